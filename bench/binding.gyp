@@ -0,0 +1,86 @@
+# Native benchmark executables, kept out of the addon build so installing
+# the package never compiles them. `npm run bench` and `npm run scan`
+# configure and build this file with `node-gyp -C bench`.
+{
+  "variables": {
+    # Same runtime lookup and scanner counters as ../binding.gyp
+    "tree_sitter_dir%": "<!(node ../bindings/node/tree_sitter_dir.js)",
+    "scanner_stats%": "<!(node -p \"['', '0'].includes(process.env.CODON_SCANNER_STATS || '') ? 0 : 1\")",
+  },
+  "targets": [
+    {
+      # Parser benchmark, run with `npm run bench`. See parse_bench.c.
+      "target_name": "codon_bench",
+      "type": "executable",
+      "include_dirs": [
+        "../src",
+        "../bindings/c",
+        "<(tree_sitter_dir)/lib/include",
+        "<(tree_sitter_dir)/lib/src",
+      ],
+      "sources": [
+        "parse_bench.c",
+        "../bindings/c/codon_memory.c",
+        "../bindings/c/codon_stats.c",
+        "../src/parser.c",
+        "../src/scanner.c",
+        "<(tree_sitter_dir)/lib/src/lib.c",
+      ],
+      "conditions": [
+        ["scanner_stats==1", {
+          "defines": [
+            "CODON_SCANNER_STATS",
+          ],
+        }],
+        ["OS!='win'", {
+          "cflags_c": [
+            "-std=c11",
+            "-O2",
+          ],
+        }, {
+          "cflags_c": [
+            "/std:c11",
+            "/utf-8",
+            "/O2",
+          ],
+        }]
+      ],
+    },
+    {
+      # Parallel corpus scanner, run with `npm run scan`. See corpus_scan.c.
+      "target_name": "codon_scan",
+      "type": "executable",
+      "include_dirs": [
+        "../src",
+        "../bindings/c",
+        "<(tree_sitter_dir)/lib/include",
+        "<(tree_sitter_dir)/lib/src",
+      ],
+      "sources": [
+        "corpus_scan.c",
+        "../bindings/c/codon_summary.c",
+        "../src/parser.c",
+        "../src/scanner.c",
+        "<(tree_sitter_dir)/lib/src/lib.c",
+      ],
+      "conditions": [
+        ["OS!='win'", {
+          "cflags_c": [
+            "-std=c11",
+            "-O2",
+            "-pthread",
+          ],
+          "ldflags": [
+            "-pthread",
+          ],
+        }, {
+          "cflags_c": [
+            "/std:c11",
+            "/utf-8",
+            "/O2",
+          ],
+        }]
+      ],
+    }
+  ]
+}
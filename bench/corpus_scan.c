@@ -0,0 +1,471 @@
+/**
+ * Parallel corpus scanner for the Codon grammar.
+ *
+ * Finds the .codon files under the given directories and parses them on
+ * a work-stealing thread pool: each worker starts with a contiguous share
+ * of the files, keeps one parser for all of them, and steals from the
+ * back of another worker's share once its own runs out. Files are mapped
+ * rather than read. One JSON line is written per file as soon as it is
+ * parsed, so lines come out in completion order:
+ *
+ *   {"path":"stdlib/a.codon","bytes":1234,"nodes":567,"errors":0,"has_error":false,"parse_ms":0.412}
+ *
+ * Files that cannot be read get {"path":...,"error":"..."} instead, and a
+ * total is printed to stderr at the end. Exits with status 1 if any file
+ * could not be read.
+ *
+ * Built as the codon_scan target of bench/binding.gyp (npm run scan), or by
+ * hand from the repository root:
+ *
+ *   cc -O2 -std=c11 -pthread -Isrc -Ibindings/c -I$TREE_SITTER_DIR/lib/include \
+ *     -I$TREE_SITTER_DIR/lib/src bench/corpus_scan.c bindings/c/codon_summary.c src/parser.c \
+ *     src/scanner.c $TREE_SITTER_DIR/lib/src/lib.c -o codon_scan
+ *
+ *   ./codon_scan [--threads N] [--ext .py] path...
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <tree_sitter/api.h>
+
+#include "codon.h"
+
+static double now_seconds(void) {
+    struct timespec ts;
+#ifdef _WIN32
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static unsigned cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? (unsigned)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned)count : 1;
+#endif
+}
+
+/* Finding files */
+
+typedef struct {
+    char **paths;
+    size_t size;
+    size_t capacity;
+    const char **extensions;
+    size_t extension_count;
+} PathList;
+
+static void path_push(PathList *list, const char *path) {
+    if (list->size == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->paths = realloc(list->paths, list->capacity * sizeof(char *));
+        if (list->paths == NULL) abort();
+    }
+    size_t length = strlen(path) + 1;
+    char *copy = malloc(length);
+    if (copy == NULL) abort();
+    memcpy(copy, path, length);
+    list->paths[list->size++] = copy;
+}
+
+static bool has_extension(const PathList *list, const char *name) {
+    const char *dot = strrchr(name, '.');
+    if (dot == NULL) return false;
+    for (size_t i = 0; i < list->extension_count; i++) {
+        if (strcmp(dot, list->extensions[i]) == 0) return true;
+    }
+    return false;
+}
+
+static char *join_path(const char *directory, const char *name) {
+    size_t length = strlen(directory) + strlen(name) + 2;
+    char *path = malloc(length);
+    if (path == NULL) abort();
+    snprintf(path, length, "%s/%s", directory, name);
+    return path;
+}
+
+// Adds a file, or every matching file under a directory in sorted order.
+// Hidden entries are skipped. Returns false if `path` cannot be read.
+static bool add_path(PathList *list, const char *path, bool explicit) {
+#ifdef _WIN32
+    DWORD attributes = GetFileAttributesA(path);
+    if (attributes == INVALID_FILE_ATTRIBUTES) return false;
+    if (attributes & FILE_ATTRIBUTE_DIRECTORY) {
+        char *pattern = join_path(path, "*");
+        WIN32_FIND_DATAA entry;
+        HANDLE find = FindFirstFileA(pattern, &entry);
+        free(pattern);
+        if (find == INVALID_HANDLE_VALUE) return false;
+        do {
+            if (entry.cFileName[0] == '.') continue;
+            bool directory = (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+            if (directory || has_extension(list, entry.cFileName)) {
+                char *child = join_path(path, entry.cFileName);
+                add_path(list, child, false);
+                free(child);
+            }
+        } while (FindNextFileA(find, &entry));
+        FindClose(find);
+        return true;
+    }
+#else
+    struct stat info;
+    if (stat(path, &info) != 0) return false;
+    if (S_ISDIR(info.st_mode)) {
+        struct dirent **entries;
+        int count = scandir(path, &entries, NULL, alphasort);
+        if (count < 0) return false;
+        for (int i = 0; i < count; i++) {
+            const char *name = entries[i]->d_name;
+            if (name[0] != '.') {
+                char *child = join_path(path, name);
+                struct stat child_info;
+                if (stat(child, &child_info) == 0 && (S_ISDIR(child_info.st_mode) || has_extension(list, name))) {
+                    add_path(list, child, false);
+                }
+                free(child);
+            }
+            free(entries[i]);
+        }
+        free(entries);
+        return true;
+    }
+#endif
+    // Files named on the command line are scanned whatever their extension
+    if (explicit || has_extension(list, path)) path_push(list, path);
+    return true;
+}
+
+/* Mapped input */
+
+typedef struct {
+    const char *data;
+    size_t length;
+#ifdef _WIN32
+    void *view;
+#endif
+} MappedFile;
+
+// Returns 0 or an errno value
+static int map_file(const char *path, MappedFile *file) {
+    file->data = "";
+    file->length = 0;
+#ifdef _WIN32
+    file->view = NULL;
+    HANDLE handle = CreateFileA(
+        path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL
+    );
+    if (handle == INVALID_HANDLE_VALUE) return ENOENT;
+    LARGE_INTEGER size;
+    int error = 0;
+    if (!GetFileSizeEx(handle, &size)) {
+        error = EIO;
+    } else if ((unsigned long long)size.QuadPart > UINT32_MAX) {
+        error = EFBIG;
+    } else if (size.QuadPart > 0) {
+        HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        file->view = mapping != NULL ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+        if (mapping != NULL) CloseHandle(mapping);
+        if (file->view == NULL) {
+            error = EIO;
+        } else {
+            file->data = file->view;
+            file->length = (size_t)size.QuadPart;
+        }
+    }
+    CloseHandle(handle);
+    return error;
+#else
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno;
+    struct stat info;
+    int error = 0;
+    if (fstat(fd, &info) != 0) {
+        error = errno;
+    } else if ((unsigned long long)info.st_size > UINT32_MAX) {
+        error = EFBIG;
+    } else if (info.st_size > 0) {
+        void *view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view == MAP_FAILED) {
+            error = errno;
+        } else {
+            file->data = view;
+            file->length = (size_t)info.st_size;
+        }
+    }
+    close(fd);
+    return error;
+#endif
+}
+
+static void unmap_file(MappedFile *file) {
+#ifdef _WIN32
+    if (file->view != NULL) UnmapViewOfFile(file->view);
+#else
+    if (file->length > 0) munmap((void *)file->data, file->length);
+#endif
+}
+
+/* Work stealing */
+
+// Files [head, tail) not yet taken from one worker's share. The owner
+// takes from the head and thieves from the tail.
+typedef struct {
+    size_t head;
+    size_t tail;
+    CodonMutex lock;
+} Share;
+
+typedef struct {
+    const PathList *paths;
+    Share *shares;
+    unsigned worker_count;
+    CodonMutex output_lock;
+    // Totals, updated under output_lock
+    size_t files;
+    size_t failed;
+    size_t with_errors;
+    uint64_t bytes;
+    double parse_seconds;
+} Scan;
+
+typedef struct {
+    Scan *scan;
+    unsigned index;
+} Worker;
+
+static bool share_take(Share *share, bool steal, size_t *file) {
+    codon_mutex_lock(&share->lock);
+    bool found = share->head < share->tail;
+    if (found) *file = steal ? --share->tail : share->head++;
+    codon_mutex_unlock(&share->lock);
+    return found;
+}
+
+// Nothing is added once the scan starts, so a worker is done when every
+// share is empty
+static bool next_file(Scan *scan, unsigned index, size_t *file) {
+    if (share_take(&scan->shares[index], false, file)) return true;
+    for (unsigned i = 1; i < scan->worker_count; i++) {
+        if (share_take(&scan->shares[(index + i) % scan->worker_count], true, file)) return true;
+    }
+    return false;
+}
+
+/* Output */
+
+typedef struct {
+    char data[8192];
+    size_t size;
+} Line;
+
+static void line_printf(Line *line, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    size_t room = sizeof(line->data) - line->size;
+    int written = vsnprintf(line->data + line->size, room, format, args);
+    va_end(args);
+    if (written > 0) line->size += (size_t)written < room ? (size_t)written : room - 1;
+}
+
+static void line_json_string(Line *line, const char *string) {
+    line_printf(line, "\"");
+    for (const unsigned char *c = (const unsigned char *)string; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            line_printf(line, "\\%c", *c);
+        } else if (*c < 0x20) {
+            line_printf(line, "\\u%04x", *c);
+        } else {
+            line_printf(line, "%c", *c);
+        }
+    }
+    line_printf(line, "\"");
+}
+
+/* Scanning */
+
+static void scan_file(Scan *scan, TSParser *parser, const char *path) {
+    Line line = {.size = 0};
+    line_printf(&line, "{\"path\":");
+    line_json_string(&line, path);
+
+    MappedFile file;
+    int error = map_file(path, &file);
+    CodonSummary summary = {0};
+    double seconds = 0;
+    if (error == 0) {
+        double started = now_seconds();
+        TSTree *tree = ts_parser_parse_string(parser, NULL, file.data, (uint32_t)file.length);
+        seconds = now_seconds() - started;
+        if (tree != NULL) {
+            codon_summarize(tree, &summary);
+            ts_tree_delete(tree);
+        } else {
+            ts_parser_reset(parser);
+            error = ECANCELED;
+        }
+        unmap_file(&file);
+    }
+
+    if (error) {
+        line_printf(&line, ",\"error\":");
+        line_json_string(&line, strerror(error));
+        line_printf(&line, "}\n");
+    } else {
+        line_printf(
+            &line, ",\"bytes\":%zu,\"nodes\":%u,\"errors\":%u,\"has_error\":%s,\"parse_ms\":%.3f}\n",
+            file.length, summary.node_count, summary.error_count,
+            summary.has_error ? "true" : "false", seconds * 1e3
+        );
+    }
+    // A path too long for the line leaves it truncated; still end it
+    if (line.data[line.size - 1] != '\n') line.data[line.size - 1] = '\n';
+
+    codon_mutex_lock(&scan->output_lock);
+    fwrite(line.data, 1, line.size, stdout);
+    scan->files++;
+    if (error) {
+        scan->failed++;
+    } else {
+        scan->bytes += file.length;
+        scan->parse_seconds += seconds;
+        if (summary.has_error) scan->with_errors++;
+    }
+    codon_mutex_unlock(&scan->output_lock);
+}
+
+static CODON_THREAD_RETURN scan_worker(void *payload) {
+    Worker *worker = payload;
+    Scan *scan = worker->scan;
+    TSParser *parser = ts_parser_new();
+    ts_parser_set_language(parser, tree_sitter_codon());
+    size_t file;
+    while (next_file(scan, worker->index, &file)) {
+        scan_file(scan, parser, scan->paths->paths[file]);
+    }
+    ts_parser_delete(parser);
+    return CODON_THREAD_RESULT;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: codon_scan [--threads N] [--ext EXT]... path...\n");
+}
+
+int main(int argc, char **argv) {
+    unsigned threads = cpu_count();
+    const char **extensions = malloc(sizeof(char *) * (size_t)(argc + 1));
+    if (extensions == NULL) abort();
+    PathList paths = {NULL, 0, 0, extensions, 0};
+    extensions[paths.extension_count++] = ".codon";
+
+    int first_path = argc;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "--threads") == 0) {
+            threads = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else if (i + 1 < argc && strcmp(argv[i], "--ext") == 0) {
+            extensions[paths.extension_count++] = argv[++i];
+        } else if (argv[i][0] == '-') {
+            usage();
+            return 2;
+        } else {
+            first_path = i;
+            break;
+        }
+    }
+    if (first_path == argc || threads == 0) {
+        usage();
+        return 2;
+    }
+
+    int status = 0;
+    double started = now_seconds();
+    for (int i = first_path; i < argc; i++) {
+        if (!add_path(&paths, argv[i], true)) {
+            fprintf(stderr, "codon_scan: cannot read %s\n", argv[i]);
+            status = 1;
+        }
+    }
+
+    if (threads > paths.size) threads = paths.size ? (unsigned)paths.size : 1;
+    Scan scan;
+    memset(&scan, 0, sizeof(scan));
+    scan.paths = &paths;
+    scan.worker_count = threads;
+    scan.shares = malloc(sizeof(Share) * threads);
+    Worker *workers = malloc(sizeof(Worker) * threads);
+    CodonThread *handles = malloc(sizeof(CodonThread) * threads);
+    if (scan.shares == NULL || workers == NULL || handles == NULL) abort();
+    codon_mutex_init(&scan.output_lock);
+    for (unsigned i = 0; i < threads; i++) {
+        scan.shares[i].head = paths.size * i / threads;
+        scan.shares[i].tail = paths.size * (i + 1) / threads;
+        codon_mutex_init(&scan.shares[i].lock);
+        workers[i].scan = &scan;
+        workers[i].index = i;
+    }
+
+    // The main thread is worker 0
+    unsigned started_threads = 0;
+    for (unsigned i = 1; i < threads; i++) {
+        if (!codon_thread_start(&handles[i], scan_worker, &workers[i])) break;
+        started_threads = i;
+    }
+    scan_worker(&workers[0]);
+    for (unsigned i = 1; i <= started_threads; i++) {
+        codon_thread_join(&handles[i]);
+    }
+    double elapsed = now_seconds() - started;
+
+    fflush(stdout);
+    fprintf(
+        stderr,
+        "codon_scan: %zu files, %zu with errors, %zu unreadable, %.1f MB in %.3f s on %u threads "
+        "(%.3f s parsing)\n",
+        scan.files, scan.with_errors, scan.failed, (double)scan.bytes / 1e6, elapsed,
+        started_threads + 1, scan.parse_seconds
+    );
+    if (scan.failed > 0) status = 1;
+
+    for (unsigned i = 0; i < threads; i++) {
+        codon_mutex_destroy(&scan.shares[i].lock);
+    }
+    codon_mutex_destroy(&scan.output_lock);
+    for (size_t i = 0; i < paths.size; i++) {
+        free(paths.paths[i]);
+    }
+    free(paths.paths);
+    free(extensions);
+    free(scan.shares);
+    free(workers);
+    free(handles);
+    return status;
+}
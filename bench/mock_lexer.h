@@ -0,0 +1,61 @@
+/**
+ * In-memory TSLexer for driving the external scanner without a parser.
+ *
+ * Include after src/scanner.c. Counts every character the scanner
+ * advances over so benchmarks can report lookahead cost.
+ */
+
+#ifndef CODON_BENCH_MOCK_LEXER_H_
+#define CODON_BENCH_MOCK_LEXER_H_
+
+typedef struct {
+    TSLexer lexer;
+    const char *source;
+    uint32_t length;
+    uint32_t position;
+    uint32_t end;
+    uint64_t advances;
+} MockLexer;
+
+static void mock_advance(TSLexer *lexer, bool skip) {
+    (void)skip;
+    MockLexer *self = (MockLexer *)lexer;
+    if (self->position < self->length) self->position++;
+    self->advances++;
+    lexer->lookahead = self->position < self->length
+        ? (unsigned char)self->source[self->position]
+        : 0;
+}
+
+static void mock_mark_end(TSLexer *lexer) {
+    MockLexer *self = (MockLexer *)lexer;
+    self->end = self->position;
+}
+
+static uint32_t mock_get_column(TSLexer *lexer) { (void)lexer; return 0; }
+
+static bool mock_eof(const TSLexer *lexer) {
+    const MockLexer *self = (const MockLexer *)lexer;
+    return self->position >= self->length;
+}
+
+static void mock_init(MockLexer *self, const char *source, uint32_t length) {
+    memset(self, 0, sizeof(*self));
+    self->source = source;
+    self->length = length;
+    self->lexer.advance = mock_advance;
+    self->lexer.mark_end = mock_mark_end;
+    self->lexer.get_column = mock_get_column;
+    self->lexer.eof = mock_eof;
+}
+
+// Position the lexer at the start of a new token
+static void mock_reset(MockLexer *self, uint32_t position) {
+    self->position = position;
+    self->end = position;
+    self->lexer.lookahead = position < self->length
+        ? (unsigned char)self->source[position]
+        : 0;
+}
+
+#endif  // CODON_BENCH_MOCK_LEXER_H_
@@ -0,0 +1,537 @@
+/**
+ * Parser benchmark for the Codon grammar.
+ *
+ * Parses the pinned synthetic inputs from synthetic.h plus any files or
+ * directories given on the command line (for example a Codon stdlib
+ * checkout) and reports, per input and overall:
+ *
+ *   - throughput in MB/s and parse latency percentiles
+ *   - incremental reparse latency after single-character insertions
+ *   - memory retained by the tree, counted through ts_set_allocator, next
+ *     to the codon_tree_memory estimate the bindings budget with
+ *   - GLR activity (stack version forks and high-water mark) for one
+ *     parse with a counting logger installed
+ *   - external scanner counters for one full parse, when built with
+ *     -DCODON_SCANNER_STATS
+ *
+ * Every input is listed with a content hash, so two runs can only be
+ * compared when they parsed the same bytes.
+ *
+ * Built as the codon_bench target of bench/binding.gyp (npm run bench), or by
+ * hand from the repository root:
+ *
+ *   cc -O2 -std=c11 -Isrc -Ibindings/c -I$TREE_SITTER_DIR/lib/include \
+ *     -I$TREE_SITTER_DIR/lib/src bench/parse_bench.c bindings/c/codon_memory.c \
+ *     bindings/c/codon_stats.c src/parser.c src/scanner.c $TREE_SITTER_DIR/lib/src/lib.c \
+ *     -o codon_bench
+ *
+ * (add -DCODON_SCANNER_STATS -pthread for the scanner line items)
+ *   ./codon_bench [--iterations N] [--edits N] [--scale N] [--json] [path...]
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include <tree_sitter/api.h>
+
+#include "codon.h"
+
+#include "synthetic.h"
+
+/* Allocation accounting */
+
+// Every block carries its size in a max_align_t header, so the live byte
+// count is exact
+typedef union {
+    size_t size;
+    max_align_t align;
+} BlockHeader;
+
+static size_t live_bytes = 0;
+
+static void *counting_malloc(size_t size) {
+    BlockHeader *block = malloc(sizeof(BlockHeader) + size);
+    if (block == NULL) return NULL;
+    block->size = size;
+    live_bytes += size;
+    return block + 1;
+}
+
+static void *counting_calloc(size_t count, size_t size) {
+    void *ptr = counting_malloc(count * size);
+    if (ptr != NULL) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+static void counting_free(void *ptr) {
+    if (ptr == NULL) return;
+    BlockHeader *block = (BlockHeader *)ptr - 1;
+    live_bytes -= block->size;
+    free(block);
+}
+
+static void *counting_realloc(void *ptr, size_t size) {
+    if (ptr == NULL) return counting_malloc(size);
+    BlockHeader *block = (BlockHeader *)ptr - 1;
+    size_t old_size = block->size;
+    block = realloc(block, sizeof(BlockHeader) + size);
+    if (block == NULL) return NULL;
+    block->size = size;
+    live_bytes += size;
+    live_bytes -= old_size;
+    return block + 1;
+}
+
+/* Timing and statistics */
+
+static double now_seconds(void) {
+    struct timespec ts;
+#ifdef _WIN32
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of a sorted sample
+static double percentile(const double *sorted, size_t count, double p) {
+    if (count == 0) return 0;
+    size_t rank = (size_t)(p / 100.0 * (double)count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1];
+}
+
+static uint64_t fnv1a(const char *data, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+/* Inputs */
+
+typedef struct {
+    char *name;
+    char *data;
+    uint32_t length;
+} Input;
+
+typedef struct {
+    Input *items;
+    size_t size;
+    size_t capacity;
+} InputList;
+
+static void input_push(InputList *list, const char *name, char *data, uint32_t length) {
+    if (list->size == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 16;
+        list->items = realloc(list->items, list->capacity * sizeof(Input));
+        if (list->items == NULL) abort();
+    }
+    Input *input = &list->items[list->size++];
+    input->name = malloc(strlen(name) + 1);
+    if (input->name == NULL) abort();
+    strcpy(input->name, name);
+    input->data = data;
+    input->length = length;
+}
+
+static bool read_input(InputList *list, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *data = size >= 0 && (unsigned long)size <= UINT32_MAX ? malloc((size_t)size + 1) : NULL;
+    bool ok = data != NULL && fread(data, 1, (size_t)size, file) == (size_t)size;
+    fclose(file);
+    if (!ok) {
+        free(data);
+        return false;
+    }
+    input_push(list, path, data, (uint32_t)size);
+    return true;
+}
+
+static bool has_source_extension(const char *name) {
+    const char *dot = strrchr(name, '.');
+    return dot != NULL && (strcmp(dot, ".codon") == 0 || strcmp(dot, ".py") == 0);
+}
+
+// Adds a file, or every .codon and .py file under a directory in sorted
+// order, so the corpus order is stable across file systems
+static bool add_path(InputList *list, const char *path) {
+#ifndef _WIN32
+    struct stat info;
+    if (stat(path, &info) == 0 && S_ISDIR(info.st_mode)) {
+        struct dirent **entries;
+        int count = scandir(path, &entries, NULL, alphasort);
+        if (count < 0) return false;
+        bool ok = true;
+        for (int i = 0; i < count; i++) {
+            const char *name = entries[i]->d_name;
+            if (name[0] != '.') {
+                size_t length = strlen(path) + strlen(name) + 2;
+                char *child = malloc(length);
+                if (child == NULL) abort();
+                snprintf(child, length, "%s/%s", path, name);
+                struct stat child_info;
+                if (stat(child, &child_info) == 0 && (S_ISDIR(child_info.st_mode) || has_source_extension(name))) {
+                    ok = add_path(list, child) && ok;
+                }
+                free(child);
+            }
+            free(entries[i]);
+        }
+        free(entries);
+        return ok;
+    }
+#endif
+    return read_input(list, path);
+}
+
+/* Measurements */
+
+typedef struct {
+    double parse_p50;
+    double parse_p99;
+    double reparse_p50;
+    double reparse_p99;
+    size_t tree_bytes;
+    uint64_t estimated_tree_bytes;
+    uint32_t node_count;
+    bool has_error;
+    CodonParseStats glr;
+#ifdef CODON_SCANNER_STATS
+    CodonScannerStats scanner;
+#endif
+} Measurement;
+
+static TSPoint point_at(const char *data, uint32_t byte) {
+    TSPoint point = {0, 0};
+    for (uint32_t i = 0; i < byte; i++) {
+        if (data[i] == '\n') {
+            point.row++;
+            point.column = 0;
+        } else {
+            point.column++;
+        }
+    }
+    return point;
+}
+
+// Inserts one character at `edit_count` pseudo-random offsets, each applied
+// to a fresh copy of `tree`, and times the edit plus the reparse
+static void measure_reparse(
+    TSParser *parser, const TSTree *tree, const Input *input,
+    unsigned edit_count, double *samples
+) {
+    uint32_t state = SYNTHETIC_SEED ^ input->length;
+    char *edited = malloc((size_t)input->length + 1);
+    if (edited == NULL) abort();
+
+    for (unsigned e = 0; e < edit_count; e++) {
+        uint32_t offset = input->length ? synthetic_next(&state) % input->length : 0;
+        memcpy(edited, input->data, offset);
+        edited[offset] = 'x';
+        memcpy(edited + offset + 1, input->data + offset, input->length - offset);
+
+        TSPoint start = point_at(input->data, offset);
+        TSInputEdit edit = {
+            offset, offset, offset + 1,
+            start, start, {start.row, start.column + 1},
+        };
+        TSTree *old_tree = ts_tree_copy(tree);
+
+        double started = now_seconds();
+        ts_tree_edit(old_tree, &edit);
+        TSTree *new_tree = ts_parser_parse_string(parser, old_tree, edited, input->length + 1);
+        samples[e] = now_seconds() - started;
+
+        ts_tree_delete(new_tree);
+        ts_tree_delete(old_tree);
+    }
+    free(edited);
+}
+
+static void measure(
+    TSParser *parser, const Input *input, unsigned iterations, unsigned edits,
+    double *samples, Measurement *result
+) {
+    // A warm-up parse measures retained tree memory: whatever is freed when
+    // the tree is deleted
+#ifdef CODON_SCANNER_STATS
+    codon_scanner_stats_reset();
+#endif
+    TSTree *tree = ts_parser_parse_string(parser, NULL, input->data, input->length);
+    size_t with_tree = live_bytes;
+#ifdef CODON_SCANNER_STATS
+    codon_scanner_stats_read(&result->scanner);
+#endif
+    ts_tree_delete(tree);
+    result->tree_bytes = with_tree - live_bytes;
+
+    tree = ts_parser_parse_string(parser, NULL, input->data, input->length);
+    CodonTreeMemory memory;
+    codon_tree_memory(tree, &memory);
+    result->estimated_tree_bytes = memory.total_bytes;
+    TSNode root = ts_tree_root_node(tree);
+    result->node_count = ts_node_descendant_count(root);
+    result->has_error = ts_node_has_error(root);
+
+    // Logging is slow, so the GLR counts come from a separate, untimed parse
+    ts_parser_set_logger(parser, codon_parse_stats_logger(&result->glr, NULL, NULL));
+    ts_tree_delete(ts_parser_parse_string(parser, NULL, input->data, input->length));
+    ts_parser_set_logger(parser, (TSLogger){NULL, NULL});
+
+    for (unsigned i = 0; i < iterations; i++) {
+        double started = now_seconds();
+        TSTree *parsed = ts_parser_parse_string(parser, NULL, input->data, input->length);
+        samples[i] = now_seconds() - started;
+        ts_tree_delete(parsed);
+    }
+    qsort(samples, iterations, sizeof(double), compare_doubles);
+    result->parse_p50 = percentile(samples, iterations, 50);
+    result->parse_p99 = percentile(samples, iterations, 99);
+
+    measure_reparse(parser, tree, input, edits, samples);
+    qsort(samples, edits, sizeof(double), compare_doubles);
+    result->reparse_p50 = percentile(samples, edits, 50);
+    result->reparse_p99 = percentile(samples, edits, 99);
+
+    ts_tree_delete(tree);
+}
+
+/* Reporting */
+
+static double ratio(uint64_t part, uint64_t whole) {
+    return whole ? (double)part / (double)whole : 0;
+}
+
+static void print_json_string(const char *string) {
+    putchar('"');
+    for (const char *c = string; *c; c++) {
+        if (*c == '"' || *c == '\\') putchar('\\');
+        if ((unsigned char)*c < 0x20) {
+            printf("\\u%04x", (unsigned char)*c);
+        } else {
+            putchar(*c);
+        }
+    }
+    putchar('"');
+}
+
+static double megabytes_per_second(uint64_t bytes, double seconds) {
+    return seconds > 0 ? (double)bytes / seconds / 1e6 : 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: codon_bench [--iterations N] [--edits N] [--scale N] [--json] [path...]\n");
+}
+
+int main(int argc, char **argv) {
+    unsigned iterations = 10, edits = 50;
+    int scale = 1;
+    bool json = false;
+    InputList inputs = {NULL, 0, 0};
+
+    // The allocator has to be in place before any tree-sitter object exists
+    ts_set_allocator(counting_malloc, counting_calloc, counting_realloc, counting_free);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (i + 1 < argc && strcmp(argv[i], "--iterations") == 0) {
+            iterations = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else if (i + 1 < argc && strcmp(argv[i], "--edits") == 0) {
+            edits = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else if (i + 1 < argc && strcmp(argv[i], "--scale") == 0) {
+            scale = atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            usage();
+            return 2;
+        } else if (!add_path(&inputs, argv[i])) {
+            fprintf(stderr, "codon_bench: cannot read %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (iterations == 0 || scale < 1) {
+        usage();
+        return 2;
+    }
+
+    SyntheticInput synthetic[SYNTHETIC_INPUT_COUNT];
+    synthetic_generate(synthetic, scale);
+    for (int i = 0; i < SYNTHETIC_INPUT_COUNT; i++) {
+        input_push(&inputs, synthetic[i].name, synthetic[i].text.data, (uint32_t)synthetic[i].text.size);
+    }
+
+    TSParser *parser = ts_parser_new();
+    ts_parser_set_language(parser, tree_sitter_codon());
+
+    double *samples = malloc(sizeof(double) * (iterations > edits ? iterations : edits));
+    double *file_latencies = malloc(sizeof(double) * (inputs.size ? inputs.size : 1));
+    Measurement *results = malloc(sizeof(Measurement) * (inputs.size ? inputs.size : 1));
+    if (samples == NULL || file_latencies == NULL || results == NULL) abort();
+
+    uint64_t total_bytes = 0;
+    double total_seconds = 0;
+    for (size_t i = 0; i < inputs.size; i++) {
+        measure(parser, &inputs.items[i], iterations, edits, samples, &results[i]);
+        file_latencies[i] = results[i].parse_p50;
+        total_bytes += inputs.items[i].length;
+        total_seconds += results[i].parse_p50;
+    }
+    qsort(file_latencies, inputs.size, sizeof(double), compare_doubles);
+
+    if (json) {
+        printf("{\"iterations\":%u,\"edits\":%u,\"scale\":%d,\"inputs\":[", iterations, edits, scale);
+        for (size_t i = 0; i < inputs.size; i++) {
+            const Input *input = &inputs.items[i];
+            const Measurement *r = &results[i];
+            printf(i ? ",{\"name\":" : "{\"name\":");
+            print_json_string(input->name);
+            printf(
+                ",\"hash\":\"%016llx\",\"bytes\":%u,\"nodes\":%u,\"has_error\":%s,"
+                "\"mb_per_s\":%.3f,\"parse_ms_p50\":%.4f,\"parse_ms_p99\":%.4f,"
+                "\"reparse_ms_p50\":%.4f,\"reparse_ms_p99\":%.4f,\"tree_bytes\":%zu,"
+                "\"estimated_tree_bytes\":%llu",
+                (unsigned long long)fnv1a(input->data, input->length), input->length,
+                r->node_count, r->has_error ? "true" : "false",
+                megabytes_per_second(input->length, r->parse_p50),
+                r->parse_p50 * 1e3, r->parse_p99 * 1e3,
+                r->reparse_p50 * 1e3, r->reparse_p99 * 1e3, r->tree_bytes,
+                (unsigned long long)r->estimated_tree_bytes
+            );
+            printf(
+                ",\"glr\":{\"steps\":%llu,\"forked_steps\":%llu,\"forks\":%llu,\"max_versions\":%u,"
+                "\"shifts\":%llu,\"reductions\":%llu}",
+                (unsigned long long)r->glr.steps, (unsigned long long)r->glr.forked_steps,
+                (unsigned long long)r->glr.forks, r->glr.max_versions,
+                (unsigned long long)r->glr.shifts, (unsigned long long)r->glr.reductions
+            );
+#ifdef CODON_SCANNER_STATS
+            const CodonScannerStats *stats = &r->scanner;
+            printf(
+                ",\"scanner\":{\"calls\":%llu,\"chars\":%llu,\"wasted_calls\":%llu,"
+                "\"wasted_chars\":%llu,\"serialize_bytes\":%llu,\"deserialize_bytes\":%llu,\"tokens\":{",
+                (unsigned long long)stats->scan_calls, (unsigned long long)stats->chars,
+                (unsigned long long)stats->wasted_calls, (unsigned long long)stats->wasted_chars,
+                (unsigned long long)stats->serialize_bytes, (unsigned long long)stats->deserialize_bytes
+            );
+            for (int t = 0; t < CODON_SCANNER_TOKEN_COUNT; t++) {
+                printf(
+                    "%s\"%s\":%llu", t ? "," : "", codon_scanner_token_names[t],
+                    (unsigned long long)stats->tokens[t]
+                );
+            }
+            printf("}}");
+#endif
+            printf("}");
+        }
+        printf(
+            "],\"total\":{\"bytes\":%llu,\"mb_per_s\":%.3f,\"file_ms_p50\":%.4f,"
+            "\"file_ms_p90\":%.4f,\"file_ms_p99\":%.4f,\"file_ms_max\":%.4f}}\n",
+            (unsigned long long)total_bytes, megabytes_per_second(total_bytes, total_seconds),
+            percentile(file_latencies, inputs.size, 50) * 1e3,
+            percentile(file_latencies, inputs.size, 90) * 1e3,
+            percentile(file_latencies, inputs.size, 99) * 1e3,
+            percentile(file_latencies, inputs.size, 100) * 1e3
+        );
+    } else {
+        printf(
+            "%-28s %-16s %10s %9s %10s %10s %11s %11s %12s %12s\n",
+            "input", "hash", "bytes", "MB/s", "parse p50", "parse p99",
+            "reparse p50", "reparse p99", "tree bytes", "estimated"
+        );
+        for (size_t i = 0; i < inputs.size; i++) {
+            const Input *input = &inputs.items[i];
+            const Measurement *r = &results[i];
+            printf(
+                "%-28s %016llx %10u %9.2f %8.3fms %8.3fms %9.3fms %9.3fms %12zu %12llu%s\n",
+                input->name, (unsigned long long)fnv1a(input->data, input->length),
+                input->length, megabytes_per_second(input->length, r->parse_p50),
+                r->parse_p50 * 1e3, r->parse_p99 * 1e3,
+                r->reparse_p50 * 1e3, r->reparse_p99 * 1e3, r->tree_bytes,
+                (unsigned long long)r->estimated_tree_bytes,
+                r->has_error ? "  (has errors)" : ""
+            );
+        }
+        printf(
+            "\n%zu inputs, %llu bytes, %.2f MB/s; per-file latency p50 %.3fms p90 %.3fms p99 %.3fms max %.3fms\n",
+            inputs.size, (unsigned long long)total_bytes, megabytes_per_second(total_bytes, total_seconds),
+            percentile(file_latencies, inputs.size, 50) * 1e3,
+            percentile(file_latencies, inputs.size, 90) * 1e3,
+            percentile(file_latencies, inputs.size, 99) * 1e3,
+            percentile(file_latencies, inputs.size, 100) * 1e3
+        );
+
+        printf(
+            "\n%-28s %10s %9s %8s %12s %10s %10s\n",
+            "GLR (one parse)", "steps", "forked", "forks", "max versions", "shifts", "reductions"
+        );
+        for (size_t i = 0; i < inputs.size; i++) {
+            const CodonParseStats *glr = &results[i].glr;
+            printf(
+                "%-28s %10llu %8.1f%% %8llu %12u %10llu %10llu\n",
+                inputs.items[i].name, (unsigned long long)glr->steps,
+                ratio(glr->forked_steps, glr->steps) * 100, (unsigned long long)glr->forks,
+                glr->max_versions, (unsigned long long)glr->shifts,
+                (unsigned long long)glr->reductions
+            );
+        }
+#ifdef CODON_SCANNER_STATS
+        printf(
+            "\n%-28s %10s %11s %11s %12s %12s %12s\n",
+            "scanner (one parse)", "calls", "chars/call", "wasted", "wasted chars",
+            "serialized", "deserialized"
+        );
+        for (size_t i = 0; i < inputs.size; i++) {
+            const CodonScannerStats *stats = &results[i].scanner;
+            printf(
+                "%-28s %10llu %11.2f %10.1f%% %11.1f%% %12llu %12llu\n",
+                inputs.items[i].name, (unsigned long long)stats->scan_calls,
+                ratio(stats->chars, stats->scan_calls),
+                ratio(stats->wasted_calls, stats->scan_calls) * 100,
+                ratio(stats->wasted_chars, stats->chars) * 100,
+                (unsigned long long)stats->serialize_bytes,
+                (unsigned long long)stats->deserialize_bytes
+            );
+        }
+#endif
+    }
+
+    ts_parser_delete(parser);
+    for (size_t i = 0; i < inputs.size; i++) {
+        free(inputs.items[i].name);
+        free(inputs.items[i].data);
+    }
+    free(inputs.items);
+    free(samples);
+    free(file_latencies);
+    free(results);
+    return 0;
+}
@@ -0,0 +1,22 @@
+/**
+ * Runs one of the native executables built by bench/binding.gyp.
+ *
+ *   npm run bench -- [--iterations N] [--edits N] [--scale N] [--json] [path...]
+ *   npm run scan -- [--threads N] [--ext EXT] path...
+ */
+
+const { spawnSync } = require("child_process");
+const path = require("path");
+
+const [target, ...args] = process.argv.slice(2);
+const executable = path.join(
+  __dirname, "build", "Release",
+  process.platform === "win32" ? `${target}.exe` : target,
+);
+
+const { status, error } = spawnSync(executable, args, { stdio: "inherit" });
+if (error) {
+  console.error(`cannot run ${executable}: ${error.message}`);
+  process.exit(1);
+}
+process.exit(status);
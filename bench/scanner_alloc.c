@@ -0,0 +1,129 @@
+/**
+ * Micro-benchmark for heap allocations in the Codon external scanner.
+ *
+ * Drives the scanner the way the parser does around every external token
+ * (deserialize, scan, serialize) over a synthetic, deeply nested source,
+ * for many short-lived scanner instances, and counts the calls that go
+ * through ts_malloc / ts_calloc / ts_realloc.
+ *
+ * Build and run from the repository root:
+ *
+ *   cc -O2 -std=c11 -Isrc bench/scanner_alloc.c -o scanner_alloc
+ *   ./scanner_alloc [scanners]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static size_t malloc_calls = 0;
+static size_t calloc_calls = 0;
+static size_t realloc_calls = 0;
+static size_t free_calls = 0;
+
+static void *counting_malloc(size_t size) { malloc_calls++; return malloc(size); }
+static void *counting_calloc(size_t count, size_t size) { calloc_calls++; return calloc(count, size); }
+static void *counting_realloc(void *ptr, size_t size) { realloc_calls++; return realloc(ptr, size); }
+static void counting_free(void *ptr) { if (ptr) free_calls++; free(ptr); }
+
+#define ts_malloc counting_malloc
+#define ts_calloc counting_calloc
+#define ts_realloc counting_realloc
+#define ts_free counting_free
+
+#include "../src/scanner.c"
+#include "mock_lexer.h"
+
+// Nested functions with f-strings, closing every level at the bottom.
+static char *make_source(int depth, int repeat, uint32_t *length) {
+    size_t capacity = (size_t)repeat * depth * (depth * 8 + 64) + 1;
+    char *source = malloc(capacity);
+    size_t size = 0;
+    for (int r = 0; r < repeat; r++) {
+        for (int d = 0; d < depth; d++) {
+            size += sprintf(source + size, "%*sdef f%d(x):\n", d * 4, "", d);
+            size += sprintf(source + size, "%*sy = f\"{x}-%d\"\n", d * 4 + 4, "", d);
+        }
+    }
+    *length = (uint32_t)size;
+    return source;
+}
+
+static size_t run(void *scanner, MockLexer *lexer, char *state, unsigned *state_length) {
+    bool newline_symbols[PREC + 1] = {false};
+    newline_symbols[NEWLINE] = newline_symbols[INDENT] = newline_symbols[DEDENT] = true;
+    bool start_symbols[PREC + 1] = {false};
+    start_symbols[STRING_START] = true;
+    bool string_symbols[PREC + 1] = {false};
+    string_symbols[STRING_CONTENT] = string_symbols[STRING_END] = true;
+
+    size_t scans = 0;
+    uint32_t position = 0;
+    while (position < lexer->length) {
+        char c = lexer->source[position];
+        const bool *valid_symbols;
+        if (c == '\n') {
+            valid_symbols = newline_symbols;
+        } else if (c == 'f' && lexer->source[position + 1] == '"') {
+            valid_symbols = start_symbols;
+        } else {
+            position++;
+            continue;
+        }
+
+        // Scan one external token and, for strings, everything up to the end
+        while (true) {
+            tree_sitter_codon_external_scanner_deserialize(scanner, state, *state_length);
+            mock_reset(lexer, position);
+            bool found = tree_sitter_codon_external_scanner_scan(scanner, &lexer->lexer, valid_symbols);
+            scans++;
+            if (!found) {
+                position++;
+                break;
+            }
+            *state_length = tree_sitter_codon_external_scanner_serialize(scanner, state);
+            position = lexer->end > position ? lexer->end : position + 1;
+            if (lexer->lexer.result_symbol == STRING_END || valid_symbols == newline_symbols) break;
+            valid_symbols = string_symbols;
+            if (lexer->source[position] == '{') {
+                // Skip the interpolation the grammar would parse
+                while (lexer->source[position] != '}') position++;
+                position++;
+            }
+        }
+    }
+    return scans;
+}
+
+int main(int argc, char **argv) {
+    int scanners = argc > 1 ? atoi(argv[1]) : 10000;
+    uint32_t length;
+    char *source = make_source(24, 4, &length);
+
+    MockLexer lexer;
+    mock_init(&lexer, source, length);
+
+    char state[TREE_SITTER_SERIALIZATION_BUFFER_SIZE];
+    size_t scans = 0;
+    clock_t start = clock();
+    for (int i = 0; i < scanners; i++) {
+        void *scanner = tree_sitter_codon_external_scanner_create();
+        unsigned state_length = 0;
+        scans += run(scanner, &lexer, state, &state_length);
+        tree_sitter_codon_external_scanner_destroy(scanner);
+    }
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    size_t allocations = malloc_calls + calloc_calls + realloc_calls;
+    printf("scanners:              %d\n", scanners);
+    printf("scan calls:            %zu\n", scans);
+    printf("malloc/calloc/realloc: %zu/%zu/%zu\n", malloc_calls, calloc_calls, realloc_calls);
+    printf("frees:                 %zu\n", free_calls);
+    printf("allocations/scanner:   %.2f\n", (double)allocations / scanners);
+    printf("allocations/1k scans:  %.3f\n", 1000.0 * allocations / scans);
+    printf("time:                  %.3fs\n", seconds);
+
+    free(source);
+    return 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * Deterministic synthetic Codon sources for benchmarks.
+ *
+ * Every generator depends only on its size arguments and a fixed seed, so
+ * the same build always benchmarks byte-identical inputs. Each one
+ * stresses one part of the grammar: deep indentation, long |> pipelines
+ * (alone and inside conditions), large extern blocks and big literal
+ * tables.
+ */
+
+#ifndef CODON_BENCH_SYNTHETIC_H_
+#define CODON_BENCH_SYNTHETIC_H_
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} TextBuffer;
+
+static void text_printf(TextBuffer *text, const char *format, ...) {
+    for (;;) {
+        va_list args;
+        va_start(args, format);
+        size_t room = text->capacity - text->size;
+        int written = vsnprintf(text->data + text->size, room, format, args);
+        va_end(args);
+        if (written < 0) abort();
+        if ((size_t)written < room) {
+            text->size += (size_t)written;
+            return;
+        }
+        text->capacity = text->capacity * 2 + (size_t)written + 1;
+        text->data = realloc(text->data, text->capacity);
+        if (text->data == NULL) abort();
+    }
+}
+
+// Small xorshift PRNG so generated inputs do not depend on the C library
+static uint32_t synthetic_next(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+#define SYNTHETIC_SEED 0x9e3779b9u
+
+// Functions nested `depth` levels deep, with control flow at each level
+static void synthetic_nesting(TextBuffer *text, int depth, int repeat) {
+    for (int r = 0; r < repeat; r++) {
+        for (int d = 0; d < depth; d++) {
+            int indent = d * 4;
+            switch (d % 4) {
+                case 0: text_printf(text, "%*sdef level%d_%d(x: int) -> int:\n", indent, "", r, d); break;
+                case 1: text_printf(text, "%*sfor i in range(x):\n", indent, ""); break;
+                case 2: text_printf(text, "%*sif i %% %d == 0:\n", indent, "", d + 1); break;
+                default: text_printf(text, "%*swhile x > %d:\n", indent, "", d); break;
+            }
+            text_printf(text, "%*sx = x + %d  # level %d\n", indent + 4, "", d, d);
+        }
+        text_printf(text, "%*sreturn x\n\n", depth * 4, "");
+    }
+}
+
+// Assignments whose right-hand side is a chain of `stages` |> and ||> calls
+static void synthetic_pipelines(TextBuffer *text, int stages, int lines) {
+    uint32_t state = SYNTHETIC_SEED;
+    for (int l = 0; l < lines; l++) {
+        text_printf(text, "result%d = range(%d)", l, l + 10);
+        for (int s = 0; s < stages; s++) {
+            uint32_t roll = synthetic_next(&state);
+            text_printf(text, " %s ", roll & 1 ? "|>" : "||>");
+            switch (roll >> 1 & 3) {
+                case 0: text_printf(text, "stage%d", s); break;
+                case 1: text_printf(text, "stage%d(...)", s); break;
+                case 2: text_printf(text, "stage%d(..., %u)", s, roll % 100); break;
+                default: text_printf(text, "mod%d.stage%d(k=%u)", s % 7, s, roll % 10); break;
+            }
+        }
+        text_printf(text, "\n");
+    }
+}
+
+// Pipelines mixed with comparisons, conditionals, walrus and
+// comprehensions, the contexts where pipes fork the parser
+static void synthetic_pipeline_conditions(TextBuffer *text, int stages, int lines) {
+    for (int l = 0; l < lines; l++) {
+        text_printf(text, "if (n%d := xs", l);
+        for (int s = 0; s < stages; s++) text_printf(text, " |> f%d", s);
+        text_printf(text, ") > %d and not ys ||> g(...) < limit:\n", l);
+        text_printf(text, "    out = [v |> h for v in vals if v |> ok] if n%d else fallback |> len\n", l);
+        text_printf(text, "    flag = a |> f < b |> g == c |> h\n");
+    }
+}
+
+// @llvm functions with `body_lines` lines of IR each
+static void synthetic_externs(TextBuffer *text, int body_lines, int functions) {
+    for (int f = 0; f < functions; f++) {
+        text_printf(text, "@llvm\ndef kernel%d(a: int, b: int) -> int:\n", f);
+        text_printf(text, "    %%v0 = add i64 %%a, %%b\n");
+        for (int l = 1; l < body_lines; l++) {
+            if (l % 16 == 0) text_printf(text, "    ; block %d\n", l / 16);
+            text_printf(text, "    %%v%d = mul i64 %%v%d, %d\n", l, l - 1, l % 13 + 1);
+        }
+        text_printf(text, "    ret i64 %%v%d\n\n", body_lines - 1);
+    }
+}
+
+// One dict literal with `rows` entries of mixed literals
+static void synthetic_literals(TextBuffer *text, int rows) {
+    uint32_t state = SYNTHETIC_SEED;
+    text_printf(text, "TABLE = {\n");
+    for (int r = 0; r < rows; r++) {
+        uint32_t a = synthetic_next(&state), b = synthetic_next(&state);
+        text_printf(
+            text, "    \"key%d\": [%u, %u.%02u, 0x%x, 'name%u', (%u, None), True],\n",
+            r, a % 100000, b % 1000, a % 100, b, a % 997, b % 31
+        );
+    }
+    text_printf(text, "}\n");
+}
+
+// Ordinary code: classes, methods, comprehensions and f-strings
+static void synthetic_mixed(TextBuffer *text, int classes) {
+    for (int c = 0; c < classes; c++) {
+        text_printf(text, "class Point%d[T]:\n", c);
+        text_printf(text, "    x: T\n    y: T\n\n");
+        text_printf(text, "    def __init__(self, x: T, y: T):\n");
+        text_printf(text, "        self.x = x\n        self.y = y\n\n");
+        text_printf(text, "    def norm(self) -> float:\n");
+        text_printf(text, "        squares = [v * v for v in (self.x, self.y) if v]\n");
+        text_printf(text, "        return sum(squares) ** 0.5\n\n");
+        text_printf(text, "    def __repr__(self) -> str:\n");
+        text_printf(text, "        return f\"Point%d({self.x}, {self.y!r:>{%d}})\"\n\n", c, c % 9 + 1);
+    }
+}
+
+typedef struct {
+    const char *name;
+    TextBuffer text;
+} SyntheticInput;
+
+#define SYNTHETIC_INPUT_COUNT 6
+
+// Fills `inputs` with the pinned benchmark set; `scale` multiplies sizes
+static void synthetic_generate(SyntheticInput inputs[SYNTHETIC_INPUT_COUNT], int scale) {
+    memset(inputs, 0, sizeof(SyntheticInput) * SYNTHETIC_INPUT_COUNT);
+    inputs[0].name = "synthetic/nesting";
+    synthetic_nesting(&inputs[0].text, 48, 40 * scale);
+    inputs[1].name = "synthetic/pipelines";
+    synthetic_pipelines(&inputs[1].text, 200, 50 * scale);
+    inputs[2].name = "synthetic/externs";
+    synthetic_externs(&inputs[2].text, 5000, 4 * scale);
+    inputs[3].name = "synthetic/literals";
+    synthetic_literals(&inputs[3].text, 20000 * scale);
+    inputs[4].name = "synthetic/mixed";
+    synthetic_mixed(&inputs[4].text, 400 * scale);
+    inputs[5].name = "synthetic/pipeline_conditions";
+    synthetic_pipeline_conditions(&inputs[5].text, 12, 2000 * scale);
+}
+
+#endif  // CODON_BENCH_SYNTHETIC_H_
@@ -0,0 +1,85 @@
+/**
+ * Reports the size of the parse tables in a generated parser.c.
+ *
+ *   node bench/table_size.js [src/parser.c] [--json]
+ *
+ * Byte counts are for the static tables as the C compiler lays them out
+ * (uint16_t parse table entries, 8-byte parse actions, 6-byte lex modes),
+ * so two grammars can be compared without building either.
+ */
+
+const fs = require("fs");
+const path = require("path");
+
+const args = process.argv.slice(2);
+const json = args.includes("--json");
+const file = args.find((arg) => !arg.startsWith("--")) ||
+  path.join(__dirname, "..", "src", "parser.c");
+const source = fs.readFileSync(file, "utf8");
+
+function define(name) {
+  const match = source.match(new RegExp(`^#define ${name} (\\d+)$`, "m"));
+  return match ? Number(match[1]) : 0;
+}
+
+// Body of `static const <type> <name>[...] = { ... };`
+function arrayBody(name) {
+  const start = source.search(new RegExp(`\\b${name}\\[[^\\]]*\\](\\[[^\\]]*\\])? = \\{`));
+  if (start < 0) return "";
+  const open = source.indexOf("{", start);
+  const close = source.indexOf("\n};", open);
+  return source.slice(open + 1, close);
+}
+
+// Counts the elements of a flat initializer, ignoring [index] designators
+function elementCount(body) {
+  return body
+    .replace(/\/\*[\s\S]*?\*\//g, "")
+    .replace(/\[[^\]]+\]\s*=/g, "")
+    .split(",")
+    .filter((element) => element.trim() !== "")
+    .length;
+}
+
+const stateCount = define("STATE_COUNT");
+const largeStateCount = define("LARGE_STATE_COUNT");
+const symbolCount = define("SYMBOL_COUNT");
+const smallTableEntries = elementCount(arrayBody("ts_small_parse_table"));
+const actionEntries = (arrayBody("ts_parse_actions")
+  .match(/\{\.entry|\b(SHIFT|SHIFT_REPEAT|SHIFT_EXTRA|REDUCE|RECOVER|ACCEPT_INPUT)\(/g) || []).length;
+const lexFunctions = source.match(/^static bool ts_lex(_keywords)?\(TSLexer \*lexer, TSStateId state\) \{[\s\S]*?^\}$/gm) || [];
+
+const report = {
+  file,
+  state_count: stateCount,
+  large_state_count: largeStateCount,
+  symbol_count: symbolCount,
+  token_count: define("TOKEN_COUNT"),
+  field_count: define("FIELD_COUNT"),
+  production_id_count: define("PRODUCTION_ID_COUNT"),
+  bytes: {
+    parse_table: largeStateCount * symbolCount * 2,
+    small_parse_table: smallTableEntries * 2,
+    small_parse_table_map: (stateCount - largeStateCount) * 4,
+    parse_actions: actionEntries * 8,
+    lex_modes: stateCount * 6,
+    primary_state_ids: stateCount * 2,
+  },
+  lex_function_lines: lexFunctions.reduce((total, body) => total + body.split("\n").length, 0),
+  source_lines: source.split("\n").length,
+};
+report.bytes.total = Object.values(report.bytes).reduce((a, b) => a + b, 0);
+
+if (json) {
+  console.log(JSON.stringify(report));
+} else {
+  console.log(`${report.file}: ${report.source_lines} lines`);
+  console.log(
+    `states ${stateCount} (large ${largeStateCount}), symbols ${symbolCount}, ` +
+    `tokens ${report.token_count}, fields ${report.field_count}, productions ${report.production_id_count}`,
+  );
+  for (const [name, bytes] of Object.entries(report.bytes)) {
+    console.log(`  ${name.padEnd(22)} ${String(bytes).padStart(10)} bytes`);
+  }
+  console.log(`  lexer functions        ${String(report.lex_function_lines).padStart(10)} lines`);
+}
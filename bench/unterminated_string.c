@@ -0,0 +1,75 @@
+/**
+ * Pathological-input benchmark: a docstring that is never closed.
+ *
+ * While recovering from the error the parser calls the external scanner
+ * again at many positions inside the unterminated string, with every
+ * external token valid. This replays that pattern (one call at the start
+ * of every line, inside an open triple-quoted string) for growing inputs
+ * and reports how many characters the scanner advances over. The
+ * per-byte figures stay flat when scanning is linear in the input size.
+ *
+ * Build and run from the repository root:
+ *
+ *   cc -O2 -std=c11 -Isrc bench/unterminated_string.c -o unterminated_string
+ *   ./unterminated_string
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/scanner.c"
+#include "mock_lexer.h"
+
+static char *make_source(int lines, uint32_t *length) {
+    const char *header = "def f():\n    \"\"\"";
+    size_t capacity = strlen(header) + (size_t)lines * 64 + 1;
+    char *source = malloc(capacity);
+    size_t size = (size_t)sprintf(source, "%s", header);
+    for (int i = 0; i < lines; i++) {
+        size += (size_t)sprintf(source + size, "    half-typed docstring, line %d\n", i);
+    }
+    *length = (uint32_t)size;
+    return source;
+}
+
+int main(void) {
+    bool all_symbols[PREC + 1];
+    for (int i = 0; i <= PREC; i++) all_symbols[i] = true;
+
+    // Scanner state inside an open """ string
+    Scanner *scanner = tree_sitter_codon_external_scanner_create();
+    stack_push(&scanner->indents, 4);
+    stack_push(&scanner->delimiters, '"' | DELIMITER_TRIPLE);
+    char state[TREE_SITTER_SERIALIZATION_BUFFER_SIZE];
+    unsigned state_length = tree_sitter_codon_external_scanner_serialize(scanner, state);
+
+    printf("%8s %10s %8s %14s %12s %12s\n",
+           "lines", "bytes", "calls", "chars scanned", "chars/byte", "ns/byte");
+    for (int lines = 1000; lines <= 32000; lines *= 2) {
+        uint32_t length;
+        char *source = make_source(lines, &length);
+        MockLexer lexer;
+        mock_init(&lexer, source, length);
+
+        uint32_t calls = 0;
+        clock_t start = clock();
+        for (uint32_t position = 0; position < length; position++) {
+            if (position > 0 && source[position - 1] != '\n') continue;
+            tree_sitter_codon_external_scanner_deserialize(scanner, state, state_length);
+            mock_reset(&lexer, position);
+            tree_sitter_codon_external_scanner_scan(scanner, &lexer.lexer, all_symbols);
+            calls++;
+        }
+        double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        printf("%8d %10u %8u %14llu %12.2f %12.2f\n",
+               lines, length, calls, (unsigned long long)lexer.advances,
+               (double)lexer.advances / length, seconds * 1e9 / length);
+        free(source);
+    }
+
+    tree_sitter_codon_external_scanner_destroy(scanner);
+    return 0;
+}
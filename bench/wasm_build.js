@@ -0,0 +1,188 @@
+/**
+ * Builds size- and speed-optimized WASM variants of the grammar and
+ * reports what each costs to download, compile and run.
+ *
+ *   node bench/wasm_build.js [--variants size,speed,simd] [--input file.codon] [--runs N] [--no-build] [--json]
+ *
+ * `tree-sitter build --wasm` has no optimization flags, so this calls emcc
+ * directly with the flags the CLI uses for side modules, then runs wasm-opt
+ * (Binaryen) when it is on PATH. Each variant is written next to the
+ * default build as tree-sitter-codon.<variant>.wasm:
+ *
+ *   size   -Oz, wasm-opt -Oz: smallest download, slowest parsing
+ *   speed  -O3, wasm-opt -O3
+ *   simd   -O3 -msimd128; needs WASM SIMD, which every current browser has
+ *
+ * For every variant it reports raw, gzip and brotli bytes, the time of
+ * WebAssembly.compile and of WebAssembly.compileStreaming (the path a
+ * browser takes for a `Content-Type: application/wasm` response), and,
+ * when web-tree-sitter is installed, Language.load time and parse
+ * throughput on --input.
+ */
+
+const { spawnSync } = require("child_process");
+const fs = require("fs");
+const path = require("path");
+const zlib = require("zlib");
+
+const root = path.join(__dirname, "..");
+
+const VARIANTS = {
+  size: { cflags: ["-Oz"], wasmOpt: ["-Oz"] },
+  speed: { cflags: ["-O3"], wasmOpt: ["-O3"] },
+  simd: { cflags: ["-O3", "-msimd128"], wasmOpt: ["-O3", "--enable-simd"] },
+};
+
+// The side-module flags of `tree-sitter build --wasm`
+const BASE_CFLAGS = [
+  "-fno-exceptions",
+  "-fvisibility=hidden",
+  "-g0",
+  "-sWASM=1",
+  "-sSIDE_MODULE=2",
+  "-sEXPORTED_FUNCTIONS=_tree_sitter_codon",
+  "-Isrc",
+  "src/parser.c",
+  "src/scanner.c",
+];
+
+function option(name, fallback) {
+  const index = process.argv.indexOf(name);
+  return index >= 0 && index + 1 < process.argv.length ? process.argv[index + 1] : fallback;
+}
+
+const json = process.argv.includes("--json");
+const build = !process.argv.includes("--no-build");
+const runs = Number(option("--runs", "10"));
+const input = option("--input");
+const variants = option("--variants", Object.keys(VARIANTS).join(",")).split(",");
+
+function has(command) {
+  return !spawnSync(command, ["--version"], { stdio: "ignore" }).error;
+}
+
+function run(command, args) {
+  const { status, error } = spawnSync(command, args, { cwd: root, stdio: json ? "ignore" : "inherit" });
+  if (error || status !== 0) {
+    console.error(`${command} failed${error ? `: ${error.message}` : ` with status ${status}`}`);
+    process.exit(1);
+  }
+}
+
+function output(variant) {
+  return path.join(root, `tree-sitter-codon.${variant}.wasm`);
+}
+
+function median(samples) {
+  const sorted = [...samples].sort((a, b) => a - b);
+  return sorted[Math.floor(sorted.length / 2)];
+}
+
+async function time(runs, action) {
+  const samples = [];
+  for (let i = 0; i < runs; i++) {
+    const started = process.hrtime.bigint();
+    await action();
+    samples.push(Number(process.hrtime.bigint() - started) / 1e6);
+  }
+  return median(samples);
+}
+
+function loadWebTreeSitter() {
+  try {
+    const module = require("web-tree-sitter");
+    // 0.25 exports classes; older releases export Parser with Language on it
+    const Parser = module.Parser || module;
+    return { Parser, Language: module.Language || Parser.Language };
+  } catch {
+    return null;
+  }
+}
+
+async function measure(variant, webTreeSitter, source) {
+  const bytes = fs.readFileSync(output(variant));
+  const report = {
+    variant,
+    bytes: bytes.length,
+    gzip_bytes: zlib.gzipSync(bytes, { level: 9 }).length,
+    brotli_bytes: zlib.brotliCompressSync(bytes, {
+      params: { [zlib.constants.BROTLI_PARAM_QUALITY]: 11 },
+    }).length,
+    compile_ms: await time(runs, () => WebAssembly.compile(bytes)),
+  };
+  if (typeof WebAssembly.compileStreaming === "function" && typeof Response === "function") {
+    report.compile_streaming_ms = await time(runs, () => WebAssembly.compileStreaming(
+      new Response(bytes, { headers: { "Content-Type": "application/wasm" } }),
+    ));
+  }
+  if (webTreeSitter) {
+    const { Parser, Language } = webTreeSitter;
+    let language;
+    report.load_ms = await time(runs, async () => {
+      language = await Language.load(bytes);
+    });
+    if (source !== undefined) {
+      const parser = new Parser();
+      parser.setLanguage(language);
+      report.parse_ms = await time(runs, () => parser.parse(source).delete());
+      report.mb_per_s = Buffer.byteLength(source) / 1e6 / (report.parse_ms / 1e3);
+      parser.delete();
+    }
+  }
+  return report;
+}
+
+async function main() {
+  for (const variant of variants) {
+    if (!VARIANTS[variant]) {
+      console.error(`unknown variant ${variant}; expected one of ${Object.keys(VARIANTS).join(", ")}`);
+      process.exit(2);
+    }
+  }
+
+  if (build) {
+    if (!has("emcc")) {
+      console.error("emcc not found; install Emscripten, or pass --no-build to measure existing variants");
+      process.exit(1);
+    }
+    const wasmOpt = has("wasm-opt");
+    if (!wasmOpt && !json) console.error("wasm-opt not found; skipping Binaryen passes");
+    for (const variant of variants) {
+      const { cflags, wasmOpt: passes } = VARIANTS[variant];
+      run("emcc", ["-o", output(variant), ...cflags, ...BASE_CFLAGS]);
+      if (wasmOpt) {
+        run("wasm-opt", [output(variant), ...passes, "--strip-debug", "--strip-producers", "-o", output(variant)]);
+      }
+    }
+  }
+
+  const webTreeSitter = loadWebTreeSitter();
+  if (webTreeSitter) await webTreeSitter.Parser.init();
+  const source = input !== undefined ? fs.readFileSync(input, "utf8") : undefined;
+  const reports = [];
+  for (const variant of variants) {
+    reports.push(await measure(variant, webTreeSitter, source));
+  }
+
+  if (json) {
+    console.log(JSON.stringify({ runs, input: input || null, variants: reports }));
+    return;
+  }
+  const columns = ["bytes", "gzip_bytes", "brotli_bytes", "compile_ms", "compile_streaming_ms", "load_ms", "parse_ms", "mb_per_s"];
+  const shown = columns.filter((column) => reports.some((report) => report[column] !== undefined));
+  console.log(["variant".padEnd(8), ...shown.map((column) => column.padStart(20))].join(" "));
+  for (const report of reports) {
+    const cells = shown.map((column) => {
+      const value = report[column];
+      if (value === undefined) return "-".padStart(20);
+      return (Number.isInteger(value) ? String(value) : value.toFixed(3)).padStart(20);
+    });
+    console.log([report.variant.padEnd(8), ...cells].join(" "));
+  }
+  if (!webTreeSitter) console.log("install web-tree-sitter for load and parse times");
+}
+
+main().catch((error) => {
+  console.error(error);
+  process.exit(1);
+});
@@ -1,4 +1,12 @@
 {
+  "variables": {
+    # The tree-sitter runtime is compiled into the addon. Set TREE_SITTER_DIR
+    # to a tree-sitter checkout, or install the tree-sitter peer dependency
+    # to use the copy it vendors; configure fails with a hint otherwise.
+    "tree_sitter_dir%": "<!(node bindings/node/tree_sitter_dir.js)",
+    # CODON_SCANNER_STATS=1 compiles the external scanner counters in
+    "scanner_stats%": "<!(node -p \"['', '0'].includes(process.env.CODON_SCANNER_STATS || '') ? 0 : 1\")",
+  },
   "targets": [
     {
       "target_name": "tree_sitter_codon_binding",
@@ -7,13 +15,35 @@
       ],
       "include_dirs": [
         "src",
+        "bindings/c",
+        "<(tree_sitter_dir)/lib/include",
+        "<(tree_sitter_dir)/lib/src",
       ],
       "sources": [
         "bindings/node/binding.cc",
+        "bindings/c/codon_cache.c",
+        "bindings/c/codon_columns.c",
+        "bindings/c/codon_edit.c",
+        "bindings/c/codon_highlight.c",
+        "bindings/c/codon_injection.c",
+        "bindings/c/codon_job.c",
+        "bindings/c/codon_memory.c",
+        "bindings/c/codon_parse.c",
+        "bindings/c/codon_prescan.c",
+        "bindings/c/codon_stats.c",
+        "bindings/c/codon_stream.c",
+        "bindings/c/codon_summary.c",
+        "bindings/c/codon_tags.c",
         "src/parser.c",
         "src/scanner.c",
+        "<(tree_sitter_dir)/lib/src/lib.c",
       ],
       "conditions": [
+        ["scanner_stats==1", {
+          "defines": [
+            "CODON_SCANNER_STATS",
+          ],
+        }],
         ["OS!='win'", {
           "cflags_c": [
             "-std=c11",
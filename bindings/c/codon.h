@@ -0,0 +1,629 @@
+/**
+ * Native helpers shared by the Codon Python and Node bindings.
+ *
+ * These sit on top of the tree-sitter runtime (tree_sitter/api.h) and
+ * never touch a host-language object, so bindings can call them with the
+ * GIL released or off the JavaScript thread.
+ */
+
+#ifndef TREE_SITTER_CODON_H_
+#define TREE_SITTER_CODON_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tree_sitter/api.h>
+
+#include "codon_thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Implemented in src/parser.c
+const TSLanguage *tree_sitter_codon(void);
+
+/* Scanner statistics */
+
+#define CODON_SCANNER_TOKEN_COUNT 8
+#define CODON_SCANNER_HISTOGRAM_SIZE 16
+
+// Counters kept by every scanner instance when src/scanner.c is compiled
+// with CODON_SCANNER_STATS
+typedef struct {
+    uint64_t scan_calls;
+    uint64_t error_recovery_calls;   // calls with every token valid
+    uint64_t pending_dedent_calls;   // answered from pending DEDENTs
+    uint64_t string_calls;           // calls that tried the string scanners
+    uint64_t newline_calls;          // calls that ran scan_newline
+    uint64_t tokens[CODON_SCANNER_TOKEN_COUNT];  // by external token type
+    uint64_t wasted_calls;           // returned false after advancing
+    uint64_t wasted_chars;           // characters advanced over by those
+    uint64_t chars;                  // characters advanced over or skipped
+    // Calls by characters consumed: 0, 1, 2-3, 4-7, ..., 2^14 and more
+    uint64_t chars_histogram[CODON_SCANNER_HISTOGRAM_SIZE];
+    uint64_t serialize_calls;
+    uint64_t serialize_bytes;
+    uint64_t deserialize_calls;
+    uint64_t deserialize_bytes;
+} CodonScannerStats;
+
+#ifdef CODON_SCANNER_STATS
+// Implemented in src/scanner.c
+
+// Names of the external tokens, indexed like CodonScannerStats.tokens
+extern const char *const codon_scanner_token_names[CODON_SCANNER_TOKEN_COUNT];
+
+// Sums the counters of every live and destroyed scanner in the process.
+// Counters of scanners that are parsing at the time of the call may be
+// slightly behind.
+void codon_scanner_stats_read(CodonScannerStats *stats);
+void codon_scanner_stats_reset(void);
+#endif
+
+/* Tree summaries */
+
+typedef struct {
+    uint32_t node_count;
+    uint32_t error_count;  // ERROR and MISSING nodes
+    uint32_t byte_length;
+    bool has_error;
+} CodonSummary;
+
+void codon_summarize(const TSTree *tree, CodonSummary *summary);
+
+/* Tags */
+
+// Kinds of definitions reported by codon_tags, matching queries/tags.scm
+typedef enum {
+    CODON_TAG_FUNCTION,
+    CODON_TAG_CLASS,
+    CODON_TAG_LLVM_FUNCTION,    // @llvm extern_function
+    CODON_TAG_PYTHON_FUNCTION,  // @python extern_function
+    CODON_TAG_C_IMPORT,         // one name of a `from C import`
+    CODON_TAG_KIND_COUNT,
+} CodonTagKind;
+
+#define CODON_TAG_NO_PARENT UINT32_MAX
+
+// One definition, as eight uint32_t so the array can be handed to a host
+// language as-is. Ranges are byte offsets into the source.
+typedef struct {
+    uint32_t kind;
+    uint32_t parent;  // index of the enclosing function or class tag
+    uint32_t name_start_byte;
+    uint32_t name_end_byte;
+    uint32_t start_byte;
+    uint32_t end_byte;
+    uint32_t start_row;
+    uint32_t end_row;
+} CodonTag;
+
+#define CODON_TAG_FIELD_COUNT (sizeof(CodonTag) / sizeof(uint32_t))
+
+typedef struct {
+    CodonTag *tags;
+    uint32_t size;
+    uint32_t capacity;
+} CodonTagList;
+
+// Names of the kinds, indexed by CodonTagKind
+extern const char *const codon_tag_kind_names[CODON_TAG_KIND_COUNT];
+
+// Appends the definitions of `tree` to `list` in source order. Returns
+// false when out of memory. Free the list with codon_tag_list_delete.
+bool codon_tags(const TSTree *tree, CodonTagList *list);
+void codon_tag_list_delete(CodonTagList *list);
+
+/* Columnar export */
+
+// Columns filled by codon_columns, one uint32_t per node each
+typedef enum {
+    CODON_COLUMN_SYMBOL,        // ts_node_symbol; ERROR is 0xFFFF
+    CODON_COLUMN_PARENT,        // row of the parent node
+    CODON_COLUMN_START_BYTE,
+    CODON_COLUMN_END_BYTE,
+    CODON_COLUMN_START_ROW,
+    CODON_COLUMN_START_COLUMN,
+    CODON_COLUMN_END_ROW,
+    CODON_COLUMN_END_COLUMN,
+    CODON_COLUMN_FIELD,         // field id in the parent, or 0
+    CODON_COLUMN_COUNT,
+} CodonColumn;
+
+#define CODON_COLUMN_NO_PARENT UINT32_MAX
+
+// Names of the columns, indexed by CodonColumn
+extern const char *const codon_column_names[CODON_COLUMN_COUNT];
+
+// Upper bound on the rows written by codon_columns: the number of nodes
+uint32_t codon_columns_capacity(const TSTree *tree);
+
+// Writes one row per node, in pre-order, into `columns`, which has room
+// for CODON_COLUMN_COUNT * capacity values. Columns are stored one after
+// the other: column c of row i is columns[c * rows + i]. With `named_only`,
+// anonymous nodes are left out and parents are the nearest named ancestor.
+// Returns the number of rows, or UINT32_MAX when out of memory.
+uint32_t codon_columns(const TSTree *tree, bool named_only, uint32_t capacity, uint32_t *columns);
+
+/* Highlighting */
+
+// One highlighted range, as three uint32_t so the array can be handed to
+// a host language as-is. `capture` indexes the query's capture names.
+typedef struct {
+    uint32_t start_byte;
+    uint32_t end_byte;
+    uint32_t capture;
+} CodonHighlight;
+
+#define CODON_HIGHLIGHT_FIELD_COUNT (sizeof(CodonHighlight) / sizeof(uint32_t))
+
+typedef struct {
+    CodonHighlight *highlights;
+    uint32_t size;
+    uint32_t capacity;
+} CodonHighlightList;
+
+// A compiled highlights query and its predicates. It is not modified after
+// creation, so one highlighter can serve any number of threads at once.
+typedef struct CodonHighlighter CodonHighlighter;
+
+// Compiles `source`. Returns NULL on failure, with the byte offset and
+// kind of the error; a malformed #eq?, #match? or #any-of? is reported as
+// a TSQueryErrorSyntax at the start of its pattern, and an
+// out-of-memory failure as TSQueryErrorNone.
+CodonHighlighter *codon_highlighter_new(
+    const TSLanguage *language,
+    const char *source,
+    uint32_t length,
+    uint32_t *error_offset,
+    TSQueryError *error_type
+);
+void codon_highlighter_delete(CodonHighlighter *highlighter);
+uint32_t codon_highlighter_capture_count(const CodonHighlighter *highlighter);
+const char *codon_highlighter_capture_name(const CodonHighlighter *highlighter, uint32_t id, uint32_t *length);
+
+// Appends the captures of the nodes that intersect [start_byte, end_byte)
+// to `list` in source order. `text` is the source of `tree`; predicates
+// are evaluated against it. Each node gets the capture of the first
+// pattern that matches it, and the ranges are not clipped to the window.
+// Returns false when out of memory. Free the list with
+// codon_highlight_list_delete.
+bool codon_highlight(
+    const CodonHighlighter *highlighter,
+    const TSTree *tree,
+    const char *text,
+    uint32_t length,
+    uint32_t start_byte,
+    uint32_t end_byte,
+    CodonHighlightList *list
+);
+void codon_highlight_list_delete(CodonHighlightList *list);
+
+/* Header pre-scan */
+
+typedef enum {
+    CODON_PRESCAN_DIRECTIVE,      // ## codon: name = value
+    CODON_PRESCAN_IMPORT,         // import name [as value]
+    CODON_PRESCAN_FROM_IMPORT,    // from name import value
+    CODON_PRESCAN_C_IMPORT,       // from C import name value, one per name
+    CODON_PRESCAN_PYTHON_IMPORT,  // from python import name value, one per name
+    CODON_PRESCAN_KIND_COUNT,
+} CodonPrescanKind;
+
+// Byte ranges into the source; value is empty when absent. For a C or
+// Python import the value is whatever follows the name: a type, a
+// signature or an `as` alias.
+typedef struct {
+    uint32_t kind;
+    uint32_t row;
+    uint32_t start_byte;  // of the whole statement
+    uint32_t end_byte;
+    uint32_t name_start_byte;
+    uint32_t name_end_byte;
+    uint32_t value_start_byte;
+    uint32_t value_end_byte;
+} CodonPrescanRecord;
+
+typedef struct {
+    CodonPrescanRecord *records;
+    uint32_t size;
+    uint32_t capacity;
+} CodonPrescanList;
+
+// Names of the kinds, indexed by CodonPrescanKind
+extern const char *const codon_prescan_kind_names[CODON_PRESCAN_KIND_COUNT];
+
+// Reads the directives and imports at the top of a file without parsing
+// it. Stops at the first top-level statement that is not an import, a
+// directive or a string (such as the module docstring). Returns false when
+// out of memory. Free the list with codon_prescan_list_delete.
+bool codon_prescan(const char *text, uint32_t length, CodonPrescanList *list);
+void codon_prescan_list_delete(CodonPrescanList *list);
+
+/* Summary cache */
+
+// Part of every cache key next to the grammar. Bump it whenever
+// src/scanner.c changes which tokens it produces, so that summaries made
+// with the old scanner are not served.
+#define CODON_SCANNER_VERSION 2
+
+// One ERROR or MISSING node
+typedef struct {
+    uint32_t start_byte;
+    uint32_t end_byte;
+    uint32_t start_row;
+    uint32_t start_column;
+} CodonErrorRange;
+
+#define CODON_ERROR_RANGE_FIELD_COUNT 4
+
+// A parse summary read from a cache file, or computed after a miss. The
+// arrays point into one block, mapped from the file on a hit.
+typedef struct {
+    bool hit;
+    CodonSummary summary;
+    const uint32_t *columns;  // named nodes only, laid out as by codon_columns
+    uint32_t rows;
+    const CodonErrorRange *errors;
+    uint32_t error_range_count;
+    const CodonTag *tags;
+    uint32_t tag_count;
+    // Private
+    void *data;
+    size_t size;
+    bool mapped;
+} CodonCacheEntry;
+
+// Looks `text` up in the cache in `directory`, which must exist. Files are
+// named after a hash of the text and a fingerprint of the grammar (its ABI
+// version, states, symbols and fields), CODON_SCANNER_VERSION and the file
+// format, so regenerating the grammar or changing the scanner makes every
+// old entry miss. On a miss, parses with `parser` and writes the entry; a
+// failed write only means the next lookup misses too. Returns false when
+// out of memory or when parsing fails. Release the entry with
+// codon_cache_entry_release.
+bool codon_cache_get(
+    const char *directory,
+    TSParser *parser,
+    const char *text,
+    uint32_t length,
+    CodonCacheEntry *entry
+);
+void codon_cache_entry_release(CodonCacheEntry *entry);
+
+/* Parse statistics */
+
+// Counts taken from the parser's log while it is installed with
+// ts_parser_set_logger. Logging slows parsing down, so measure time
+// separately.
+typedef struct {
+    uint64_t steps;               // parser loop iterations over all versions
+    uint64_t forked_steps;        // ... taken while several versions were alive
+    uint64_t forks;               // times the number of stack versions grew
+    uint32_t max_versions;        // stack version high-water mark
+    uint32_t current_versions;
+    uint64_t lex_calls;
+    uint64_t external_lex_calls;  // lex calls that ran the external scanner
+    uint64_t shifts;
+    uint64_t reductions;
+    uint64_t reused_nodes;        // subtrees reused from the old tree
+    uint64_t errors_detected;
+    uint64_t recoveries;          // error recovery actions taken
+    // ts_language_symbol_count counters of reductions to each symbol, or NULL
+    uint64_t *symbol_reductions;
+    const TSLanguage *language;
+} CodonParseStats;
+
+// Returns a logger that resets `stats` and then accumulates into it. When
+// `symbol_reductions` is not NULL it must hold one counter per symbol of
+// `language`; they are zeroed and count the reductions to each symbol,
+// which attributes parse work to grammar rules.
+TSLogger codon_parse_stats_logger(CodonParseStats *stats, const TSLanguage *language, uint64_t *symbol_reductions);
+
+/* Parser pool */
+
+// Idle parsers with the Codon language set, shared between threads
+typedef struct {
+    TSParser **parsers;
+    uint32_t size;
+    uint32_t capacity;
+    CodonMutex lock;
+} CodonParserPool;
+
+void codon_parser_pool_init(CodonParserPool *pool);
+void codon_parser_pool_destroy(CodonParserPool *pool);
+TSParser *codon_parser_pool_acquire(CodonParserPool *pool);
+void codon_parser_pool_release(CodonParserPool *pool, TSParser *parser);
+
+/* Buffer input */
+
+typedef struct {
+    const char *data;
+    uint32_t length;
+} CodonBuffer;
+
+// Reads a UTF-8 buffer in one chunk, for ts_parser_parse_with_options.
+// `buffer` must outlive the parse.
+TSInput codon_buffer_input(CodonBuffer *buffer);
+
+/* Streamed input */
+
+// Copies up to `capacity` bytes of the source, starting at byte `offset`,
+// into `buffer`. Returns the count, 0 at the end of the source, or
+// CODON_STREAM_FAILED to stop the parse.
+typedef uint32_t (*CodonStreamRead)(void *payload, uint32_t offset, char *buffer, uint32_t capacity);
+
+#define CODON_STREAM_FAILED UINT32_MAX
+
+// Feeds a parse from a source read in chunks, through one reusable buffer,
+// so the source is never held whole. Reads are sequential apart from the
+// lexer stepping back, and when it goes forward the last quarter of the
+// buffer is kept so that short steps back are served without a read.
+typedef struct {
+    CodonStreamRead read;
+    void *payload;
+    char *data;
+    uint32_t capacity;
+    uint32_t start;   // source offset of data[0]
+    uint32_t length;  // bytes of data filled
+    bool ended;       // the source ends at start + length
+    bool failed;      // a read failed; the parse sees the source end
+} CodonStream;
+
+// `chunk_size` is rounded up to a multiple of 8, and to at least 64.
+// Returns false when the buffer cannot be allocated.
+bool codon_stream_init(CodonStream *stream, uint32_t chunk_size, CodonStreamRead read, void *payload);
+void codon_stream_destroy(CodonStream *stream);
+
+// `encoding` is that of the bytes `read` returns. `stream` must outlive the
+// parse, and its tree must be discarded when `stream->failed` is set.
+TSInput codon_stream_input(CodonStream *stream, TSInputEncoding encoding);
+
+/* Resumable parsing */
+
+// A parse of one buffer that runs in time slices. Between slices the
+// parser keeps its state and resumes where it stopped, so a huge file can
+// be parsed in the background of an interactive tool. Not thread-safe.
+typedef struct {
+    CodonParserPool *pool;
+    TSParser *parser;  // taken from the pool by the first slice, until the end
+    CodonBuffer buffer;
+    TSTree *old_tree;
+    TSTree *tree;      // the finished tree, owned by the job
+    uint32_t offset;   // furthest byte the parser has reached
+    bool has_error;    // the parse has hit a syntax error so far
+    double deadline;
+} CodonParseJob;
+
+// `text` and `pool` must outlive the job. `old_tree`, when given, must be
+// edited to match `text`, and is copied.
+void codon_parse_job_init(
+    CodonParseJob *job,
+    CodonParserPool *pool,
+    const char *text,
+    uint32_t length,
+    const TSTree *old_tree
+);
+void codon_parse_job_destroy(CodonParseJob *job);
+
+// Parses for about `seconds`, or to the end when `seconds` is negative.
+// Returns true once `job->tree` is complete; calling again is then a
+// no-op. Returns false when the slice ran out first.
+bool codon_parse_job_run(CodonParseJob *job, double seconds);
+
+// Where a tree of the text parsed so far would end: the start of the
+// last line at or before min(job->offset, max_bytes) that begins at
+// column 0 with something other than a comment, so the prefix ends
+// between top-level statements. A line inside a multi-line string can
+// also match, which gives the prefix an error at its end.
+uint32_t codon_parse_job_prefix(const CodonParseJob *job, uint32_t max_bytes);
+
+// Parses text[0, codon_parse_job_prefix(job, max_bytes)) on its own, with
+// a parser taken from the pool, and returns the tree or NULL. The parse is
+// not incremental, so it costs about as much as the slices so far; it is
+// meant for one early look at a big file, not for every slice.
+TSTree *codon_parse_job_partial(CodonParseJob *job, uint32_t max_bytes);
+
+/* Edit sessions */
+
+typedef struct {
+    uint32_t start;     // offset into the original or the added buffer
+    uint32_t length;
+    uint32_t newlines;  // '\n' bytes in the piece, for computing points
+    bool added;
+} CodonPiece;
+
+// A document kept as a piece table over its original text and an
+// append-only buffer of inserted text, together with its latest tree.
+// Edits never copy the untouched text, and reparses read it in place.
+typedef struct {
+    char *original;
+    uint32_t original_length;
+    char *added;
+    uint32_t added_length;
+    uint32_t added_capacity;
+    CodonPiece *pieces;
+    uint32_t piece_count;
+    uint32_t piece_capacity;
+    uint32_t length;
+    TSTree *tree;
+    // Last piece returned by the read callback, where sequential reads
+    // resume their search
+    uint32_t read_piece;
+    uint32_t read_piece_start;
+} CodonEditSession;
+
+// Copies `text` into a new session with no tree yet. Returns false when out
+// of memory.
+bool codon_edit_session_init(CodonEditSession *session, const char *text, uint32_t length);
+void codon_edit_session_destroy(CodonEditSession *session);
+
+// Replaces the bytes [start, old_end) with `text` and applies the matching
+// ts_tree_edit to the session's tree, which is left ready for a reparse.
+// Requires start <= old_end <= session->length. Returns false when out of
+// memory or when the document would grow past 4 GiB, leaving the session
+// unchanged.
+bool codon_edit_session_edit(
+    CodonEditSession *session,
+    uint32_t start,
+    uint32_t old_end,
+    const char *text,
+    uint32_t length,
+    TSInputEdit *edit
+);
+
+// Reparses the document, reusing the edited tree, and sets `ranges` to the
+// ranges whose syntax changed (the whole document for the first parse).
+// Free them with free(). Returns false, keeping the old tree, when the
+// parse failed.
+bool codon_edit_session_parse(CodonEditSession *session, TSParser *parser, TSRange **ranges, uint32_t *count);
+
+// Copies the bytes [start, end) of the document into `out`
+void codon_edit_session_read(const CodonEditSession *session, uint32_t start, uint32_t end, char *out);
+
+/* Tree memory */
+
+typedef struct {
+    uint64_t heap_subtrees;        // subtrees with an allocation of their own
+    uint64_t inline_subtrees;      // small tokens packed into their parent
+    uint64_t subtree_bytes;        // subtree allocations, child arrays included
+    uint64_t scanner_state_bytes;  // external scanner states too long to inline
+    uint64_t total_bytes;          // all of the above plus the tree itself
+} CodonTreeMemory;
+
+// Estimates the bytes `tree` holds from its node structure, using the
+// subtree layout of the tree-sitter 0.25 runtime. Hidden nodes are not
+// visible through the API, so the tokens and repetitions the grammar
+// hides (newlines, indents, string content, statement lists) are counted
+// from the visible nodes around them. Trees that share subtrees, like
+// copies or an old tree and its reparse, each count them in full. Walks
+// every node, so it costs about as much as codon_summarize.
+void codon_tree_memory(const TSTree *tree, CodonTreeMemory *memory);
+
+/* Tree cache */
+
+typedef struct {
+    char *key;
+    uint32_t key_length;
+    uint64_t hash;
+    TSTree *tree;
+    uint64_t bytes;  // codon_tree_memory total when added
+    uint64_t last_used;
+} CodonCachedTree;
+
+// Trees kept under a memory budget, keyed by a caller-chosen name such as
+// a document URI. Adding a tree that takes the cache over budget evicts the
+// least recently used ones; callers reparse an evicted tree when they need
+// it again. Not thread-safe.
+typedef struct {
+    CodonCachedTree *entries;
+    uint32_t size;
+    uint32_t capacity;
+    uint64_t budget;  // bytes; 0 keeps every tree
+    uint64_t bytes;
+    uint64_t clock;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} CodonTreeCache;
+
+void codon_tree_cache_init(CodonTreeCache *cache, uint64_t budget);
+void codon_tree_cache_destroy(CodonTreeCache *cache);
+
+// Returns the tree under `key`, or NULL. The tree belongs to the cache and
+// stays valid until the next call that adds, removes or evicts; take a
+// ts_tree_copy to keep it.
+const TSTree *codon_tree_cache_get(CodonTreeCache *cache, const char *key, uint32_t key_length);
+
+// Takes ownership of `tree` and stores it under `key`, replacing any tree
+// there, then evicts least recently used trees until the cache is within
+// budget. The new tree is never evicted by its own insertion, even when it
+// alone is over budget. Returns false, and deletes `tree`, when out of memory.
+bool codon_tree_cache_put(CodonTreeCache *cache, const char *key, uint32_t key_length, TSTree *tree);
+
+// Deletes the tree under `key`. Returns false when there is none.
+bool codon_tree_cache_remove(CodonTreeCache *cache, const char *key, uint32_t key_length);
+
+// Changes the budget, evicting least recently used trees to meet it
+void codon_tree_cache_set_budget(CodonTreeCache *cache, uint64_t budget);
+
+/* Injections */
+
+typedef struct {
+    const TSLanguage *language;
+    uint64_t hash;  // of the region's text and indentation
+    uint32_t length;
+    uint64_t last_used;
+    uint64_t bytes;  // codon_tree_memory total
+    TSTree *tree;
+} CodonInjection;
+
+// Trees of embedded regions (extern block bodies) parsed with another
+// language, keyed on their content so that moving or editing the
+// surrounding code does not reparse them. Not thread-safe.
+typedef struct {
+    CodonInjection *entries;
+    uint32_t size;
+    uint32_t capacity;  // least recently used entries are evicted past this
+    uint64_t budget;    // or past this many bytes of trees, unless 0
+    uint64_t bytes;
+    uint64_t clock;
+    uint64_t hits;
+    uint64_t misses;
+    TSParser *parser;
+} CodonInjectionCache;
+
+bool codon_injection_cache_init(CodonInjectionCache *cache, uint32_t capacity, uint64_t budget);
+void codon_injection_cache_destroy(CodonInjectionCache *cache);
+
+// Returns the tree of source[start, end) parsed as `language`, from the
+// cache when the same text was parsed before. The indentation the region
+// shares with the line `start` is on is left out of the parse, so an
+// indented Python body parses as a module. Offsets and rows in the tree
+// are relative to `start`. The tree belongs to the cache and stays valid
+// until the next call; take a ts_tree_copy to keep it. Returns NULL when
+// the language cannot be used or parsing fails.
+const TSTree *codon_injection_parse(
+    CodonInjectionCache *cache,
+    const TSLanguage *language,
+    const char *source,
+    uint32_t start,
+    uint32_t end
+);
+
+/* Batch parsing */
+
+typedef struct {
+    const char *path;  // read from disk when set
+    const char *data;  // otherwise parse this buffer
+    uint32_t length;
+} CodonSource;
+
+typedef struct {
+    TSTree *tree;  // only kept when requested
+    CodonSummary summary;
+    int error;     // errno from reading `path`, or 0
+    bool cached;   // the summary came from the cache without parsing
+} CodonResult;
+
+// Parses every source on `threads` worker threads, each with one parser
+// taken from `pool`. Results are in source order. Unless trees are kept,
+// summaries are looked up in and added to the summary cache in
+// `cache_directory` when it is not NULL.
+void codon_parse_many(
+    CodonParserPool *pool,
+    const CodonSource *sources,
+    size_t count,
+    unsigned threads,
+    bool keep_trees,
+    const char *cache_directory,
+    CodonResult *results
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // TREE_SITTER_CODON_H_
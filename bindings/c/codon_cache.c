@@ -0,0 +1,334 @@
+/**
+ * Content-addressed on-disk cache of parse summaries.
+ *
+ * Each entry is one file holding a header, the named-node columns, the
+ * error ranges and the tags of one source text. A hit maps the file and
+ * points into it; nothing is parsed or copied.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "codon.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define CACHE_MAGIC 0x534e4443u  // "CDNS"
+#define CACHE_FORMAT 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t format;
+    uint64_t grammar;
+    uint64_t content_hash;
+    uint32_t content_length;
+    uint32_t rows;
+    uint32_t error_range_count;
+    uint32_t tag_count;
+    uint32_t node_count;
+    uint32_t error_count;
+    uint32_t byte_length;
+    uint32_t has_error;
+} CacheHeader;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static uint64_t hash_u32(uint64_t hash, uint32_t value) {
+    return fnv1a(hash, &value, sizeof(value));
+}
+
+// Changes whenever the grammar is regenerated with different symbols,
+// fields or states, or the scanner or file format changes
+static uint64_t grammar_fingerprint(void) {
+    const TSLanguage *language = tree_sitter_codon();
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = hash_u32(hash, CACHE_FORMAT);
+    hash = hash_u32(hash, CODON_SCANNER_VERSION);
+    hash = hash_u32(hash, ts_language_abi_version(language));
+    hash = hash_u32(hash, ts_language_state_count(language));
+    uint32_t symbol_count = ts_language_symbol_count(language);
+    hash = hash_u32(hash, symbol_count);
+    for (uint32_t i = 0; i < symbol_count; i++) {
+        const char *name = ts_language_symbol_name(language, (TSSymbol)i);
+        hash = fnv1a(hash, name, strlen(name) + 1);
+    }
+    uint32_t field_count = ts_language_field_count(language);
+    hash = hash_u32(hash, field_count);
+    for (uint32_t i = 1; i <= field_count; i++) {
+        const char *name = ts_language_field_name_for_id(language, (TSFieldId)i);
+        hash = fnv1a(hash, name, strlen(name) + 1);
+    }
+    return hash;
+}
+
+static size_t block_size(const CacheHeader *header) {
+    return sizeof(CacheHeader)
+        + (size_t)header->rows * CODON_COLUMN_COUNT * sizeof(uint32_t)
+        + (size_t)header->error_range_count * sizeof(CodonErrorRange)
+        + (size_t)header->tag_count * sizeof(CodonTag);
+}
+
+// Points `entry` into a block. Returns false if the block is not an
+// entry for this text and grammar, such as a truncated file.
+static bool entry_init(CodonCacheEntry *entry, void *data, size_t size, uint64_t grammar, uint64_t content_hash, uint32_t length) {
+    const CacheHeader *header = data;
+    if (size < sizeof(CacheHeader)
+        || header->magic != CACHE_MAGIC
+        || header->format != CACHE_FORMAT
+        || header->grammar != grammar
+        || header->content_hash != content_hash
+        || header->content_length != length
+        || block_size(header) != size) {
+        return false;
+    }
+    const char *cursor = (const char *)data + sizeof(CacheHeader);
+    entry->summary.node_count = header->node_count;
+    entry->summary.error_count = header->error_count;
+    entry->summary.byte_length = header->byte_length;
+    entry->summary.has_error = header->has_error != 0;
+    entry->rows = header->rows;
+    entry->columns = (const uint32_t *)cursor;
+    cursor += (size_t)header->rows * CODON_COLUMN_COUNT * sizeof(uint32_t);
+    entry->error_range_count = header->error_range_count;
+    entry->errors = (const CodonErrorRange *)cursor;
+    cursor += (size_t)header->error_range_count * sizeof(CodonErrorRange);
+    entry->tag_count = header->tag_count;
+    entry->tags = (const CodonTag *)cursor;
+    entry->data = data;
+    entry->size = size;
+    return true;
+}
+
+static bool map_file(const char *path, void **data, size_t *size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(
+        path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL
+    );
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER file_size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart >= (LONGLONG)sizeof(CacheHeader)) {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+    void *view = mapping != NULL ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (mapping != NULL) CloseHandle(mapping);
+    CloseHandle(file);
+    if (view == NULL) return false;
+    *data = view;
+    *size = (size_t)file_size.QuadPart;
+    return true;
+#else
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat status;
+    void *view = MAP_FAILED;
+    if (fstat(fd, &status) == 0 && (size_t)status.st_size >= sizeof(CacheHeader)) {
+        view = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (view == MAP_FAILED) return false;
+    *data = view;
+    *size = (size_t)status.st_size;
+    return true;
+#endif
+}
+
+static void unmap_file(void *data, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(data);
+#else
+    munmap(data, size);
+#endif
+}
+
+// Writes through a temporary file and a rename, so concurrent readers see
+// either no entry or a whole one
+static void write_file(const char *path, const void *data, size_t size) {
+    char temporary[4096];
+#ifdef _WIN32
+    unsigned long process = GetCurrentProcessId();
+#else
+    unsigned long process = (unsigned long)getpid();
+#endif
+    int written = snprintf(temporary, sizeof(temporary), "%s.%lu.%p.tmp", path, process, data);
+    if (written < 0 || (size_t)written >= sizeof(temporary)) return;
+
+    FILE *file = fopen(temporary, "wb");
+    if (file == NULL) return;
+    bool ok = fwrite(data, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(temporary, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(temporary, path) == 0;
+#endif
+    if (!ok) remove(temporary);
+}
+
+// Appends the ERROR and MISSING nodes of `tree` to a malloc'd array.
+// Returns false when out of memory.
+static bool error_ranges(const TSTree *tree, CodonErrorRange **ranges, uint32_t *count) {
+    uint32_t capacity = 0;
+    *ranges = NULL;
+    *count = 0;
+    TSNode root = ts_tree_root_node(tree);
+    if (!ts_node_has_error(root)) return true;
+
+    // Only descend into subtrees that contain an error
+    TSTreeCursor cursor = ts_tree_cursor_new(root);
+    bool ok = true;
+    for (;;) {
+        TSNode node = ts_tree_cursor_current_node(&cursor);
+        if (ts_node_is_error(node) || ts_node_is_missing(node)) {
+            if (*count == capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                CodonErrorRange *grown = realloc(*ranges, capacity * sizeof(CodonErrorRange));
+                if (grown == NULL) {
+                    ok = false;
+                    break;
+                }
+                *ranges = grown;
+            }
+            TSPoint start = ts_node_start_point(node);
+            (*ranges)[(*count)++] = (CodonErrorRange){
+                ts_node_start_byte(node), ts_node_end_byte(node), start.row, start.column,
+            };
+        }
+        if (ts_node_has_error(node) && ts_tree_cursor_goto_first_child(&cursor)) continue;
+        while (!ts_tree_cursor_goto_next_sibling(&cursor)) {
+            if (!ts_tree_cursor_goto_parent(&cursor)) goto done;
+        }
+    }
+
+done:
+    ts_tree_cursor_delete(&cursor);
+    if (!ok) {
+        free(*ranges);
+        *ranges = NULL;
+    }
+    return ok;
+}
+
+// Lays out a cache block for `tree` in malloc'd memory
+static void *build_block(const TSTree *tree, CacheHeader *header, size_t *size) {
+    uint32_t capacity = codon_columns_capacity(tree);
+    uint32_t *columns = malloc((size_t)(capacity ? capacity : 1) * CODON_COLUMN_COUNT * sizeof(uint32_t));
+    CodonErrorRange *errors = NULL;
+    CodonTagList tags = {0};
+    char *block = NULL;
+    uint32_t rows = columns != NULL ? codon_columns(tree, true, capacity, columns) : UINT32_MAX;
+    if (rows == UINT32_MAX
+        || !error_ranges(tree, &errors, &header->error_range_count)
+        || !codon_tags(tree, &tags)) {
+        goto done;
+    }
+
+    CodonSummary summary;
+    codon_summarize(tree, &summary);
+    header->rows = rows;
+    header->tag_count = tags.size;
+    header->node_count = summary.node_count;
+    header->error_count = summary.error_count;
+    header->byte_length = summary.byte_length;
+    header->has_error = summary.has_error;
+    *size = block_size(header);
+    block = malloc(*size);
+    if (block == NULL) goto done;
+
+    char *cursor = block;
+    memcpy(cursor, header, sizeof(CacheHeader));
+    cursor += sizeof(CacheHeader);
+    memcpy(cursor, columns, (size_t)rows * CODON_COLUMN_COUNT * sizeof(uint32_t));
+    cursor += (size_t)rows * CODON_COLUMN_COUNT * sizeof(uint32_t);
+    if (header->error_range_count > 0) {
+        memcpy(cursor, errors, header->error_range_count * sizeof(CodonErrorRange));
+    }
+    cursor += header->error_range_count * sizeof(CodonErrorRange);
+    if (tags.size > 0) memcpy(cursor, tags.tags, tags.size * sizeof(CodonTag));
+
+done:
+    free(columns);
+    free(errors);
+    codon_tag_list_delete(&tags);
+    return block;
+}
+
+bool codon_cache_get(
+    const char *directory,
+    TSParser *parser,
+    const char *text,
+    uint32_t length,
+    CodonCacheEntry *entry
+) {
+    memset(entry, 0, sizeof(*entry));
+    uint64_t grammar = grammar_fingerprint();
+    uint64_t content_hash = fnv1a(0xcbf29ce484222325ull, text, length);
+
+    char path[4096];
+    int written = snprintf(
+        path, sizeof(path), "%s/%016llx-%016llx.summary",
+        directory, (unsigned long long)content_hash, (unsigned long long)grammar
+    );
+    bool cacheable = written >= 0 && (size_t)written < sizeof(path);
+
+    void *data;
+    size_t size;
+    if (cacheable && map_file(path, &data, &size)) {
+        if (entry_init(entry, data, size, grammar, content_hash, length)) {
+            entry->hit = true;
+            entry->mapped = true;
+            return true;
+        }
+        unmap_file(data, size);
+    }
+
+    TSTree *tree = ts_parser_parse_string(parser, NULL, text, length);
+    if (tree == NULL) {
+        ts_parser_reset(parser);
+        return false;
+    }
+    CacheHeader header = {
+        .magic = CACHE_MAGIC,
+        .format = CACHE_FORMAT,
+        .grammar = grammar,
+        .content_hash = content_hash,
+        .content_length = length,
+    };
+    data = build_block(tree, &header, &size);
+    ts_tree_delete(tree);
+    if (data == NULL) return false;
+    if (cacheable) write_file(path, data, size);
+    entry_init(entry, data, size, grammar, content_hash, length);
+    return true;
+}
+
+void codon_cache_entry_release(CodonCacheEntry *entry) {
+    if (entry->data != NULL) {
+        if (entry->mapped) {
+            unmap_file(entry->data, entry->size);
+        } else {
+            free(entry->data);
+        }
+    }
+    memset(entry, 0, sizeof(*entry));
+}
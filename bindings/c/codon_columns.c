@@ -0,0 +1,95 @@
+/**
+ * Columnar export of whole trees.
+ */
+
+#include "codon.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+const char *const codon_column_names[CODON_COLUMN_COUNT] = {
+    "symbol",
+    "parent",
+    "start_byte",
+    "end_byte",
+    "start_row",
+    "start_column",
+    "end_row",
+    "end_column",
+    "field",
+};
+
+uint32_t codon_columns_capacity(const TSTree *tree) {
+    return ts_node_descendant_count(ts_tree_root_node(tree));
+}
+
+uint32_t codon_columns(const TSTree *tree, bool named_only, uint32_t capacity, uint32_t *columns) {
+    uint32_t *symbol = columns + CODON_COLUMN_SYMBOL * (size_t)capacity;
+    uint32_t *parent = columns + CODON_COLUMN_PARENT * (size_t)capacity;
+    uint32_t *start_byte = columns + CODON_COLUMN_START_BYTE * (size_t)capacity;
+    uint32_t *end_byte = columns + CODON_COLUMN_END_BYTE * (size_t)capacity;
+    uint32_t *start_row = columns + CODON_COLUMN_START_ROW * (size_t)capacity;
+    uint32_t *start_column = columns + CODON_COLUMN_START_COLUMN * (size_t)capacity;
+    uint32_t *end_row = columns + CODON_COLUMN_END_ROW * (size_t)capacity;
+    uint32_t *end_column = columns + CODON_COLUMN_END_COLUMN * (size_t)capacity;
+    uint32_t *field = columns + CODON_COLUMN_FIELD * (size_t)capacity;
+
+    // Row of the node at each depth of the cursor above the current one
+    uint32_t *rows = NULL;
+    uint32_t depth = 0, rows_capacity = 0;
+    uint32_t count = 0;
+
+    TSTreeCursor cursor = ts_tree_cursor_new(ts_tree_root_node(tree));
+    for (;;) {
+        TSNode node = ts_tree_cursor_current_node(&cursor);
+        uint32_t row = depth > 0 ? rows[depth - 1] : CODON_COLUMN_NO_PARENT;
+        if (!named_only || ts_node_is_named(node)) {
+            if (count == capacity) break;
+            TSPoint start = ts_node_start_point(node);
+            TSPoint end = ts_node_end_point(node);
+            symbol[count] = ts_node_symbol(node);
+            parent[count] = row;
+            start_byte[count] = ts_node_start_byte(node);
+            end_byte[count] = ts_node_end_byte(node);
+            start_row[count] = start.row;
+            start_column[count] = start.column;
+            end_row[count] = end.row;
+            end_column[count] = end.column;
+            field[count] = ts_tree_cursor_current_field_id(&cursor);
+            row = count++;
+        }
+
+        // Children of a skipped node get its nearest kept ancestor as parent
+        if (ts_tree_cursor_goto_first_child(&cursor)) {
+            if (depth == rows_capacity) {
+                rows_capacity = rows_capacity ? rows_capacity * 2 : 64;
+                uint32_t *grown = realloc(rows, rows_capacity * sizeof(uint32_t));
+                if (grown == NULL) {
+                    count = UINT32_MAX;
+                    break;
+                }
+                rows = grown;
+            }
+            rows[depth++] = row;
+            continue;
+        }
+
+        while (!ts_tree_cursor_goto_next_sibling(&cursor)) {
+            if (depth == 0) goto done;
+            ts_tree_cursor_goto_parent(&cursor);
+            depth--;
+        }
+    }
+
+done:
+    ts_tree_cursor_delete(&cursor);
+    free(rows);
+
+    // Close the gaps left when fewer rows than `capacity` were written
+    if (count != UINT32_MAX && count < capacity) {
+        for (size_t c = 1; c < CODON_COLUMN_COUNT; c++) {
+            memmove(columns + c * count, columns + c * capacity, count * sizeof(uint32_t));
+        }
+    }
+    return count;
+}
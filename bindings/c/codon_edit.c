@@ -0,0 +1,254 @@
+/**
+ * Piece-table documents that keep their tree in sync with edits.
+ */
+
+#include "codon.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Past this many pieces an edit first flattens the document back into one
+static const uint32_t MAX_PIECES = 4096;
+
+static uint32_t count_newlines(const char *text, uint32_t length) {
+    uint32_t newlines = 0;
+    const char *end = text + length;
+    while ((text = memchr(text, '\n', (size_t)(end - text))) != NULL) {
+        newlines++;
+        text++;
+    }
+    return newlines;
+}
+
+static const char *piece_text(const CodonEditSession *session, const CodonPiece *piece) {
+    return (piece->added ? session->added : session->original) + piece->start;
+}
+
+static bool reserve_pieces(CodonEditSession *session, uint32_t extra) {
+    if (session->piece_count + extra <= session->piece_capacity) return true;
+    uint32_t capacity = session->piece_capacity ? session->piece_capacity * 2 : 16;
+    while (capacity < session->piece_count + extra) capacity *= 2;
+    CodonPiece *pieces = realloc(session->pieces, capacity * sizeof(CodonPiece));
+    if (pieces == NULL) return false;
+    session->pieces = pieces;
+    session->piece_capacity = capacity;
+    return true;
+}
+
+bool codon_edit_session_init(CodonEditSession *session, const char *text, uint32_t length) {
+    memset(session, 0, sizeof(*session));
+    session->original = malloc(length ? length : 1);
+    if (session->original == NULL || !reserve_pieces(session, 1)) {
+        codon_edit_session_destroy(session);
+        return false;
+    }
+    memcpy(session->original, text, length);
+    session->original_length = length;
+    session->length = length;
+    if (length > 0) {
+        session->pieces[0] = (CodonPiece){0, length, count_newlines(text, length), false};
+        session->piece_count = 1;
+    }
+    return true;
+}
+
+void codon_edit_session_destroy(CodonEditSession *session) {
+    free(session->original);
+    free(session->added);
+    free(session->pieces);
+    ts_tree_delete(session->tree);
+    memset(session, 0, sizeof(*session));
+}
+
+// Position of byte `offset`, in tree-sitter's rows and byte columns
+static TSPoint point_at(const CodonEditSession *session, uint32_t offset) {
+    TSPoint point = {0, 0};
+    uint32_t position = 0;
+    uint32_t line_start = 0;
+    for (uint32_t i = 0; i < session->piece_count && position < offset; i++) {
+        const CodonPiece *piece = &session->pieces[i];
+        uint32_t length = offset - position < piece->length ? offset - position : piece->length;
+        const char *text = piece_text(session, piece);
+        uint32_t newlines = length == piece->length ? piece->newlines : count_newlines(text, length);
+        if (newlines > 0) {
+            point.row += newlines;
+            const char *last = text + length;
+            while (last[-1] != '\n') last--;
+            line_start = position + (uint32_t)(last - text);
+        }
+        position += length;
+    }
+    point.column = offset - line_start;
+    return point;
+}
+
+// Makes a piece boundary at `offset` and returns the index of the piece
+// starting there
+static uint32_t split_at(CodonEditSession *session, uint32_t offset) {
+    uint32_t position = 0;
+    for (uint32_t i = 0; i < session->piece_count; i++) {
+        CodonPiece *piece = &session->pieces[i];
+        if (position == offset) return i;
+        if (offset < position + piece->length) {
+            uint32_t head = offset - position;
+            uint32_t head_newlines = count_newlines(piece_text(session, piece), head);
+            CodonPiece tail = {piece->start + head, piece->length - head, piece->newlines - head_newlines, piece->added};
+            piece->length = head;
+            piece->newlines = head_newlines;
+            memmove(&session->pieces[i + 2], &session->pieces[i + 1],
+                    (session->piece_count - i - 1) * sizeof(CodonPiece));
+            session->pieces[i + 1] = tail;
+            session->piece_count++;
+            return i + 1;
+        }
+        position += piece->length;
+    }
+    return session->piece_count;
+}
+
+// Replaces the pieces with a single one over a fresh copy of the document
+static bool flatten(CodonEditSession *session) {
+    char *text = malloc(session->length ? session->length : 1);
+    if (text == NULL) return false;
+    codon_edit_session_read(session, 0, session->length, text);
+    free(session->original);
+    session->original = text;
+    session->original_length = session->length;
+    session->added_length = 0;
+    session->piece_count = session->length > 0 ? 1 : 0;
+    if (session->length > 0) {
+        session->pieces[0] = (CodonPiece){0, session->length, count_newlines(text, session->length), false};
+    }
+    session->read_piece = 0;
+    session->read_piece_start = 0;
+    return true;
+}
+
+bool codon_edit_session_edit(
+    CodonEditSession *session,
+    uint32_t start,
+    uint32_t old_end,
+    const char *text,
+    uint32_t length,
+    TSInputEdit *edit
+) {
+    if ((uint64_t)session->length - (old_end - start) + length > UINT32_MAX) return false;
+    if ((uint64_t)session->added_length + length > UINT32_MAX) {
+        if (!flatten(session)) return false;
+    }
+    if (session->piece_count >= MAX_PIECES && !flatten(session)) return false;
+    // Two splits and one inserted piece at most
+    if (!reserve_pieces(session, 3)) return false;
+    if (session->added_length + length > session->added_capacity) {
+        uint32_t capacity = session->added_capacity ? session->added_capacity : 256;
+        while (capacity < session->added_length + length) {
+            capacity = capacity > UINT32_MAX / 2 ? UINT32_MAX : capacity * 2;
+        }
+        char *added = realloc(session->added, capacity);
+        if (added == NULL) return false;
+        session->added = added;
+        session->added_capacity = capacity;
+    }
+
+    edit->start_byte = start;
+    edit->old_end_byte = old_end;
+    edit->new_end_byte = start + length;
+    edit->start_point = point_at(session, start);
+    edit->old_end_point = old_end == start ? edit->start_point : point_at(session, old_end);
+    uint32_t newlines = count_newlines(text, length);
+    if (newlines == 0) {
+        edit->new_end_point = (TSPoint){edit->start_point.row, edit->start_point.column + length};
+    } else {
+        const char *last = text + length;
+        while (last[-1] != '\n') last--;
+        edit->new_end_point = (TSPoint){edit->start_point.row + newlines, (uint32_t)(text + length - last)};
+    }
+
+    uint32_t first = split_at(session, start);
+    uint32_t end = split_at(session, old_end);
+    memmove(&session->pieces[first], &session->pieces[end], (session->piece_count - end) * sizeof(CodonPiece));
+    session->piece_count -= end - first;
+
+    if (length > 0) {
+        memcpy(session->added + session->added_length, text, length);
+        CodonPiece *previous = first > 0 ? &session->pieces[first - 1] : NULL;
+        if (previous != NULL && previous->added && previous->start + previous->length == session->added_length) {
+            // Typing: extend the piece of the previous insertion
+            previous->length += length;
+            previous->newlines += newlines;
+        } else {
+            memmove(&session->pieces[first + 1], &session->pieces[first],
+                    (session->piece_count - first) * sizeof(CodonPiece));
+            session->pieces[first] = (CodonPiece){session->added_length, length, newlines, true};
+            session->piece_count++;
+        }
+        session->added_length += length;
+    }
+    session->length = session->length - (old_end - start) + length;
+    session->read_piece = 0;
+    session->read_piece_start = 0;
+
+    if (session->tree != NULL) ts_tree_edit(session->tree, edit);
+    return true;
+}
+
+static const char *session_read(void *payload, uint32_t byte, TSPoint position, uint32_t *bytes_read) {
+    CodonEditSession *session = (CodonEditSession *)payload;
+    (void)position;
+    uint32_t i = session->read_piece, piece_start = session->read_piece_start;
+    if (byte < piece_start) i = piece_start = 0;
+    for (; i < session->piece_count; i++) {
+        const CodonPiece *piece = &session->pieces[i];
+        if (byte < piece_start + piece->length) {
+            session->read_piece = i;
+            session->read_piece_start = piece_start;
+            *bytes_read = piece_start + piece->length - byte;
+            return piece_text(session, piece) + (byte - piece_start);
+        }
+        piece_start += piece->length;
+    }
+    *bytes_read = 0;
+    return "";
+}
+
+bool codon_edit_session_parse(CodonEditSession *session, TSParser *parser, TSRange **ranges, uint32_t *count) {
+    TSInput input;
+    input.payload = session;
+    input.read = session_read;
+    input.encoding = TSInputEncodingUTF8;
+    input.decode = NULL;
+    TSTree *tree = ts_parser_parse(parser, session->tree, input);
+    if (tree == NULL) return false;
+
+    if (session->tree != NULL) {
+        *ranges = ts_tree_get_changed_ranges(session->tree, tree, count);
+        ts_tree_delete(session->tree);
+    } else {
+        TSNode root = ts_tree_root_node(tree);
+        *ranges = malloc(sizeof(TSRange));
+        *count = *ranges != NULL;
+        if (*ranges != NULL) {
+            (*ranges)[0] = (TSRange){
+                ts_node_start_point(root), ts_node_end_point(root),
+                ts_node_start_byte(root), ts_node_end_byte(root),
+            };
+        }
+    }
+    session->tree = tree;
+    return true;
+}
+
+void codon_edit_session_read(const CodonEditSession *session, uint32_t start, uint32_t end, char *out) {
+    uint32_t position = 0;
+    for (uint32_t i = 0; i < session->piece_count && position < end; i++) {
+        const CodonPiece *piece = &session->pieces[i];
+        uint32_t piece_end = position + piece->length;
+        if (piece_end > start) {
+            uint32_t from = start > position ? start - position : 0;
+            uint32_t to = end < piece_end ? end - position : piece->length;
+            memcpy(out, piece_text(session, piece) + from, to - from);
+            out += to - from;
+        }
+        position = piece_end;
+    }
+}
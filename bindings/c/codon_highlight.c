@@ -0,0 +1,404 @@
+/**
+ * Batched highlighting: runs a highlights query natively and returns the
+ * captured ranges as one packed array.
+ *
+ * The text predicates (#eq?, #match?, #any-of? and their not- and any-
+ * forms) are evaluated here; other predicates and all directives are left
+ * to the host and treated as satisfied.
+ */
+
+#include "codon.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <regex.h>
+#endif
+
+typedef enum {
+    PREDICATE_EQ,
+    PREDICATE_MATCH,
+    PREDICATE_ANY_OF,
+} PredicateKind;
+
+typedef struct {
+    const char *string;
+    uint32_t length;
+} String;
+
+typedef struct {
+    PredicateKind kind;
+    bool negated;
+    bool any;  // one node of a quantified capture is enough
+    uint32_t capture;
+    uint32_t other_capture;  // for #eq? against a capture, else UINT32_MAX
+    String value;            // for #eq? against a string
+    uint32_t first_value;    // #any-of? values in `values`
+    uint32_t value_count;
+#ifndef _WIN32
+    regex_t *regex;
+#endif
+} Predicate;
+
+struct CodonHighlighter {
+    TSQuery *query;
+    Predicate *predicates;
+    uint32_t predicate_count;
+    uint32_t *pattern_predicates;  // pattern i owns [p[i], p[i + 1])
+    String *values;
+};
+
+static bool string_equals(String string, const char *name) {
+    return string.length == strlen(name) && memcmp(string.string, name, string.length) == 0;
+}
+
+static String string_value(const TSQuery *query, uint32_t id) {
+    String string;
+    string.string = ts_query_string_value_for_id(query, id, &string.length);
+    return string;
+}
+
+// Recognizes the predicate named `name`. Returns false for names that are
+// not text predicates.
+static bool predicate_kind(String name, Predicate *predicate) {
+    predicate->any = false;
+    predicate->negated = false;
+    if (name.length > 4 && memcmp(name.string, "any-", 4) == 0 && !string_equals(name, "any-of?")) {
+        predicate->any = true;
+        name.string += 4;
+        name.length -= 4;
+    }
+    if (name.length > 4 && memcmp(name.string, "not-", 4) == 0) {
+        predicate->negated = true;
+        name.string += 4;
+        name.length -= 4;
+    }
+    if (string_equals(name, "eq?")) {
+        predicate->kind = PREDICATE_EQ;
+    } else if (string_equals(name, "match?")) {
+        predicate->kind = PREDICATE_MATCH;
+    } else if (string_equals(name, "any-of?") && !predicate->any) {
+        predicate->kind = PREDICATE_ANY_OF;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+typedef enum {
+    PARSE_OK,
+    PARSE_IGNORED,
+    PARSE_INVALID,
+    PARSE_NO_MEMORY,
+} ParseResult;
+
+// Reads one predicate from steps[0, count), which excludes its Done step
+static ParseResult parse_predicate(
+    CodonHighlighter *highlighter,
+    const TSQueryPredicateStep *steps,
+    uint32_t count,
+    Predicate *predicate,
+    uint32_t *value_count,
+    uint32_t *value_capacity
+) {
+    const TSQuery *query = highlighter->query;
+    if (count == 0 || steps[0].type != TSQueryPredicateStepTypeString) return PARSE_INVALID;
+    if (!predicate_kind(string_value(query, steps[0].value_id), predicate)) return PARSE_IGNORED;
+    if (count < 3 || steps[1].type != TSQueryPredicateStepTypeCapture) return PARSE_INVALID;
+    predicate->capture = steps[1].value_id;
+    predicate->other_capture = UINT32_MAX;
+
+    switch (predicate->kind) {
+        case PREDICATE_EQ:
+            if (count != 3) return PARSE_INVALID;
+            if (steps[2].type == TSQueryPredicateStepTypeCapture) {
+                predicate->other_capture = steps[2].value_id;
+            } else {
+                predicate->value = string_value(query, steps[2].value_id);
+            }
+            return PARSE_OK;
+
+        case PREDICATE_MATCH: {
+            if (count != 3 || steps[2].type != TSQueryPredicateStepTypeString) return PARSE_INVALID;
+#ifdef _WIN32
+            return PARSE_INVALID;
+#else
+            // The string table is not NUL-terminated
+            String pattern = string_value(query, steps[2].value_id);
+            char *terminated = malloc((size_t)pattern.length + 1);
+            predicate->regex = malloc(sizeof(regex_t));
+            if (terminated == NULL || predicate->regex == NULL) {
+                free(terminated);
+                free(predicate->regex);
+                predicate->regex = NULL;
+                return PARSE_NO_MEMORY;
+            }
+            memcpy(terminated, pattern.string, pattern.length);
+            terminated[pattern.length] = '\0';
+            int status = regcomp(predicate->regex, terminated, REG_EXTENDED | REG_NOSUB);
+            free(terminated);
+            if (status != 0) {
+                free(predicate->regex);
+                predicate->regex = NULL;
+                return status == REG_ESPACE ? PARSE_NO_MEMORY : PARSE_INVALID;
+            }
+            return PARSE_OK;
+#endif
+        }
+
+        case PREDICATE_ANY_OF:
+            predicate->first_value = *value_count;
+            predicate->value_count = count - 2;
+            for (uint32_t i = 2; i < count; i++) {
+                if (steps[i].type != TSQueryPredicateStepTypeString) return PARSE_INVALID;
+                if (*value_count == *value_capacity) {
+                    *value_capacity = *value_capacity ? *value_capacity * 2 : 16;
+                    String *grown = realloc(highlighter->values, *value_capacity * sizeof(String));
+                    if (grown == NULL) return PARSE_NO_MEMORY;
+                    highlighter->values = grown;
+                }
+                highlighter->values[(*value_count)++] = string_value(query, steps[i].value_id);
+            }
+            return PARSE_OK;
+    }
+    return PARSE_INVALID;
+}
+
+CodonHighlighter *codon_highlighter_new(
+    const TSLanguage *language,
+    const char *source,
+    uint32_t length,
+    uint32_t *error_offset,
+    TSQueryError *error_type
+) {
+    *error_offset = 0;
+    *error_type = TSQueryErrorNone;
+    CodonHighlighter *highlighter = calloc(1, sizeof(CodonHighlighter));
+    if (highlighter == NULL) return NULL;
+    highlighter->query = ts_query_new(language, source, length, error_offset, error_type);
+    if (highlighter->query == NULL) {
+        free(highlighter);
+        return NULL;
+    }
+
+    uint32_t pattern_count = ts_query_pattern_count(highlighter->query);
+    highlighter->pattern_predicates = calloc((size_t)pattern_count + 1, sizeof(uint32_t));
+    if (highlighter->pattern_predicates == NULL) goto fail;
+
+    // Every predicate ends with a Done step, so counting those sizes the
+    // array
+    uint32_t capacity = 0;
+    for (uint32_t i = 0; i < pattern_count; i++) {
+        uint32_t step_count;
+        const TSQueryPredicateStep *steps = ts_query_predicates_for_pattern(highlighter->query, i, &step_count);
+        for (uint32_t j = 0; j < step_count; j++) {
+            if (steps[j].type == TSQueryPredicateStepTypeDone) capacity++;
+        }
+    }
+    highlighter->predicates = calloc(capacity ? capacity : 1, sizeof(Predicate));
+    if (highlighter->predicates == NULL) goto fail;
+
+    uint32_t value_count = 0, value_capacity = 0;
+    for (uint32_t i = 0; i < pattern_count; i++) {
+        highlighter->pattern_predicates[i] = highlighter->predicate_count;
+        uint32_t step_count;
+        const TSQueryPredicateStep *steps = ts_query_predicates_for_pattern(highlighter->query, i, &step_count);
+        uint32_t start = 0;
+        for (uint32_t j = 0; j < step_count; j++) {
+            if (steps[j].type != TSQueryPredicateStepTypeDone) continue;
+            Predicate *predicate = &highlighter->predicates[highlighter->predicate_count];
+            ParseResult result = parse_predicate(
+                highlighter, steps + start, j - start, predicate, &value_count, &value_capacity
+            );
+            if (result == PARSE_OK) {
+                highlighter->predicate_count++;
+            } else if (result != PARSE_IGNORED) {
+                if (result == PARSE_INVALID) {
+                    *error_offset = ts_query_start_byte_for_pattern(highlighter->query, i);
+                    *error_type = TSQueryErrorSyntax;
+                }
+                goto fail;
+            }
+            start = j + 1;
+        }
+    }
+    highlighter->pattern_predicates[pattern_count] = highlighter->predicate_count;
+    return highlighter;
+
+fail:
+    codon_highlighter_delete(highlighter);
+    return NULL;
+}
+
+void codon_highlighter_delete(CodonHighlighter *highlighter) {
+    if (highlighter == NULL) return;
+#ifndef _WIN32
+    for (uint32_t i = 0; i < highlighter->predicate_count; i++) {
+        if (highlighter->predicates[i].regex == NULL) continue;
+        regfree(highlighter->predicates[i].regex);
+        free(highlighter->predicates[i].regex);
+    }
+#endif
+    free(highlighter->predicates);
+    free(highlighter->pattern_predicates);
+    free(highlighter->values);
+    ts_query_delete(highlighter->query);
+    free(highlighter);
+}
+
+uint32_t codon_highlighter_capture_count(const CodonHighlighter *highlighter) {
+    return ts_query_capture_count(highlighter->query);
+}
+
+const char *codon_highlighter_capture_name(const CodonHighlighter *highlighter, uint32_t id, uint32_t *length) {
+    return ts_query_capture_name_for_id(highlighter->query, id, length);
+}
+
+typedef struct {
+    const char *text;
+    uint32_t length;
+    char *scratch;  // NUL-terminated copies of node text for regexec
+    size_t scratch_capacity;
+    bool out_of_memory;
+} Source;
+
+static String node_text(const Source *source, TSNode node) {
+    uint32_t start = ts_node_start_byte(node);
+    uint32_t end = ts_node_end_byte(node);
+    if (end > source->length) end = source->length;
+    if (start > end) start = end;
+    return (String){source->text + start, end - start};
+}
+
+static bool strings_equal(String a, String b) {
+    return a.length == b.length && memcmp(a.string, b.string, a.length) == 0;
+}
+
+static bool node_satisfies(const CodonHighlighter *highlighter, const Predicate *predicate, Source *source, const TSQueryMatch *match, TSNode node) {
+    String text = node_text(source, node);
+    switch (predicate->kind) {
+        case PREDICATE_EQ:
+            if (predicate->other_capture == UINT32_MAX) return strings_equal(text, predicate->value);
+            for (uint16_t i = 0; i < match->capture_count; i++) {
+                if (match->captures[i].index == predicate->other_capture) {
+                    return strings_equal(text, node_text(source, match->captures[i].node));
+                }
+            }
+            return false;
+
+        case PREDICATE_MATCH: {
+#ifdef _WIN32
+            return false;
+#else
+            if ((size_t)text.length + 1 > source->scratch_capacity) {
+                size_t capacity = (size_t)text.length + 1 > 2 * source->scratch_capacity
+                    ? (size_t)text.length + 1
+                    : 2 * source->scratch_capacity;
+                char *grown = realloc(source->scratch, capacity);
+                if (grown == NULL) {
+                    source->out_of_memory = true;
+                    return false;
+                }
+                source->scratch = grown;
+                source->scratch_capacity = capacity;
+            }
+            memcpy(source->scratch, text.string, text.length);
+            source->scratch[text.length] = '\0';
+            return regexec(predicate->regex, source->scratch, 0, NULL, 0) == 0;
+#endif
+        }
+
+        case PREDICATE_ANY_OF:
+            for (uint32_t i = 0; i < predicate->value_count; i++) {
+                if (strings_equal(text, highlighter->values[predicate->first_value + i])) return true;
+            }
+            return false;
+    }
+    return false;
+}
+
+// Whether the predicates of `match` hold. A capture that matched no nodes
+// satisfies its predicates.
+static bool match_satisfies(const CodonHighlighter *highlighter, Source *source, const TSQueryMatch *match) {
+    uint32_t first = highlighter->pattern_predicates[match->pattern_index];
+    uint32_t last = highlighter->pattern_predicates[match->pattern_index + 1];
+    for (uint32_t p = first; p < last; p++) {
+        const Predicate *predicate = &highlighter->predicates[p];
+        bool any_node = false, all_nodes = true, seen = false;
+        for (uint16_t i = 0; i < match->capture_count; i++) {
+            if (match->captures[i].index != predicate->capture) continue;
+            seen = true;
+            bool holds = node_satisfies(highlighter, predicate, source, match, match->captures[i].node) != predicate->negated;
+            any_node = any_node || holds;
+            all_nodes = all_nodes && holds;
+        }
+        if (seen && !(predicate->any ? any_node : all_nodes)) return false;
+    }
+    return true;
+}
+
+// Whether a capture of the same range is already in the list. Entries are
+// sorted by start, so only the tail that starts at `start` is searched.
+static bool already_captured(const CodonHighlightList *list, uint32_t start, uint32_t end) {
+    for (uint32_t i = list->size; i > 0 && list->highlights[i - 1].start_byte == start; i--) {
+        if (list->highlights[i - 1].end_byte == end) return true;
+    }
+    return false;
+}
+
+bool codon_highlight(
+    const CodonHighlighter *highlighter,
+    const TSTree *tree,
+    const char *text,
+    uint32_t length,
+    uint32_t start_byte,
+    uint32_t end_byte,
+    CodonHighlightList *list
+) {
+    TSQueryCursor *cursor = ts_query_cursor_new();
+    if (cursor == NULL) return false;
+    ts_query_cursor_set_byte_range(cursor, start_byte, end_byte);
+    ts_query_cursor_exec(cursor, highlighter->query, ts_tree_root_node(tree));
+
+    Source source = {text, length, NULL, 0, false};
+    bool ok = true;
+    TSQueryMatch match;
+    uint32_t capture_index;
+    while (ts_query_cursor_next_capture(cursor, &match, &capture_index)) {
+        if (!match_satisfies(highlighter, &source, &match)) {
+            if (source.out_of_memory) {
+                ok = false;
+                break;
+            }
+            ts_query_cursor_remove_match(cursor, match.id);
+            continue;
+        }
+        TSQueryCapture capture = match.captures[capture_index];
+        uint32_t start = ts_node_start_byte(capture.node);
+        uint32_t end = ts_node_end_byte(capture.node);
+        if (already_captured(list, start, end)) continue;
+
+        if (list->size == list->capacity) {
+            uint32_t capacity = list->capacity ? list->capacity * 2 : 256;
+            CodonHighlight *grown = realloc(list->highlights, capacity * sizeof(CodonHighlight));
+            if (grown == NULL) {
+                ok = false;
+                break;
+            }
+            list->highlights = grown;
+            list->capacity = capacity;
+        }
+        list->highlights[list->size++] = (CodonHighlight){start, end, capture.index};
+    }
+    free(source.scratch);
+    ts_query_cursor_delete(cursor);
+    return ok;
+}
+
+void codon_highlight_list_delete(CodonHighlightList *list) {
+    free(list->highlights);
+    list->highlights = NULL;
+    list->size = 0;
+    list->capacity = 0;
+}
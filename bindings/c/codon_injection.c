@@ -0,0 +1,170 @@
+/**
+ * On-demand parsing of embedded LLVM IR and Python, cached by content.
+ */
+
+#include "codon.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t fnv1a(uint64_t hash, const char *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static bool is_blank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+bool codon_injection_cache_init(CodonInjectionCache *cache, uint32_t capacity, uint64_t budget) {
+    memset(cache, 0, sizeof(*cache));
+    cache->capacity = capacity ? capacity : 1;
+    cache->budget = budget;
+    cache->entries = calloc(cache->capacity, sizeof(CodonInjection));
+    cache->parser = ts_parser_new();
+    if (cache->entries == NULL || cache->parser == NULL) {
+        codon_injection_cache_destroy(cache);
+        return false;
+    }
+    return true;
+}
+
+void codon_injection_cache_destroy(CodonInjectionCache *cache) {
+    for (uint32_t i = 0; i < cache->size; i++) {
+        ts_tree_delete(cache->entries[i].tree);
+    }
+    free(cache->entries);
+    if (cache->parser != NULL) ts_parser_delete(cache->parser);
+    memset(cache, 0, sizeof(*cache));
+}
+
+// The entry added by the current call has the newest clock, so it is
+// never chosen while there are others
+static CodonInjection *least_recently_used(CodonInjectionCache *cache) {
+    CodonInjection *oldest = &cache->entries[0];
+    for (uint32_t i = 1; i < cache->size; i++) {
+        if (cache->entries[i].last_used < oldest->last_used) oldest = &cache->entries[i];
+    }
+    return oldest;
+}
+
+// Indentation shared by the lines of text[0, length). The first line
+// starts `first_indent` columns into its line in the source.
+static uint32_t common_indent(const char *text, uint32_t length, uint32_t first_indent) {
+    uint32_t common = first_indent;
+    const char *newline = memchr(text, '\n', length);
+    while (newline != NULL) {
+        const char *line = newline + 1;
+        const char *end = text + length;
+        uint32_t indent = 0;
+        while (line + indent < end && is_blank(line[indent])) indent++;
+        // Blank lines do not count
+        if (line + indent < end && line[indent] != '\n' && line[indent] != '\r' && indent < common) {
+            common = indent;
+        }
+        newline = memchr(line, '\n', (size_t)(end - line));
+    }
+    return common;
+}
+
+// One included range per line, each starting after `indent` columns of
+// the lines after the first. Returns the number of ranges, or 0 when out
+// of memory.
+static uint32_t line_ranges(const char *text, uint32_t length, uint32_t indent, TSRange **ranges) {
+    uint32_t lines = 1;
+    for (const char *c = text; (c = memchr(c, '\n', (size_t)(text + length - c))) != NULL; c++) lines++;
+    *ranges = malloc(lines * sizeof(TSRange));
+    if (*ranges == NULL) return 0;
+
+    uint32_t count = 0, row = 0, line_start = 0;
+    while (line_start < length) {
+        const char *newline = memchr(text + line_start, '\n', length - line_start);
+        uint32_t line_end = newline ? (uint32_t)(newline - text) + 1 : length;
+        uint32_t skip = 0;
+        if (row > 0) {
+            while (skip < indent && line_start + skip < line_end && is_blank(text[line_start + skip])) skip++;
+        }
+        TSRange *range = &(*ranges)[count++];
+        range->start_byte = line_start + skip;
+        range->end_byte = line_end;
+        range->start_point = (TSPoint){row, skip};
+        range->end_point = newline ? (TSPoint){row + 1, 0} : (TSPoint){row, line_end - line_start};
+        line_start = line_end;
+        row++;
+    }
+    return count;
+}
+
+const TSTree *codon_injection_parse(
+    CodonInjectionCache *cache,
+    const TSLanguage *language,
+    const char *source,
+    uint32_t start,
+    uint32_t end
+) {
+    const char *text = source + start;
+    uint32_t length = end - start;
+
+    // Extern blocks start after the indentation of their first line. A
+    // region starting mid-line leaves the indent to the lines after it.
+    uint32_t first_indent = 0;
+    while (first_indent < start && is_blank(source[start - first_indent - 1])) first_indent++;
+    if (first_indent < start && source[start - first_indent - 1] != '\n') first_indent = UINT32_MAX;
+    uint32_t indent = common_indent(text, length, first_indent);
+    if (indent == UINT32_MAX) indent = 0;
+
+    uint64_t hash = fnv1a(0xcbf29ce484222325ull, text, length);
+    hash = fnv1a(hash, (const char *)&indent, sizeof(indent));
+    cache->clock++;
+    for (uint32_t i = 0; i < cache->size; i++) {
+        CodonInjection *entry = &cache->entries[i];
+        if (entry->language == language && entry->hash == hash && entry->length == length) {
+            entry->last_used = cache->clock;
+            cache->hits++;
+            return entry->tree;
+        }
+    }
+    cache->misses++;
+
+    if (!ts_parser_set_language(cache->parser, language)) return NULL;
+    TSRange *ranges = NULL;
+    uint32_t range_count = length > 0 ? line_ranges(text, length, indent, &ranges) : 0;
+    if (length > 0 && range_count == 0) return NULL;
+    TSTree *tree = NULL;
+    if (range_count == 0 || ts_parser_set_included_ranges(cache->parser, ranges, range_count)) {
+        tree = ts_parser_parse_string(cache->parser, NULL, text, length);
+    }
+    free(ranges);
+    ts_parser_set_included_ranges(cache->parser, NULL, 0);
+    if (tree == NULL) return NULL;
+
+    CodonTreeMemory memory;
+    codon_tree_memory(tree, &memory);
+    CodonInjection *slot = &cache->entries[cache->size];
+    if (cache->size == cache->capacity) {
+        slot = least_recently_used(cache);
+        cache->bytes -= slot->bytes;
+        ts_tree_delete(slot->tree);
+    } else {
+        cache->size++;
+    }
+    slot->language = language;
+    slot->hash = hash;
+    slot->length = length;
+    slot->last_used = cache->clock;
+    slot->bytes = memory.total_bytes;
+    slot->tree = tree;
+    cache->bytes += slot->bytes;
+
+    // Trim to the budget, keeping the tree being returned
+    while (cache->budget > 0 && cache->bytes > cache->budget && cache->size > 1) {
+        CodonInjection *oldest = least_recently_used(cache);
+        cache->bytes -= oldest->bytes;
+        ts_tree_delete(oldest->tree);
+        *oldest = cache->entries[--cache->size];
+    }
+    return tree;
+}
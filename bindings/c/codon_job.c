@@ -0,0 +1,99 @@
+/**
+ * Parsing in time slices, for files too big to parse in one go.
+ *
+ * tree-sitter keeps an interrupted parse in the parser and resumes it on
+ * the next call with the same input, so a job holds one parser for its
+ * whole life and only resets it by handing it back to the pool.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "codon.h"
+
+#include <string.h>
+#include <time.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+#ifdef _WIN32
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Called by the parser every hundred or so operations
+static bool job_progress(TSParseState *state) {
+    CodonParseJob *job = (CodonParseJob *)state->payload;
+    if (state->current_byte_offset > job->offset) job->offset = state->current_byte_offset;
+    if (state->has_error) job->has_error = true;
+    return job->deadline >= 0 && now_seconds() >= job->deadline;
+}
+
+void codon_parse_job_init(
+    CodonParseJob *job,
+    CodonParserPool *pool,
+    const char *text,
+    uint32_t length,
+    const TSTree *old_tree
+) {
+    memset(job, 0, sizeof(*job));
+    job->pool = pool;
+    job->buffer.data = text;
+    job->buffer.length = length;
+    job->old_tree = old_tree != NULL ? ts_tree_copy(old_tree) : NULL;
+}
+
+void codon_parse_job_destroy(CodonParseJob *job) {
+    if (job->parser != NULL) codon_parser_pool_release(job->pool, job->parser);
+    ts_tree_delete(job->tree);
+    ts_tree_delete(job->old_tree);
+    memset(job, 0, sizeof(*job));
+}
+
+bool codon_parse_job_run(CodonParseJob *job, double seconds) {
+    if (job->tree != NULL) return true;
+    if (job->parser == NULL) job->parser = codon_parser_pool_acquire(job->pool);
+
+    job->deadline = seconds < 0 ? -1 : now_seconds() + seconds;
+    TSParseOptions options;
+    options.payload = job;
+    options.progress_callback = job_progress;
+    TSTree *tree = ts_parser_parse_with_options(job->parser, job->old_tree, codon_buffer_input(&job->buffer), options);
+    if (tree == NULL) return false;
+
+    codon_parser_pool_release(job->pool, job->parser);
+    job->parser = NULL;
+    job->tree = tree;
+    job->offset = job->buffer.length;
+    job->has_error = ts_node_has_error(ts_tree_root_node(tree));
+    return true;
+}
+
+static bool starts_statement(char c) {
+    return c != ' ' && c != '\t' && c != '\f' && c != '\r' && c != '\n' && c != '#';
+}
+
+uint32_t codon_parse_job_prefix(const CodonParseJob *job, uint32_t max_bytes) {
+    uint32_t limit = job->offset < max_bytes ? job->offset : max_bytes;
+    if (limit >= job->buffer.length) return job->buffer.length;
+
+    const char *text = job->buffer.data;
+    for (uint32_t i = limit; i > 0; i--) {
+        if (text[i - 1] == '\n' && starts_statement(text[i])) return i;
+    }
+    return 0;
+}
+
+TSTree *codon_parse_job_partial(CodonParseJob *job, uint32_t max_bytes) {
+    uint32_t length = codon_parse_job_prefix(job, max_bytes);
+    if (length == job->buffer.length && job->tree != NULL) return ts_tree_copy(job->tree);
+
+    TSParser *parser = codon_parser_pool_acquire(job->pool);
+    TSTree *tree = ts_parser_parse_string(parser, NULL, job->buffer.data, length);
+    codon_parser_pool_release(job->pool, parser);
+    return tree;
+}
@@ -0,0 +1,251 @@
+/**
+ * Tree memory estimates, and a cache of trees kept under a memory budget.
+ */
+
+#include "codon.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Layout of the tree-sitter 0.25 runtime: sizeof(SubtreeHeapData), one
+// Subtree in a child array, the inline storage of an external scanner
+// state, and TSTree with its one included range
+#define SUBTREE_BYTES 80
+#define CHILD_BYTES 8
+#define INLINE_STATE_BYTES 24
+#define TREE_BYTES 64
+
+// Tokens are stored inline in their parent when all of these fit
+#define INLINE_LIMIT 255
+#define INLINE_SYMBOL_LIMIT 255
+#define INLINE_PADDING_ROWS 16
+
+typedef struct {
+    TSSymbol module;
+    TSSymbol block;
+    TSSymbol string;
+    TSSymbol string_start;
+    TSSymbol string_end;
+    TSSymbol extern_content;
+} Symbols;
+
+static TSSymbol symbol(const TSLanguage *language, const char *name) {
+    return ts_language_symbol_for_name(language, name, (uint32_t)strlen(name), true);
+}
+
+static void add_node(CodonTreeMemory *memory, uint32_t child_count) {
+    memory->heap_subtrees++;
+    memory->subtree_bytes += SUBTREE_BYTES + (uint64_t)child_count * CHILD_BYTES;
+}
+
+// An external token: always on the heap, carrying the scanner state that
+// was serialized after it. The Codon scanner writes one varint each for
+// the indent and delimiter counts, then about a byte per open indent and
+// string, so the state grows with the nesting.
+static void add_external_token(CodonTreeMemory *memory, uint32_t blocks, uint32_t strings) {
+    add_node(memory, 0);
+    uint32_t state = 2 + (blocks + 1) + strings;
+    if (state > INLINE_STATE_BYTES) memory->scanner_state_bytes += state;
+}
+
+void codon_tree_memory(const TSTree *tree, CodonTreeMemory *memory) {
+    memset(memory, 0, sizeof(*memory));
+    const TSLanguage *language = ts_tree_language(tree);
+    Symbols symbols = {
+        symbol(language, "module"),
+        symbol(language, "block"),
+        symbol(language, "string"),
+        symbol(language, "string_start"),
+        symbol(language, "string_end"),
+        symbol(language, "extern_content"),
+    };
+
+    TSTreeCursor cursor = ts_tree_cursor_new(ts_tree_root_node(tree));
+    uint32_t blocks = 0, strings = 0;
+    uint32_t last_end = 0;
+    TSPoint last_point = {0, 0};
+    for (;;) {
+        TSNode node = ts_tree_cursor_current_node(&cursor);
+        TSSymbol type = ts_node_symbol(node);
+        uint32_t children = ts_node_child_count(node);
+        if (children > 0) {
+            add_node(memory, children);
+            if (type == symbols.module || type == symbols.block) {
+                // A hidden repeat node joins each pair of statements, and
+                // simple statements end in a hidden _newline
+                if (children > 1) {
+                    memory->heap_subtrees += children - 1;
+                    memory->subtree_bytes += (uint64_t)(children - 1) * (SUBTREE_BYTES + 2 * CHILD_BYTES);
+                }
+                uint32_t depth = blocks + (type == symbols.block);
+                for (uint32_t i = 0; i < children; i++) add_external_token(memory, depth, strings);
+                if (type == symbols.block) {
+                    add_external_token(memory, depth, strings);  // _indent
+                    add_external_token(memory, depth, strings);  // _dedent
+                }
+            } else if (type == symbols.string) {
+                // Hidden _string_content between the visible parts
+                for (uint32_t i = 1; i < children; i++) add_external_token(memory, blocks, strings + 1);
+            }
+        } else {
+            uint32_t start = ts_node_start_byte(node), end = ts_node_end_byte(node);
+            TSPoint start_point = ts_node_start_point(node), end_point = ts_node_end_point(node);
+            uint32_t padding_rows = start_point.row - last_point.row;
+            uint32_t padding_columns = padding_rows ? start_point.column : start_point.column - last_point.column;
+            if (type == symbols.string_start || type == symbols.string_end ||
+                type == symbols.extern_content || type == symbols.block) {
+                // A childless block is an aliased _newline
+                add_external_token(memory, blocks, strings);
+            } else if (type <= INLINE_SYMBOL_LIMIT && start - last_end < INLINE_LIMIT &&
+                       padding_rows < INLINE_PADDING_ROWS && padding_columns < INLINE_LIMIT &&
+                       end - start < INLINE_LIMIT && end_point.row == start_point.row &&
+                       end_point.column - start_point.column < INLINE_LIMIT) {
+                memory->inline_subtrees++;
+            } else {
+                add_node(memory, 0);
+            }
+            last_end = end;
+            last_point = end_point;
+        }
+
+        if (ts_tree_cursor_goto_first_child(&cursor)) {
+            if (type == symbols.block) blocks++;
+            if (type == symbols.string) strings++;
+            continue;
+        }
+        bool done = false;
+        while (!ts_tree_cursor_goto_next_sibling(&cursor)) {
+            if (!ts_tree_cursor_goto_parent(&cursor)) {
+                done = true;
+                break;
+            }
+            TSSymbol parent = ts_node_symbol(ts_tree_cursor_current_node(&cursor));
+            if (parent == symbols.block) blocks--;
+            if (parent == symbols.string) strings--;
+        }
+        if (done) break;
+    }
+    ts_tree_cursor_delete(&cursor);
+    memory->total_bytes = TREE_BYTES + memory->subtree_bytes + memory->scanner_state_bytes;
+}
+
+/* Tree cache */
+
+static uint64_t fnv1a(const char *data, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static CodonCachedTree *find(CodonTreeCache *cache, const char *key, uint32_t key_length) {
+    uint64_t hash = fnv1a(key, key_length);
+    for (uint32_t i = 0; i < cache->size; i++) {
+        CodonCachedTree *entry = &cache->entries[i];
+        if (entry->hash == hash && entry->key_length == key_length && memcmp(entry->key, key, key_length) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Removes `entry` by moving the last entry into its slot
+static void drop(CodonTreeCache *cache, CodonCachedTree *entry) {
+    cache->bytes -= entry->bytes;
+    ts_tree_delete(entry->tree);
+    free(entry->key);
+    *entry = cache->entries[--cache->size];
+}
+
+// Evicts least recently used trees, other than `keep`, until within budget
+static void evict(CodonTreeCache *cache, const CodonCachedTree *keep) {
+    if (cache->budget == 0) return;
+    while (cache->bytes > cache->budget && cache->size > (keep != NULL ? 1 : 0)) {
+        CodonCachedTree *oldest = NULL;
+        for (uint32_t i = 0; i < cache->size; i++) {
+            CodonCachedTree *entry = &cache->entries[i];
+            if (entry != keep && (oldest == NULL || entry->last_used < oldest->last_used)) oldest = entry;
+        }
+        // The last entry moves into the evicted slot
+        if (keep == &cache->entries[cache->size - 1]) keep = oldest;
+        drop(cache, oldest);
+        cache->evictions++;
+    }
+}
+
+void codon_tree_cache_init(CodonTreeCache *cache, uint64_t budget) {
+    memset(cache, 0, sizeof(*cache));
+    cache->budget = budget;
+}
+
+void codon_tree_cache_destroy(CodonTreeCache *cache) {
+    for (uint32_t i = 0; i < cache->size; i++) {
+        ts_tree_delete(cache->entries[i].tree);
+        free(cache->entries[i].key);
+    }
+    free(cache->entries);
+    memset(cache, 0, sizeof(*cache));
+}
+
+const TSTree *codon_tree_cache_get(CodonTreeCache *cache, const char *key, uint32_t key_length) {
+    CodonCachedTree *entry = find(cache, key, key_length);
+    if (entry == NULL) {
+        cache->misses++;
+        return NULL;
+    }
+    cache->hits++;
+    entry->last_used = ++cache->clock;
+    return entry->tree;
+}
+
+bool codon_tree_cache_put(CodonTreeCache *cache, const char *key, uint32_t key_length, TSTree *tree) {
+    CodonTreeMemory memory;
+    codon_tree_memory(tree, &memory);
+
+    CodonCachedTree *entry = find(cache, key, key_length);
+    if (entry != NULL) {
+        cache->bytes -= entry->bytes;
+        ts_tree_delete(entry->tree);
+    } else {
+        if (cache->size == cache->capacity) {
+            uint32_t capacity = cache->capacity ? cache->capacity * 2 : 16;
+            CodonCachedTree *entries = realloc(cache->entries, capacity * sizeof(CodonCachedTree));
+            if (entries == NULL) {
+                ts_tree_delete(tree);
+                return false;
+            }
+            cache->entries = entries;
+            cache->capacity = capacity;
+        }
+        char *copy = malloc(key_length ? key_length : 1);
+        if (copy == NULL) {
+            ts_tree_delete(tree);
+            return false;
+        }
+        memcpy(copy, key, key_length);
+        entry = &cache->entries[cache->size++];
+        entry->key = copy;
+        entry->key_length = key_length;
+        entry->hash = fnv1a(key, key_length);
+    }
+    entry->tree = tree;
+    entry->bytes = memory.total_bytes;
+    entry->last_used = ++cache->clock;
+    cache->bytes += entry->bytes;
+    evict(cache, entry);
+    return true;
+}
+
+bool codon_tree_cache_remove(CodonTreeCache *cache, const char *key, uint32_t key_length) {
+    CodonCachedTree *entry = find(cache, key, key_length);
+    if (entry == NULL) return false;
+    drop(cache, entry);
+    return true;
+}
+
+void codon_tree_cache_set_budget(CodonTreeCache *cache, uint64_t budget) {
+    cache->budget = budget;
+    evict(cache, NULL);
+}
@@ -0,0 +1,225 @@
+/**
+ * Parser pooling and multi-threaded batch parsing.
+ */
+
+#include "codon.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void codon_parser_pool_init(CodonParserPool *pool) {
+    pool->parsers = NULL;
+    pool->size = 0;
+    pool->capacity = 0;
+    codon_mutex_init(&pool->lock);
+}
+
+void codon_parser_pool_destroy(CodonParserPool *pool) {
+    for (uint32_t i = 0; i < pool->size; i++) {
+        ts_parser_delete(pool->parsers[i]);
+    }
+    free(pool->parsers);
+    pool->parsers = NULL;
+    pool->size = 0;
+    pool->capacity = 0;
+    codon_mutex_destroy(&pool->lock);
+}
+
+TSParser *codon_parser_pool_acquire(CodonParserPool *pool) {
+    TSParser *parser = NULL;
+    codon_mutex_lock(&pool->lock);
+    if (pool->size > 0) {
+        parser = pool->parsers[--pool->size];
+    }
+    codon_mutex_unlock(&pool->lock);
+
+    if (parser == NULL) {
+        parser = ts_parser_new();
+        ts_parser_set_language(parser, tree_sitter_codon());
+    }
+    return parser;
+}
+
+void codon_parser_pool_release(CodonParserPool *pool, TSParser *parser) {
+    ts_parser_reset(parser);
+    codon_mutex_lock(&pool->lock);
+    if (pool->size == pool->capacity) {
+        uint32_t capacity = pool->capacity ? pool->capacity * 2 : 8;
+        TSParser **parsers = realloc(pool->parsers, capacity * sizeof(TSParser *));
+        if (parsers == NULL) {
+            codon_mutex_unlock(&pool->lock);
+            ts_parser_delete(parser);
+            return;
+        }
+        pool->parsers = parsers;
+        pool->capacity = capacity;
+    }
+    pool->parsers[pool->size++] = parser;
+    codon_mutex_unlock(&pool->lock);
+}
+
+static const char *buffer_read(void *payload, uint32_t byte, TSPoint position, uint32_t *bytes_read) {
+    CodonBuffer *buffer = (CodonBuffer *)payload;
+    (void)position;
+    if (byte >= buffer->length) {
+        *bytes_read = 0;
+        return "";
+    }
+    *bytes_read = buffer->length - byte;
+    return buffer->data + byte;
+}
+
+TSInput codon_buffer_input(CodonBuffer *buffer) {
+    TSInput input;
+    input.payload = buffer;
+    input.read = buffer_read;
+    input.encoding = TSInputEncodingUTF8;
+    input.decode = NULL;
+    return input;
+}
+
+// Reads a whole file into a malloc'd buffer. Returns 0 or an errno value.
+static int read_file(const char *path, char **data, uint32_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return errno;
+
+    int error = 0;
+    char *buffer = NULL;
+    long size;
+    if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0) {
+        error = errno;
+    } else if ((unsigned long)size > UINT32_MAX) {
+        error = EFBIG;
+    } else if ((buffer = malloc(size ? (size_t)size : 1)) == NULL) {
+        error = ENOMEM;
+    } else if (fread(buffer, 1, (size_t)size, file) != (size_t)size) {
+        error = EIO;
+    }
+    fclose(file);
+
+    if (error) {
+        free(buffer);
+        return error;
+    }
+    *data = buffer;
+    *length = (uint32_t)size;
+    return 0;
+}
+
+static void parse_source(
+    TSParser *parser,
+    const CodonSource *source,
+    bool keep_trees,
+    const char *cache_directory,
+    CodonResult *result
+) {
+    const char *data = source->data;
+    uint32_t length = source->length;
+    char *owned = NULL;
+
+    result->tree = NULL;
+    result->error = 0;
+    result->cached = false;
+    if (source->path != NULL) {
+        result->error = read_file(source->path, &owned, &length);
+        if (result->error) return;
+        data = owned;
+    }
+
+    if (cache_directory != NULL && !keep_trees) {
+        CodonCacheEntry entry;
+        bool ok = codon_cache_get(cache_directory, parser, data, length, &entry);
+        free(owned);
+        if (!ok) {
+            result->error = ECANCELED;
+            return;
+        }
+        result->summary = entry.summary;
+        result->cached = entry.hit;
+        codon_cache_entry_release(&entry);
+        return;
+    }
+
+    TSTree *tree = ts_parser_parse_string(parser, NULL, data, length);
+    free(owned);
+    if (tree == NULL) {
+        result->error = ECANCELED;
+        ts_parser_reset(parser);
+        return;
+    }
+
+    codon_summarize(tree, &result->summary);
+    if (keep_trees) {
+        result->tree = tree;
+    } else {
+        ts_tree_delete(tree);
+    }
+}
+
+typedef struct {
+    CodonParserPool *pool;
+    const CodonSource *sources;
+    CodonResult *results;
+    size_t count;
+    size_t next;
+    bool keep_trees;
+    const char *cache_directory;
+    CodonMutex lock;
+} Batch;
+
+static size_t batch_take(Batch *batch) {
+    codon_mutex_lock(&batch->lock);
+    size_t index = batch->next < batch->count ? batch->next++ : batch->count;
+    codon_mutex_unlock(&batch->lock);
+    return index;
+}
+
+static CODON_THREAD_RETURN batch_worker(void *payload) {
+    Batch *batch = (Batch *)payload;
+    TSParser *parser = codon_parser_pool_acquire(batch->pool);
+    for (size_t i = batch_take(batch); i < batch->count; i = batch_take(batch)) {
+        parse_source(parser, &batch->sources[i], batch->keep_trees, batch->cache_directory, &batch->results[i]);
+    }
+    codon_parser_pool_release(batch->pool, parser);
+    return CODON_THREAD_RESULT;
+}
+
+void codon_parse_many(
+    CodonParserPool *pool,
+    const CodonSource *sources,
+    size_t count,
+    unsigned threads,
+    bool keep_trees,
+    const char *cache_directory,
+    CodonResult *results
+) {
+    Batch batch;
+    batch.pool = pool;
+    batch.sources = sources;
+    batch.results = results;
+    batch.count = count;
+    batch.next = 0;
+    batch.keep_trees = keep_trees;
+    batch.cache_directory = cache_directory;
+    codon_mutex_init(&batch.lock);
+
+    if (threads > count) threads = (unsigned)count;
+    if (threads == 0) threads = 1;
+
+    // The calling thread is always one of the workers
+    CodonThread *workers = threads > 1 ? malloc((threads - 1) * sizeof(CodonThread)) : NULL;
+    unsigned started = 0;
+    if (workers != NULL) {
+        while (started < threads - 1 && codon_thread_start(&workers[started], batch_worker, &batch)) {
+            started++;
+        }
+    }
+    batch_worker(&batch);
+    for (unsigned i = 0; i < started; i++) {
+        codon_thread_join(&workers[i]);
+    }
+
+    free(workers);
+    codon_mutex_destroy(&batch.lock);
+}
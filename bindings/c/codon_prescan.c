@@ -0,0 +1,372 @@
+/**
+ * Header pre-scan: the directives and imports at the top of a file.
+ *
+ * Build tools only need a file's dependencies and compiler flags, which
+ * Codon code keeps above everything else. Instead of parsing the whole
+ * file this lexes statements one at a time from the top, and returns at
+ * the first one that is not an import, a directive or a bare string.
+ */
+
+#include "codon.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+const char *const codon_prescan_kind_names[CODON_PRESCAN_KIND_COUNT] = {
+    "directive",
+    "import",
+    "from_import",
+    "c_import",
+    "python_import",
+};
+
+typedef struct {
+    const char *text;
+    uint32_t length;
+    uint32_t position;
+    uint32_t row;
+    uint32_t depth;  // of the parenthesized name list being read, if any
+    CodonPrescanList *list;
+    bool failed;     // out of memory
+} Prescanner;
+
+static unsigned char peek(const Prescanner *p, uint32_t offset) {
+    return p->position + offset < p->length ? (unsigned char)p->text[p->position + offset] : 0;
+}
+
+static bool is_name_char(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+static bool is_line_end(unsigned char c) {
+    return c == 0 || c == '\n' || c == '\r';
+}
+
+static void skip_comment(Prescanner *p) {
+    while (!is_line_end(peek(p, 0))) p->position++;
+}
+
+static void skip_newline(Prescanner *p) {
+    if (peek(p, 0) == '\r') p->position++;
+    if (peek(p, 0) == '\n') p->position++;
+    p->row++;
+}
+
+// Skips blanks and line continuations, and inside a parenthesized list
+// also newlines and comments
+static void skip_space(Prescanner *p) {
+    for (;;) {
+        unsigned char c = peek(p, 0);
+        if (c == ' ' || c == '\t' || c == '\f') {
+            p->position++;
+        } else if (c == '\\' && (peek(p, 1) == '\n' || (peek(p, 1) == '\r' && peek(p, 2) == '\n'))) {
+            p->position++;
+            skip_newline(p);
+        } else if (p->depth > 0 && (c == '\n' || c == '\r')) {
+            skip_newline(p);
+        } else if (p->depth > 0 && c == '#') {
+            skip_comment(p);
+        } else {
+            return;
+        }
+    }
+}
+
+static bool read_name(Prescanner *p, uint32_t *start, uint32_t *end) {
+    if (!is_name_char(peek(p, 0)) || (peek(p, 0) >= '0' && peek(p, 0) <= '9')) return false;
+    *start = p->position;
+    while (is_name_char(peek(p, 0))) p->position++;
+    *end = p->position;
+    return true;
+}
+
+// `a.b.c`, allowing blanks around the dots as Python does
+static bool read_dotted_name(Prescanner *p, uint32_t *start, uint32_t *end) {
+    uint32_t ignored;
+    if (!read_name(p, start, end)) return false;
+    for (;;) {
+        uint32_t position = p->position, row = p->row;
+        skip_space(p);
+        if (peek(p, 0) == '.') {
+            p->position++;
+            skip_space(p);
+            if (read_name(p, &ignored, end)) continue;
+        }
+        p->position = position;
+        p->row = row;
+        return true;
+    }
+}
+
+static bool at_keyword(const Prescanner *p, const char *word) {
+    size_t length = strlen(word);
+    return p->length - p->position >= length &&
+        memcmp(p->text + p->position, word, length) == 0 &&
+        !is_name_char(peek(p, (uint32_t)length));
+}
+
+static bool keyword(Prescanner *p, const char *word) {
+    if (!at_keyword(p, word)) return false;
+    p->position += (uint32_t)strlen(word);
+    return true;
+}
+
+static bool consume(Prescanner *p, unsigned char c) {
+    if (peek(p, 0) != c) return false;
+    p->position++;
+    return true;
+}
+
+// A string literal statement, such as the module docstring
+static bool skip_string(Prescanner *p) {
+    uint32_t offset = 0;
+    while (offset < 2 && peek(p, offset) != 0 && strchr("rRbBuUfF", peek(p, offset)) != NULL) offset++;
+    unsigned char quote = peek(p, offset);
+    if (quote != '"' && quote != '\'') return false;
+    bool triple = peek(p, offset + 1) == quote && peek(p, offset + 2) == quote;
+    p->position += offset + (triple ? 3 : 1);
+    while (p->position < p->length) {
+        unsigned char c = peek(p, 0);
+        if (c == '\\') {
+            p->position++;
+            if (peek(p, 0) == '\n') p->row++;
+        } else if (c == quote && (!triple || (peek(p, 1) == quote && peek(p, 2) == quote))) {
+            p->position += triple ? 3 : 1;
+            return true;
+        } else if (c == '\n') {
+            if (!triple) return true;
+            p->row++;
+        }
+        p->position++;
+    }
+    return true;
+}
+
+static bool add_record(
+    Prescanner *p, CodonPrescanKind kind, uint32_t start, uint32_t row,
+    uint32_t name_start, uint32_t name_end, uint32_t value_start, uint32_t value_end
+) {
+    CodonPrescanList *list = p->list;
+    if (list->size == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 16;
+        CodonPrescanRecord *records = realloc(list->records, capacity * sizeof(CodonPrescanRecord));
+        if (records == NULL) {
+            p->failed = true;
+            return false;
+        }
+        list->records = records;
+        list->capacity = capacity;
+    }
+    list->records[list->size++] = (CodonPrescanRecord){
+        .kind = kind,
+        .row = row,
+        .start_byte = start,
+        .end_byte = start,
+        .name_start_byte = name_start,
+        .name_end_byte = name_end,
+        .value_start_byte = value_start,
+        .value_end_byte = value_end,
+    };
+    return true;
+}
+
+// Reads up to the next `,` or the end of the statement or name list,
+// balancing brackets. Returns the range without surrounding blanks.
+static void read_rest(Prescanner *p, uint32_t *start, uint32_t *end) {
+    uint32_t nesting = 0;
+    skip_space(p);
+    *start = *end = p->position;
+    while (p->position < p->length) {
+        unsigned char c = peek(p, 0);
+        bool bracketed = nesting > 0 || p->depth > 0;
+        if (nesting == 0 && (c == ',' || (p->depth > 0 && c == ')'))) break;
+        if (c == '\\' && (peek(p, 1) == '\n' || peek(p, 1) == '\r')) {
+            p->position++;
+            skip_newline(p);
+            continue;
+        }
+        if (c == '\n' || c == '\r') {
+            if (!bracketed) break;
+            skip_newline(p);
+            continue;
+        }
+        if (c == '#') {
+            if (!bracketed) break;
+            skip_comment(p);
+            continue;
+        }
+        if (c == ';' && !bracketed) break;
+        if (c == '(' || c == '[' || c == '{') nesting++;
+        if ((c == ')' || c == ']' || c == '}') && nesting > 0) nesting--;
+        p->position++;
+        if (c != ' ' && c != '\t' && c != '\f') *end = p->position;
+    }
+}
+
+// `import a.b as c, d`
+static bool read_import(Prescanner *p, uint32_t start, uint32_t row) {
+    do {
+        uint32_t name_start, name_end;
+        skip_space(p);
+        if (!read_dotted_name(p, &name_start, &name_end)) return false;
+        uint32_t alias_start = name_end, alias_end = name_end;
+        skip_space(p);
+        if (keyword(p, "as")) {
+            skip_space(p);
+            if (!read_name(p, &alias_start, &alias_end)) return false;
+            skip_space(p);
+        }
+        if (!add_record(p, CODON_PRESCAN_IMPORT, start, row, name_start, name_end, alias_start, alias_end)) return false;
+    } while (consume(p, ','));
+    return true;
+}
+
+// `from .a import b`, `from C import f(int) -> int`, `from python import g`
+static bool read_from_import(Prescanner *p, uint32_t start, uint32_t row) {
+    uint32_t module_start, module_end, ignored;
+    skip_space(p);
+    module_start = module_end = p->position;
+    while (peek(p, 0) == '.') {
+        p->position++;
+        module_end = p->position;
+        skip_space(p);
+    }
+    // `from . import a` imports from the package itself
+    if (module_end == module_start || !at_keyword(p, "import")) {
+        if (!read_dotted_name(p, &ignored, &module_end)) return false;
+    }
+    skip_space(p);
+    if (!keyword(p, "import")) return false;
+    skip_space(p);
+
+    uint32_t module_length = module_end - module_start;
+    const char *module = p->text + module_start;
+    CodonPrescanKind kind = CODON_PRESCAN_FROM_IMPORT;
+    if (module_length == 1 && module[0] == 'C') kind = CODON_PRESCAN_C_IMPORT;
+    if (module_length == 6 && memcmp(module, "python", 6) == 0) kind = CODON_PRESCAN_PYTHON_IMPORT;
+
+    bool parenthesized = consume(p, '(');
+    if (parenthesized) p->depth = 1;
+    if (kind == CODON_PRESCAN_FROM_IMPORT) {
+        uint32_t names_start, names_end, item_start, item_end;
+        read_rest(p, &names_start, &names_end);
+        while (consume(p, ',')) {
+            read_rest(p, &item_start, &item_end);
+            if (item_end > item_start) names_end = item_end;
+        }
+        if (!add_record(p, kind, start, row, module_start, module_end, names_start, names_end)) return false;
+    } else {
+        do {
+            uint32_t name_start, name_end, value_start, value_end;
+            skip_space(p);
+            // A trailing comma inside parentheses
+            if (parenthesized && peek(p, 0) == ')') break;
+            if (!read_dotted_name(p, &name_start, &name_end)) return false;
+            read_rest(p, &value_start, &value_end);
+            if (!add_record(p, kind, start, row, name_start, name_end, value_start, value_end)) return false;
+        } while (consume(p, ','));
+    }
+    if (parenthesized) {
+        skip_space(p);
+        p->depth = 0;
+        if (!consume(p, ')')) return false;
+    }
+    return true;
+}
+
+// `## codon: key = value`. Anything else starting with `##` is a comment.
+static bool read_directive(Prescanner *p) {
+    uint32_t start = p->position, row = p->row;
+    uint32_t key_start, key_end, value_start, value_end;
+    p->position += 2;
+    skip_space(p);
+    if (!keyword(p, "codon") || !consume(p, ':')) return false;
+    skip_space(p);
+    if (!read_name(p, &key_start, &key_end)) return false;
+    skip_space(p);
+    if (!consume(p, '=')) return false;
+    skip_space(p);
+    value_start = p->position;
+    while (is_name_char(peek(p, 0))) p->position++;
+    value_end = p->position;
+    if (value_end == value_start) return false;
+    if (!add_record(p, CODON_PRESCAN_DIRECTIVE, start, row, key_start, key_end, value_start, value_end)) return false;
+    p->list->records[p->list->size - 1].end_byte = value_end;
+    return true;
+}
+
+// One statement starting at the cursor. Returns false at the first one
+// outside the header.
+static bool read_statement(Prescanner *p) {
+    uint32_t start = p->position, row = p->row;
+    uint32_t first = p->list->size;
+    bool ok;
+    if (keyword(p, "import")) {
+        ok = read_import(p, start, row);
+    } else if (keyword(p, "from")) {
+        ok = read_from_import(p, start, row);
+    } else {
+        ok = skip_string(p);
+    }
+    p->depth = 0;
+    if (!ok) {
+        // Drop what a statement that turned out not to be an import added
+        p->list->size = first;
+        return false;
+    }
+    uint32_t end = p->position;
+    while (end > start && (p->text[end - 1] == ' ' || p->text[end - 1] == '\t')) end--;
+    for (uint32_t i = first; i < p->list->size; i++) p->list->records[i].end_byte = end;
+    return true;
+}
+
+bool codon_prescan(const char *text, uint32_t length, CodonPrescanList *list) {
+    Prescanner p = {.text = text, .length = length, .list = list};
+    // A byte order mark is not indentation
+    if (length >= 3 && memcmp(text, "\xEF\xBB\xBF", 3) == 0) p.position = 3;
+
+    while (p.position < p.length && !p.failed) {
+        uint32_t line_start = p.position;
+        while (peek(&p, 0) == ' ' || peek(&p, 0) == '\t' || peek(&p, 0) == '\f') p.position++;
+        unsigned char c = peek(&p, 0);
+        if (p.position >= p.length) break;
+        if (c == '\n' || c == '\r') {
+            skip_newline(&p);
+            continue;
+        }
+        if (c == '#') {
+            if (p.position == line_start && peek(&p, 1) == '#') {
+                uint32_t position = p.position;
+                if (!read_directive(&p) && !p.failed) p.position = position;
+            }
+            skip_comment(&p);
+            continue;
+        }
+        // Indented code cannot be part of the header
+        if (p.position != line_start) break;
+
+        bool more = true;
+        for (;;) {
+            if (!read_statement(&p)) {
+                more = false;
+                break;
+            }
+            skip_space(&p);
+            if (!consume(&p, ';')) break;
+            skip_space(&p);
+            if (is_line_end(peek(&p, 0)) || peek(&p, 0) == '#') break;
+        }
+        if (!more) break;
+        // Anything left on the line ends the header too
+        if (peek(&p, 0) != '#' && !is_line_end(peek(&p, 0))) break;
+        skip_comment(&p);
+    }
+    return !p.failed;
+}
+
+void codon_prescan_list_delete(CodonPrescanList *list) {
+    free(list->records);
+    list->records = NULL;
+    list->size = 0;
+    list->capacity = 0;
+}
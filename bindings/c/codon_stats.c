@@ -0,0 +1,84 @@
+/**
+ * Per-parse statistics collected from the tree-sitter parse log.
+ */
+
+#include "codon.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// True when `message` starts with the action name `word`
+static bool is_action(const char *message, const char *word) {
+    size_t length = strlen(word);
+    if (strncmp(message, word, length) != 0) return false;
+    char next = message[length];
+    return next == '\0' || next == ' ' || next == ',';
+}
+
+// The symbol named by `name`, which runs to the next comma. Only rules are
+// reduced to, and they come after the tokens in the symbol table, so the
+// search runs backwards to prefer a rule over a token of the same name.
+// Returns UINT16_MAX when no symbol matches.
+static TSSymbol reduced_symbol(const TSLanguage *language, const char *name) {
+    const char *end = strchr(name, ',');
+    size_t length = end ? (size_t)(end - name) : strlen(name);
+    for (uint32_t i = ts_language_symbol_count(language); i > 0; i--) {
+        const char *candidate = ts_language_symbol_name(language, (TSSymbol)(i - 1));
+        if (candidate != NULL && strncmp(candidate, name, length) == 0 && candidate[length] == '\0') {
+            return (TSSymbol)(i - 1);
+        }
+    }
+    return UINT16_MAX;
+}
+
+static void log_parse_stats(void *payload, TSLogType type, const char *message) {
+    if (type != TSLogTypeParse) return;
+    CodonParseStats *stats = (CodonParseStats *)payload;
+
+    if (is_action(message, "process")) {
+        // "process version:%u, version_count:%u, state:%d, ..."
+        const char *count = strstr(message, "version_count:");
+        uint32_t versions = count ? (uint32_t)strtoul(count + 14, NULL, 10) : 1;
+        stats->steps++;
+        if (versions > 1) stats->forked_steps++;
+        if (stats->current_versions > 0 && versions > stats->current_versions) {
+            stats->forks += versions - stats->current_versions;
+        }
+        if (versions > stats->max_versions) stats->max_versions = versions;
+        stats->current_versions = versions;
+    } else if (is_action(message, "lex_external")) {
+        stats->lex_calls++;
+        stats->external_lex_calls++;
+    } else if (is_action(message, "lex_internal")) {
+        stats->lex_calls++;
+    } else if (is_action(message, "shift") || is_action(message, "shift_extra")) {
+        stats->shifts++;
+    } else if (is_action(message, "reduce")) {
+        // "reduce sym:%s, child_count:%u"
+        stats->reductions++;
+        if (stats->symbol_reductions != NULL && strncmp(message, "reduce sym:", 11) == 0) {
+            TSSymbol symbol = reduced_symbol(stats->language, message + 11);
+            if (symbol != UINT16_MAX) stats->symbol_reductions[symbol]++;
+        }
+    } else if (is_action(message, "reuse_node")) {
+        stats->reused_nodes++;
+    } else if (is_action(message, "detect_error")) {
+        stats->errors_detected++;
+    } else if (is_action(message, "recover_to_previous") || is_action(message, "recover_eof") ||
+               is_action(message, "skip_token")) {
+        stats->recoveries++;
+    }
+}
+
+TSLogger codon_parse_stats_logger(CodonParseStats *stats, const TSLanguage *language, uint64_t *symbol_reductions) {
+    memset(stats, 0, sizeof(*stats));
+    if (symbol_reductions != NULL) {
+        memset(symbol_reductions, 0, ts_language_symbol_count(language) * sizeof(uint64_t));
+        stats->symbol_reductions = symbol_reductions;
+        stats->language = language;
+    }
+    TSLogger logger;
+    logger.payload = stats;
+    logger.log = log_parse_stats;
+    return logger;
+}
@@ -0,0 +1,91 @@
+/**
+ * Parsing from a source read in chunks.
+ */
+
+#include "codon.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// The longest character in any input encoding. With fewer bytes than this
+// left in the buffer, the lexer may be looking at a split character.
+#define MAX_CHARACTER_BYTES 4
+
+bool codon_stream_init(CodonStream *stream, uint32_t chunk_size, CodonStreamRead read, void *payload) {
+    memset(stream, 0, sizeof(*stream));
+    if (chunk_size < 64) chunk_size = 64;
+    if (chunk_size > (UINT32_MAX >> 1)) chunk_size = UINT32_MAX >> 1;
+    chunk_size = (chunk_size + 7) & ~(uint32_t)7;
+    stream->data = malloc(chunk_size);
+    if (stream->data == NULL) return false;
+    stream->capacity = chunk_size;
+    stream->read = read;
+    stream->payload = payload;
+    return true;
+}
+
+void codon_stream_destroy(CodonStream *stream) {
+    free(stream->data);
+    memset(stream, 0, sizeof(*stream));
+}
+
+// Moves the buffer so that it holds `byte`, keeping what it can of the old
+// contents, and fills the rest
+static void refill(CodonStream *stream, uint32_t byte) {
+    uint32_t end = stream->start + stream->length;
+    if (byte >= stream->start && byte <= end) {
+        uint32_t back = stream->capacity / 4;
+        uint32_t keep = byte - stream->start > back ? byte - back : stream->start;
+        memmove(stream->data, stream->data + (keep - stream->start), end - keep);
+        stream->start = keep;
+        stream->length = end - keep;
+    } else {
+        stream->start = byte;
+        stream->length = 0;
+        stream->ended = false;
+    }
+
+    while (stream->length < stream->capacity && !stream->ended) {
+        uint32_t count = stream->read(
+            stream->payload, stream->start + stream->length,
+            stream->data + stream->length, stream->capacity - stream->length
+        );
+        if (count == CODON_STREAM_FAILED) {
+            stream->failed = true;
+            return;
+        }
+        if (count == 0 || count > stream->capacity - stream->length) {
+            stream->ended = true;
+        } else {
+            stream->length += count;
+        }
+    }
+}
+
+static const char *stream_read(void *payload, uint32_t byte, TSPoint position, uint32_t *bytes_read) {
+    CodonStream *stream = (CodonStream *)payload;
+    (void)position;
+    *bytes_read = 0;
+    if (stream->failed) return "";
+
+    uint32_t end = stream->start + stream->length;
+    bool held = byte >= stream->start && byte < end;
+    if (!(held && (end - byte >= MAX_CHARACTER_BYTES || stream->ended)) &&
+        !(byte >= end && byte >= stream->start && stream->ended)) {
+        refill(stream, byte);
+        if (stream->failed) return "";
+        end = stream->start + stream->length;
+    }
+    if (byte < stream->start || byte >= end) return "";
+    *bytes_read = end - byte;
+    return stream->data + (byte - stream->start);
+}
+
+TSInput codon_stream_input(CodonStream *stream, TSInputEncoding encoding) {
+    TSInput input;
+    input.payload = stream;
+    input.read = stream_read;
+    input.encoding = encoding;
+    input.decode = NULL;
+    return input;
+}
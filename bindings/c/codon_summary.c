@@ -0,0 +1,32 @@
+/**
+ * Cheap per-tree statistics.
+ */
+
+#include "codon.h"
+
+void codon_summarize(const TSTree *tree, CodonSummary *summary) {
+    TSNode root = ts_tree_root_node(tree);
+    summary->node_count = ts_node_descendant_count(root);
+    summary->error_count = 0;
+    summary->byte_length = ts_node_end_byte(root);
+    summary->has_error = ts_node_has_error(root);
+    if (!summary->has_error) return;
+
+    // Only descend into subtrees that contain an error
+    TSTreeCursor cursor = ts_tree_cursor_new(root);
+    for (;;) {
+        TSNode node = ts_tree_cursor_current_node(&cursor);
+        if (ts_node_is_error(node) || ts_node_is_missing(node)) {
+            summary->error_count++;
+        }
+        if (ts_node_has_error(node) && ts_tree_cursor_goto_first_child(&cursor)) {
+            continue;
+        }
+        while (!ts_tree_cursor_goto_next_sibling(&cursor)) {
+            if (!ts_tree_cursor_goto_parent(&cursor)) {
+                ts_tree_cursor_delete(&cursor);
+                return;
+            }
+        }
+    }
+}
@@ -0,0 +1,213 @@
+/**
+ * Definition extraction for outlines and symbol indexes.
+ *
+ * The same definitions as queries/tags.scm, found by walking statements
+ * with a tree cursor instead of running a query.
+ */
+
+#include "codon.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+const char *const codon_tag_kind_names[CODON_TAG_KIND_COUNT] = {
+    "function",
+    "class",
+    "llvm_function",
+    "python_function",
+    "c_import",
+};
+
+// Nodes whose children can be statements. Nothing else is descended into,
+// so expressions are skipped without being visited.
+static const char *const container_names[] = {
+    "module",
+    "block",
+    "decorated_definition",
+    "function_definition",
+    "class_definition",
+    "if_statement",
+    "elif_clause",
+    "else_clause",
+    "for_statement",
+    "while_statement",
+    "try_statement",
+    "except_clause",
+    "except_group_clause",
+    "finally_clause",
+    "with_statement",
+    "match_statement",
+    "case_clause",
+};
+
+typedef struct {
+    bool *containers;  // indexed by symbol
+    uint32_t symbol_count;
+    TSSymbol function_definition;
+    TSSymbol class_definition;
+    TSSymbol extern_function;
+    TSSymbol import_from_statement;
+    TSSymbol dotted_name;
+    TSSymbol c_typed_import;
+    TSSymbol aliased_import;
+    TSSymbol c_module;  // the "C" in `from C import`
+    TSSymbol llvm;
+    TSFieldId name_field;
+    TSFieldId alias_field;
+    TSFieldId module_name_field;
+    TSFieldId extern_type_field;
+} Symbols;
+
+static TSSymbol symbol(const TSLanguage *language, const char *name, bool named) {
+    return ts_language_symbol_for_name(language, name, (uint32_t)strlen(name), named);
+}
+
+static TSFieldId field(const TSLanguage *language, const char *name) {
+    return ts_language_field_id_for_name(language, name, (uint32_t)strlen(name));
+}
+
+static bool symbols_init(Symbols *symbols, const TSLanguage *language) {
+    symbols->symbol_count = ts_language_symbol_count(language);
+    symbols->containers = calloc(symbols->symbol_count, sizeof(bool));
+    if (symbols->containers == NULL) return false;
+    for (size_t i = 0; i < sizeof(container_names) / sizeof(container_names[0]); i++) {
+        TSSymbol container = symbol(language, container_names[i], true);
+        if (container != 0) symbols->containers[container] = true;
+    }
+    symbols->function_definition = symbol(language, "function_definition", true);
+    symbols->class_definition = symbol(language, "class_definition", true);
+    symbols->extern_function = symbol(language, "extern_function", true);
+    symbols->import_from_statement = symbol(language, "import_from_statement", true);
+    symbols->dotted_name = symbol(language, "dotted_name", true);
+    symbols->c_typed_import = symbol(language, "c_typed_import", true);
+    symbols->aliased_import = symbol(language, "aliased_import", true);
+    symbols->c_module = symbol(language, "C", false);
+    symbols->llvm = symbol(language, "llvm", false);
+    symbols->name_field = field(language, "name");
+    symbols->alias_field = field(language, "alias");
+    symbols->module_name_field = field(language, "module_name");
+    symbols->extern_type_field = field(language, "extern_type");
+    return true;
+}
+
+static bool is_container(const Symbols *symbols, TSNode node) {
+    TSSymbol symbol = ts_node_symbol(node);
+    return (symbol < symbols->symbol_count && symbols->containers[symbol]) || ts_node_is_error(node);
+}
+
+// Appends a tag unless `name` is missing, as it can be in broken code.
+// Returns false when out of memory.
+static bool add_tag(CodonTagList *list, CodonTagKind kind, uint32_t parent, TSNode name, TSNode node) {
+    if (ts_node_is_null(name)) return true;
+    if (list->size == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 64;
+        CodonTag *tags = realloc(list->tags, capacity * sizeof(CodonTag));
+        if (tags == NULL) return false;
+        list->tags = tags;
+        list->capacity = capacity;
+    }
+    CodonTag *tag = &list->tags[list->size++];
+    tag->kind = kind;
+    tag->parent = parent;
+    tag->name_start_byte = ts_node_start_byte(name);
+    tag->name_end_byte = ts_node_end_byte(name);
+    tag->start_byte = ts_node_start_byte(node);
+    tag->end_byte = ts_node_end_byte(node);
+    tag->start_row = ts_node_start_point(node).row;
+    tag->end_row = ts_node_end_point(node).row;
+    return true;
+}
+
+// One tag per imported name of a `from C import`. Leaves the cursor where
+// it was.
+static bool add_c_imports(const Symbols *symbols, TSTreeCursor *cursor, CodonTagList *list, uint32_t parent) {
+    bool ok = true;
+    ts_tree_cursor_goto_first_child(cursor);
+    do {
+        if (ts_tree_cursor_current_field_id(cursor) != symbols->name_field) continue;
+        TSNode item = ts_tree_cursor_current_node(cursor);
+        TSSymbol symbol = ts_node_symbol(item);
+        TSNode name = item;
+        if (symbol == symbols->c_typed_import) {
+            name = ts_node_child_by_field_id(item, symbols->name_field);
+        } else if (symbol == symbols->aliased_import) {
+            name = ts_node_child_by_field_id(item, symbols->alias_field);
+        } else if (symbol != symbols->dotted_name) {
+            continue;
+        }
+        ok = add_tag(list, CODON_TAG_C_IMPORT, parent, name, item);
+    } while (ok && ts_tree_cursor_goto_next_sibling(cursor));
+    ts_tree_cursor_goto_parent(cursor);
+    return ok;
+}
+
+bool codon_tags(const TSTree *tree, CodonTagList *list) {
+    Symbols symbols;
+    if (!symbols_init(&symbols, ts_tree_language(tree))) return false;
+
+    // Enclosing tag of each container the cursor is inside
+    uint32_t *parents = NULL;
+    uint32_t depth = 0, capacity = 0;
+    uint32_t parent = CODON_TAG_NO_PARENT;
+    bool ok = true;
+
+    TSTreeCursor cursor = ts_tree_cursor_new(ts_tree_root_node(tree));
+    bool more = ts_tree_cursor_goto_first_child(&cursor);
+    while (ok && more) {
+        TSNode node = ts_tree_cursor_current_node(&cursor);
+        TSSymbol symbol = ts_node_symbol(node);
+        uint32_t index = list->size;
+
+        if (symbol == symbols.function_definition || symbol == symbols.class_definition) {
+            CodonTagKind kind = symbol == symbols.class_definition ? CODON_TAG_CLASS : CODON_TAG_FUNCTION;
+            ok = add_tag(list, kind, parent, ts_node_child_by_field_id(node, symbols.name_field), node);
+        } else if (symbol == symbols.extern_function) {
+            TSNode extern_type = ts_node_child_by_field_id(node, symbols.extern_type_field);
+            CodonTagKind kind = ts_node_symbol(extern_type) == symbols.llvm
+                ? CODON_TAG_LLVM_FUNCTION
+                : CODON_TAG_PYTHON_FUNCTION;
+            ok = add_tag(list, kind, parent, ts_node_child_by_field_id(node, symbols.name_field), node);
+        } else if (symbol == symbols.import_from_statement) {
+            TSNode module = ts_node_child_by_field_id(node, symbols.module_name_field);
+            if (ts_node_symbol(module) == symbols.c_module) {
+                ok = add_c_imports(&symbols, &cursor, list, parent);
+            }
+        }
+        if (!ok) break;
+
+        if (is_container(&symbols, node) && ts_tree_cursor_goto_first_child(&cursor)) {
+            if (depth == capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                uint32_t *grown = realloc(parents, capacity * sizeof(uint32_t));
+                if (grown == NULL) {
+                    ok = false;
+                    break;
+                }
+                parents = grown;
+            }
+            parents[depth++] = parent;
+            // Only functions and classes parent what is nested in them
+            if (index < list->size && (symbol == symbols.function_definition || symbol == symbols.class_definition)) {
+                parent = index;
+            }
+            continue;
+        }
+
+        while (!(more = ts_tree_cursor_goto_next_sibling(&cursor)) && depth > 0) {
+            ts_tree_cursor_goto_parent(&cursor);
+            parent = parents[--depth];
+        }
+    }
+
+    ts_tree_cursor_delete(&cursor);
+    free(parents);
+    free(symbols.containers);
+    return ok;
+}
+
+void codon_tag_list_delete(CodonTagList *list) {
+    free(list->tags);
+    list->tags = NULL;
+    list->size = 0;
+    list->capacity = 0;
+}
@@ -0,0 +1,63 @@
+/**
+ * Minimal portable threads for the Codon native helpers.
+ */
+
+#ifndef TREE_SITTER_CODON_THREAD_H_
+#define TREE_SITTER_CODON_THREAD_H_
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef HANDLE CodonThread;
+typedef SRWLOCK CodonMutex;
+
+// Static initializer, for mutexes that need no codon_mutex_init call
+#define CODON_MUTEX_INITIALIZER SRWLOCK_INIT
+
+#define CODON_THREAD_RETURN DWORD WINAPI
+#define CODON_THREAD_RESULT 0
+
+typedef DWORD (WINAPI *CodonThreadFunction)(void *);
+
+static inline bool codon_thread_start(CodonThread *thread, CodonThreadFunction function, void *payload) {
+    *thread = CreateThread(NULL, 0, function, payload, 0, NULL);
+    return *thread != NULL;
+}
+
+static inline void codon_thread_join(CodonThread *thread) {
+    WaitForSingleObject(*thread, INFINITE);
+    CloseHandle(*thread);
+}
+
+static inline void codon_mutex_init(CodonMutex *mutex) { InitializeSRWLock(mutex); }
+static inline void codon_mutex_destroy(CodonMutex *mutex) { (void)mutex; }
+static inline void codon_mutex_lock(CodonMutex *mutex) { AcquireSRWLockExclusive(mutex); }
+static inline void codon_mutex_unlock(CodonMutex *mutex) { ReleaseSRWLockExclusive(mutex); }
+
+#else
+#include <pthread.h>
+
+typedef pthread_t CodonThread;
+typedef pthread_mutex_t CodonMutex;
+
+#define CODON_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+
+#define CODON_THREAD_RETURN void *
+#define CODON_THREAD_RESULT NULL
+
+typedef void *(*CodonThreadFunction)(void *);
+
+static inline bool codon_thread_start(CodonThread *thread, CodonThreadFunction function, void *payload) {
+    return pthread_create(thread, NULL, function, payload) == 0;
+}
+
+static inline void codon_thread_join(CodonThread *thread) { pthread_join(*thread, NULL); }
+
+static inline void codon_mutex_init(CodonMutex *mutex) { pthread_mutex_init(mutex, NULL); }
+static inline void codon_mutex_destroy(CodonMutex *mutex) { pthread_mutex_destroy(mutex); }
+static inline void codon_mutex_lock(CodonMutex *mutex) { pthread_mutex_lock(mutex); }
+static inline void codon_mutex_unlock(CodonMutex *mutex) { pthread_mutex_unlock(mutex); }
+
+#endif
+
+#endif  // TREE_SITTER_CODON_THREAD_H_
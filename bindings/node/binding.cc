@@ -4,13 +4,1292 @@
 
 #include <napi.h>
 
-extern "C" const void *tree_sitter_codon();
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "codon.h"
+
+/* Instance data */
+
+// State of one Node environment: the main thread and every worker thread
+// that loads the addon get their own, so nothing JavaScript-visible is
+// shared between isolates
+struct AddonData {
+    AddonData() { codon_parser_pool_init(&parsers); }
+    ~AddonData() { codon_parser_pool_destroy(&parsers); }
+
+    Napi::FunctionReference tree_constructor;
+    // Parsers reused by every parse started from this environment, both on
+    // its own thread and on the libuv pool
+    CodonParserPool parsers;
+};
+
+// A parser taken from the environment's pool for one scope
+class PooledParser {
+  public:
+    explicit PooledParser(CodonParserPool *pool) : pool(pool), parser(codon_parser_pool_acquire(pool)) {}
+    explicit PooledParser(Napi::Env env) : PooledParser(&env.GetInstanceData<AddonData>()->parsers) {}
+    ~PooledParser() { codon_parser_pool_release(pool, parser); }
+    PooledParser(const PooledParser &) = delete;
+    PooledParser &operator=(const PooledParser &) = delete;
+
+    TSParser *get() const { return parser; }
+
+  private:
+    CodonParserPool *pool;
+    TSParser *parser;
+};
+
+/* Source text */
+
+// A string argument is copied into `storage`; Buffers and typed arrays are
+// read in place, so callers that keep the text past the call copy it
+static CodonBuffer GetText(Napi::Env env, Napi::Value value, const char *name, std::string &storage) {
+    if (value.IsString()) {
+        storage = value.As<Napi::String>().Utf8Value();
+        if (storage.size() > UINT32_MAX) throw Napi::RangeError::New(env, std::string(name) + " is larger than 4 GiB");
+        return {storage.data(), static_cast<uint32_t>(storage.size())};
+    }
+    if (value.IsTypedArray()) {
+        Napi::TypedArray array = value.As<Napi::TypedArray>();
+        if (array.ByteLength() > UINT32_MAX) {
+            throw Napi::RangeError::New(env, std::string(name) + " is larger than 4 GiB");
+        }
+        const char *data = static_cast<const char *>(array.ArrayBuffer().Data()) + array.ByteOffset();
+        return {data, static_cast<uint32_t>(array.ByteLength())};
+    }
+    throw Napi::TypeError::New(env, std::string(name) + " must be a string, Buffer or typed array");
+}
+
+/* Tree */
+
+static Napi::Object SummaryObject(Napi::Env env, const CodonSummary &summary) {
+    Napi::Object result = Napi::Object::New(env);
+    result["nodeCount"] = Napi::Number::New(env, summary.node_count);
+    result["errorCount"] = Napi::Number::New(env, summary.error_count);
+    result["byteLength"] = Napi::Number::New(env, summary.byte_length);
+    result["hasError"] = Napi::Boolean::New(env, summary.has_error);
+    return result;
+}
+
+// {rows, buffer, symbol, parent, ...}: one Uint32Array per column, all
+// views of `buffer`, which holds the columns as laid out by codon_columns.
+// Transferring `buffer` moves the whole result to another thread.
+static Napi::Object ColumnsObject(Napi::Env env, Napi::ArrayBuffer buffer, uint32_t rows) {
+    static const char *const names[CODON_COLUMN_COUNT] = {
+        "symbol", "parent", "startIndex", "endIndex", "startRow", "startColumn", "endRow", "endColumn", "field",
+    };
+    Napi::Object result = Napi::Object::New(env);
+    result["rows"] = Napi::Number::New(env, rows);
+    result["buffer"] = buffer;
+    for (uint32_t c = 0; c < CODON_COLUMN_COUNT; c++) {
+        size_t offset = static_cast<size_t>(c) * rows * sizeof(uint32_t);
+        result[names[c]] = Napi::Uint32Array::New(env, rows, buffer, offset);
+    }
+    return result;
+}
+
+class Tree : public Napi::ObjectWrap<Tree> {
+  public:
+    static Napi::Function Init(Napi::Env env) {
+        Napi::Function constructor = DefineClass(env, "Tree", {
+            InstanceMethod("rootString", &Tree::RootString),
+            InstanceMethod("summary", &Tree::Summary),
+            InstanceMethod("edit", &Tree::Edit),
+            InstanceMethod("tags", &Tree::Tags),
+            InstanceMethod("columns", &Tree::Columns),
+            InstanceMethod("memory", &Tree::Memory),
+            InstanceAccessor("hasError", &Tree::HasError, nullptr),
+        });
+        env.GetInstanceData<AddonData>()->tree_constructor = Napi::Persistent(constructor);
+        return constructor;
+    }
+
+    // Takes ownership of `tree`
+    static Napi::Object New(Napi::Env env, TSTree *tree) {
+        return env.GetInstanceData<AddonData>()->tree_constructor.New({Napi::External<TSTree>::New(env, tree)});
+    }
+
+    // The wrapped tree, or nullptr when `value` is not a Tree of this
+    // environment
+    static TSTree *Get(Napi::Value value) {
+        Napi::FunctionReference &constructor = value.Env().GetInstanceData<AddonData>()->tree_constructor;
+        if (!value.IsObject() || !value.As<Napi::Object>().InstanceOf(constructor.Value())) {
+            return nullptr;
+        }
+        return Unwrap(value.As<Napi::Object>())->tree;
+    }
+
+    explicit Tree(const Napi::CallbackInfo &info) : Napi::ObjectWrap<Tree>(info) {
+        if (info.Length() != 1 || !info[0].IsExternal()) {
+            throw Napi::TypeError::New(info.Env(), "Tree objects are created by parseAsync");
+        }
+        tree = info[0].As<Napi::External<TSTree>>().Data();
+    }
+
+    ~Tree() { ts_tree_delete(tree); }
+
+  private:
+    Napi::Value RootString(const Napi::CallbackInfo &info) {
+        char *string = ts_node_string(ts_tree_root_node(tree));
+        Napi::String result = Napi::String::New(info.Env(), string);
+        free(string);
+        return result;
+    }
+
+    Napi::Value Summary(const Napi::CallbackInfo &info) {
+        CodonSummary summary;
+        codon_summarize(tree, &summary);
+        return SummaryObject(info.Env(), summary);
+    }
+
+    // Definitions as a Uint32Array of packed CodonTag records, laid out as
+    // described by the tagFields export
+    Napi::Value Tags(const Napi::CallbackInfo &info) {
+        CodonTagList list = {nullptr, 0, 0};
+        if (!codon_tags(tree, &list)) {
+            codon_tag_list_delete(&list);
+            throw Napi::Error::New(info.Env(), "out of memory");
+        }
+        size_t length = static_cast<size_t>(list.size) * CODON_TAG_FIELD_COUNT;
+        Napi::ArrayBuffer buffer = Napi::ArrayBuffer::New(info.Env(), length * sizeof(uint32_t));
+        if (length > 0) memcpy(buffer.Data(), list.tags, length * sizeof(uint32_t));
+        codon_tag_list_delete(&list);
+        return Napi::Uint32Array::New(info.Env(), length, buffer, 0);
+    }
+
+    // columns(namedOnly?) returns one Uint32Array per column, all views of a
+    // single ArrayBuffer written by one cursor walk
+    Napi::Value Columns(const Napi::CallbackInfo &info) {
+        bool named_only = info.Length() > 0 && info[0].ToBoolean();
+        uint32_t capacity = codon_columns_capacity(tree);
+        Napi::ArrayBuffer buffer = Napi::ArrayBuffer::New(
+            info.Env(), static_cast<size_t>(capacity) * CODON_COLUMN_COUNT * sizeof(uint32_t)
+        );
+        uint32_t rows = codon_columns(tree, named_only, capacity, static_cast<uint32_t *>(buffer.Data()));
+        if (rows == UINT32_MAX) {
+            throw Napi::Error::New(info.Env(), "out of memory");
+        }
+        return ColumnsObject(info.Env(), buffer, rows);
+    }
+
+    Napi::Value HasError(const Napi::CallbackInfo &info) {
+        return Napi::Boolean::New(info.Env(), ts_node_has_error(ts_tree_root_node(tree)));
+    }
+
+    // memory() estimates the bytes the tree holds; see codon_tree_memory
+    Napi::Value Memory(const Napi::CallbackInfo &info) {
+        Napi::Env env = info.Env();
+        CodonTreeMemory memory;
+        codon_tree_memory(tree, &memory);
+        auto count = [env](uint64_t value) { return Napi::Number::New(env, static_cast<double>(value)); };
+        Napi::Object result = Napi::Object::New(env);
+        result["heapSubtrees"] = count(memory.heap_subtrees);
+        result["inlineSubtrees"] = count(memory.inline_subtrees);
+        result["subtreeBytes"] = count(memory.subtree_bytes);
+        result["scannerStateBytes"] = count(memory.scanner_state_bytes);
+        result["totalBytes"] = count(memory.total_bytes);
+        return result;
+    }
+
+    // Same shape as the edits accepted by node-tree-sitter's Tree#edit
+    void Edit(const Napi::CallbackInfo &info) {
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(info.Env(), "edit must be an object");
+        }
+        Napi::Object edit = info[0].As<Napi::Object>();
+        TSInputEdit input_edit;
+        input_edit.start_byte = GetIndex(edit, "startIndex");
+        input_edit.old_end_byte = GetIndex(edit, "oldEndIndex");
+        input_edit.new_end_byte = GetIndex(edit, "newEndIndex");
+        input_edit.start_point = GetPoint(edit, "startPosition");
+        input_edit.old_end_point = GetPoint(edit, "oldEndPosition");
+        input_edit.new_end_point = GetPoint(edit, "newEndPosition");
+        ts_tree_edit(tree, &input_edit);
+    }
+
+    static uint32_t GetIndex(Napi::Object object, const char *key) {
+        Napi::Value value = object.Get(key);
+        if (!value.IsNumber()) {
+            throw Napi::TypeError::New(object.Env(), std::string(key) + " must be a number");
+        }
+        return value.As<Napi::Number>().Uint32Value();
+    }
+
+    static TSPoint GetPoint(Napi::Object object, const char *key) {
+        Napi::Value value = object.Get(key);
+        if (!value.IsObject()) {
+            throw Napi::TypeError::New(object.Env(), std::string(key) + " must be a {row, column} object");
+        }
+        Napi::Object point = value.As<Napi::Object>();
+        return {GetIndex(point, "row"), GetIndex(point, "column")};
+    }
+
+    TSTree *tree = nullptr;
+};
+
+/* Asynchronous parsing */
+
+using CancelFlag = std::shared_ptr<std::atomic_bool>;
+
+class ParseWorker : public Napi::AsyncWorker {
+  public:
+    ParseWorker(Napi::Env env, std::string source, TSTree *old_tree, CancelFlag cancelled)
+        : Napi::AsyncWorker(env, "tree-sitter-codon:parseAsync"),
+          deferred(Napi::Promise::Deferred::New(env)),
+          text(std::move(source)),
+          old_tree(old_tree ? ts_tree_copy(old_tree) : nullptr),
+          cancelled(std::move(cancelled)),
+          // Node waits for queued work before tearing an environment down,
+          // so the pool outlives Execute
+          parsers(&env.GetInstanceData<AddonData>()->parsers) {
+        buffer.data = text.data();
+        buffer.length = static_cast<uint32_t>(text.size());
+    }
+
+    ~ParseWorker() {
+        ts_tree_delete(tree);
+        ts_tree_delete(old_tree);
+    }
+
+    Napi::Promise Promise() { return deferred.Promise(); }
+
+  protected:
+    void Execute() override {
+        if (!cancelled->load(std::memory_order_relaxed)) {
+            TSParseOptions options = {};
+            options.payload = cancelled.get();
+            options.progress_callback = [](TSParseState *state) {
+                return static_cast<std::atomic_bool *>(state->payload)->load(std::memory_order_relaxed);
+            };
+            PooledParser parser(parsers);
+            tree = ts_parser_parse_with_options(parser.get(), old_tree, codon_buffer_input(&buffer), options);
+            if (tree != nullptr) return;
+            // Drop the half-finished parse so the next request starts clean
+            ts_parser_reset(parser.get());
+        }
+        SetError("parse was cancelled");
+    }
+
+    void OnOK() override {
+        TSTree *result = tree;
+        tree = nullptr;
+        deferred.Resolve(Tree::New(Env(), result));
+    }
+
+    void OnError(const Napi::Error &error) override {
+        Napi::Object value = error.Value();
+        value["name"] = "AbortError";
+        deferred.Reject(value);
+    }
+
+  private:
+    Napi::Promise::Deferred deferred;
+    std::string text;
+    CodonBuffer buffer;
+    TSTree *old_tree;
+    TSTree *tree = nullptr;
+    CancelFlag cancelled;
+    CodonParserPool *parsers;
+};
+
+// parseAsync(source, oldTree?) parses on the libuv thread pool and returns a
+// Promise for a Tree. The promise has a cancel() method that makes the parse
+// stop and reject with an AbortError.
+static Napi::Value ParseAsync(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    // V8 strings cannot be read off the main thread, and the backing store
+    // of a typed array can be detached or written while the parse runs, so
+    // the worker always gets a copy
+    std::string text;
+    CodonBuffer source = GetText(env, info[0], "source", text);
+    if (source.data != text.data()) text.assign(source.data, source.length);
+
+    TSTree *old_tree = nullptr;
+    if (info.Length() > 1 && !info[1].IsUndefined() && !info[1].IsNull()) {
+        old_tree = Tree::Get(info[1]);
+        if (old_tree == nullptr) {
+            throw Napi::TypeError::New(env, "oldTree must be a Tree returned by parseAsync");
+        }
+    }
+
+    CancelFlag cancelled = std::make_shared<std::atomic_bool>(false);
+    auto *worker = new ParseWorker(env, std::move(text), old_tree, cancelled);
+    Napi::Promise promise = worker->Promise();
+    promise["cancel"] = Napi::Function::New(env, [cancelled](const Napi::CallbackInfo &) {
+        cancelled->store(true, std::memory_order_relaxed);
+    }, "cancel");
+    worker->Queue();
+    return promise;
+}
+
+/* Parse statistics */
+
+static Napi::Object ParseStatsObject(Napi::Env env, const CodonParseStats &stats) {
+    auto count = [env](uint64_t value) { return Napi::Number::New(env, static_cast<double>(value)); };
+    Napi::Object result = Napi::Object::New(env);
+    result["steps"] = count(stats.steps);
+    result["forkedSteps"] = count(stats.forked_steps);
+    result["forks"] = count(stats.forks);
+    result["maxVersions"] = count(stats.max_versions);
+    result["lexCalls"] = count(stats.lex_calls);
+    result["externalLexCalls"] = count(stats.external_lex_calls);
+    result["shifts"] = count(stats.shifts);
+    result["reductions"] = count(stats.reductions);
+    result["reusedNodes"] = count(stats.reused_nodes);
+    result["errorsDetected"] = count(stats.errors_detected);
+    result["recoveries"] = count(stats.recoveries);
+
+    // Keyed by node type name; aliased symbols share a name, so their
+    // counts are summed
+    Napi::Object by_symbol = Napi::Object::New(env);
+    uint32_t symbol_count = ts_language_symbol_count(stats.language);
+    for (uint32_t i = 0; i < symbol_count; i++) {
+        if (stats.symbol_reductions[i] == 0) continue;
+        const char *name = ts_language_symbol_name(stats.language, static_cast<TSSymbol>(i));
+        double previous = by_symbol.Has(name) ? by_symbol.Get(name).As<Napi::Number>().DoubleValue() : 0;
+        by_symbol[name] = Napi::Number::New(env, previous + static_cast<double>(stats.symbol_reductions[i]));
+    }
+    result["reductionsBySymbol"] = by_symbol;
+    return result;
+}
+
+// parseWithStats(source, oldTree?) parses on the calling thread under the
+// stats logger and returns {tree, stats}. Logging makes the parse several
+// times slower, so this is for finding out why a file is slow.
+static Napi::Value ParseWithStats(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    std::string storage;
+    CodonBuffer source = GetText(env, info[0], "source", storage);
+
+    TSTree *old_tree = nullptr;
+    if (info.Length() > 1 && !info[1].IsUndefined() && !info[1].IsNull()) {
+        old_tree = Tree::Get(info[1]);
+        if (old_tree == nullptr) {
+            throw Napi::TypeError::New(env, "oldTree must be a Tree returned by parseAsync");
+        }
+    }
+
+    const TSLanguage *language = tree_sitter_codon();
+    std::vector<uint64_t> symbol_reductions(ts_language_symbol_count(language));
+    CodonParseStats stats;
+    TSTree *tree;
+    {
+        PooledParser parser(env);
+        ts_parser_set_logger(parser.get(), codon_parse_stats_logger(&stats, language, symbol_reductions.data()));
+        tree = ts_parser_parse_string(parser.get(), old_tree, source.data, source.length);
+        ts_parser_set_logger(parser.get(), {nullptr, nullptr});
+    }
+    if (tree == nullptr) throw Napi::Error::New(env, "parsing failed");
+
+    Napi::Object result = Napi::Object::New(env);
+    result["tree"] = Tree::New(env, tree);
+    result["stats"] = ParseStatsObject(env, stats);
+    return result;
+}
+
+/* Streamed parsing */
+
+// "utf8" (the default), "utf16le" or "utf16be", with or without a dash
+static TSInputEncoding GetEncoding(Napi::Value value) {
+    if (value.IsUndefined()) return TSInputEncodingUTF8;
+    std::string name = value.IsString() ? value.As<Napi::String>().Utf8Value() : "";
+    if (name == "utf8" || name == "utf-8") return TSInputEncodingUTF8;
+    if (name == "utf16le" || name == "utf-16le") return TSInputEncodingUTF16LE;
+    if (name == "utf16be" || name == "utf-16be") return TSInputEncodingUTF16BE;
+    throw Napi::TypeError::New(value.Env(), "encoding must be utf8, utf16le or utf16be");
+}
+
+static uint32_t GetChunkSize(Napi::Value value) {
+    if (value.IsUndefined()) return 1 << 18;
+    if (!value.IsNumber() || !(value.As<Napi::Number>().DoubleValue() > 0)) {
+        throw Napi::TypeError::New(value.Env(), "chunkSize must be a positive number");
+    }
+    double size = value.As<Napi::Number>().DoubleValue();
+    return size < UINT32_MAX ? static_cast<uint32_t>(size) : UINT32_MAX;
+}
+
+// Appends the bytes of a chunk: a Buffer or typed array as is, a string
+// encoded as `encoding`
+static void AppendChunk(Napi::Value chunk, TSInputEncoding encoding, std::string &bytes) {
+    if (chunk.IsTypedArray()) {
+        Napi::TypedArray array = chunk.As<Napi::TypedArray>();
+        bytes.append(static_cast<const char *>(array.ArrayBuffer().Data()) + array.ByteOffset(), array.ByteLength());
+    } else if (chunk.IsString() && encoding == TSInputEncodingUTF8) {
+        bytes += chunk.As<Napi::String>().Utf8Value();
+    } else if (chunk.IsString()) {
+        bool little_endian = encoding == TSInputEncodingUTF16LE;
+        for (char16_t unit : chunk.As<Napi::String>().Utf16Value()) {
+            char low = static_cast<char>(unit & 0xff), high = static_cast<char>(unit >> 8);
+            bytes += little_endian ? low : high;
+            bytes += little_endian ? high : low;
+        }
+    } else {
+        throw Napi::TypeError::New(chunk.Env(), "chunks must be strings, Buffers or typed arrays");
+    }
+}
+
+// Calls provider(index, size) on the main thread for each chunk
+struct ProviderReader {
+    Napi::Function provider;
+    TSInputEncoding encoding;
+    std::string chunk;
+    Napi::ObjectReference error;
+
+    static uint32_t Read(void *payload, uint32_t offset, char *buffer, uint32_t capacity) {
+        auto *reader = static_cast<ProviderReader *>(payload);
+        Napi::Env env = reader->provider.Env();
+        // Exceptions must not unwind through the parser
+        try {
+            Napi::Value value = reader->provider.Call({Napi::Number::New(env, offset), Napi::Number::New(env, capacity)});
+            if (value.IsUndefined() || value.IsNull()) return 0;
+            reader->chunk.clear();
+            AppendChunk(value, reader->encoding, reader->chunk);
+        } catch (const Napi::Error &error) {
+            reader->error = Napi::Persistent(error.Value());
+            return CODON_STREAM_FAILED;
+        }
+        uint32_t count = reader->chunk.size() < capacity ? static_cast<uint32_t>(reader->chunk.size()) : capacity;
+        std::memcpy(buffer, reader->chunk.data(), count);
+        return count;
+    }
+};
+
+// parseStream(provider, encoding?, chunkSize?) parses on the calling thread,
+// reading provider(index, size) into one reusable buffer
+static Napi::Value ParseStream(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsFunction()) {
+        throw Napi::TypeError::New(env, "provider must be a function");
+    }
+    ProviderReader reader{info[0].As<Napi::Function>(), GetEncoding(info[1]), {}, {}};
+    CodonStream stream;
+    if (!codon_stream_init(&stream, GetChunkSize(info[2]), ProviderReader::Read, &reader)) {
+        throw Napi::Error::New(env, "out of memory");
+    }
+    TSTree *tree = ts_parser_parse(PooledParser(env).get(), nullptr, codon_stream_input(&stream, reader.encoding));
+    bool failed = stream.failed;
+    codon_stream_destroy(&stream);
+    if (failed) {
+        ts_tree_delete(tree);
+        throw Napi::Error(env, reader.error.Value());
+    }
+    if (tree == nullptr) throw Napi::Error::New(env, "parsing failed");
+    return Tree::New(env, tree);
+}
+
+// Chunks fed from the main thread to a parse on the thread pool
+struct StreamQueue {
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<std::string> chunks;
+    size_t consumed = 0;     // bytes of chunks.front() already read
+    uint32_t delivered = 0;  // bytes read so far
+    bool requested = false;  // want() has been called and not yet answered
+    bool ended = false;
+    bool aborted = false;
+};
+
+// Parses on the libuv thread pool, asking the main thread for each chunk
+// with want() and blocking until feed() answers, so at most one chunk of
+// the stream is queued at a time
+class StreamWorker : public Napi::AsyncWorker {
+  public:
+    StreamWorker(Napi::Env env, Napi::Function want, TSInputEncoding encoding, uint32_t chunk_size,
+                 std::shared_ptr<StreamQueue> queue)
+        : Napi::AsyncWorker(env),
+          deferred(Napi::Promise::Deferred::New(env)),
+          encoding(encoding),
+          chunk_size(chunk_size),
+          queue(queue),
+          parsers(&env.GetInstanceData<AddonData>()->parsers) {
+        // Torn down environments never feed again, so give up the parse
+        this->want = Napi::ThreadSafeFunction::New(env, want, "parseReadable", 0, 1, [queue](Napi::Env) {
+            std::lock_guard<std::mutex> guard(queue->lock);
+            queue->aborted = true;
+            queue->ready.notify_one();
+        });
+    }
+
+    ~StreamWorker() { ts_tree_delete(tree); }
+
+    Napi::Promise Promise() { return deferred.Promise(); }
+
+  protected:
+    void Execute() override {
+        CodonStream stream;
+        if (codon_stream_init(&stream, chunk_size, Read, this)) {
+            {
+                PooledParser parser(parsers);
+                tree = ts_parser_parse(parser.get(), nullptr, codon_stream_input(&stream, encoding));
+            }
+            if (stream.failed) {
+                ts_tree_delete(tree);
+                tree = nullptr;
+            } else if (tree == nullptr) {
+                message = "parsing failed";
+            }
+            codon_stream_destroy(&stream);
+        } else {
+            message = "out of memory";
+        }
+        want.Release();
+        if (tree == nullptr) SetError(message);
+    }
+
+    void OnOK() override {
+        TSTree *result = tree;
+        tree = nullptr;
+        deferred.Resolve(Tree::New(Env(), result));
+    }
+
+    void OnError(const Napi::Error &error) override {
+        Napi::Object value = error.Value();
+        if (aborted) value["name"] = "AbortError";
+        deferred.Reject(value);
+    }
+
+  private:
+    static uint32_t Read(void *payload, uint32_t offset, char *buffer, uint32_t capacity) {
+        auto *worker = static_cast<StreamWorker *>(payload);
+        StreamQueue &queue = *worker->queue;
+        std::unique_lock<std::mutex> lock(queue.lock);
+        if (offset != queue.delivered) {
+            worker->message = "the parser stepped back past the buffered chunk of the stream; use a larger chunkSize";
+            return CODON_STREAM_FAILED;
+        }
+        while (queue.chunks.empty() && !queue.ended && !queue.aborted) {
+            if (!queue.requested) {
+                queue.requested = true;
+                worker->want.NonBlockingCall();
+            }
+            queue.ready.wait(lock);
+        }
+        if (queue.aborted) {
+            worker->aborted = true;
+            worker->message = "parse was cancelled";
+            return CODON_STREAM_FAILED;
+        }
+        if (queue.chunks.empty()) return 0;
+
+        const std::string &chunk = queue.chunks.front();
+        size_t left = chunk.size() - queue.consumed;
+        uint32_t count = left < capacity ? static_cast<uint32_t>(left) : capacity;
+        std::memcpy(buffer, chunk.data() + queue.consumed, count);
+        queue.consumed += count;
+        if (queue.consumed == chunk.size()) {
+            queue.chunks.pop_front();
+            queue.consumed = 0;
+        }
+        queue.delivered += count;
+        return count;
+    }
+
+    Napi::Promise::Deferred deferred;
+    Napi::ThreadSafeFunction want;
+    TSInputEncoding encoding;
+    uint32_t chunk_size;
+    std::shared_ptr<StreamQueue> queue;
+    CodonParserPool *parsers;
+    TSTree *tree = nullptr;
+    std::string message;
+    bool aborted = false;
+};
+
+// parseReadable(want, encoding?, chunkSize?) starts a parse on the thread
+// pool and returns {promise, feed, abort}. want() asks for a chunk; answer
+// with feed(chunk), or feed(null) at the end. abort() rejects the promise
+// with an AbortError.
+static Napi::Value ParseReadable(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsFunction()) {
+        throw Napi::TypeError::New(env, "want must be a function");
+    }
+    TSInputEncoding encoding = GetEncoding(info[1]);
+    uint32_t chunk_size = GetChunkSize(info[2]);
+
+    auto queue = std::make_shared<StreamQueue>();
+    auto *worker = new StreamWorker(env, info[0].As<Napi::Function>(), encoding, chunk_size, queue);
+    Napi::Object result = Napi::Object::New(env);
+    result["promise"] = worker->Promise();
+    result["feed"] = Napi::Function::New(env, [queue, encoding](const Napi::CallbackInfo &info) {
+        std::string bytes;
+        bool end = info.Length() < 1 || info[0].IsUndefined() || info[0].IsNull();
+        if (!end) AppendChunk(info[0], encoding, bytes);
+        std::lock_guard<std::mutex> guard(queue->lock);
+        if (end) {
+            queue->ended = true;
+        } else if (!bytes.empty()) {
+            queue->chunks.push_back(std::move(bytes));
+        }
+        queue->requested = false;
+        queue->ready.notify_one();
+    }, "feed");
+    result["abort"] = Napi::Function::New(env, [queue](const Napi::CallbackInfo &) {
+        std::lock_guard<std::mutex> guard(queue->lock);
+        queue->aborted = true;
+        queue->ready.notify_one();
+    }, "abort");
+    worker->Queue();
+    return result;
+}
+
+/* Parse jobs */
+
+// new ParseJob(source, oldTree?) parses one source in slices on the main
+// thread: run(budgetMs) parses for about that long and returns whether the
+// tree is done, so a UI can yield between slices with setImmediate.
+class ParseJob : public Napi::ObjectWrap<ParseJob> {
+  public:
+    static Napi::Function Init(Napi::Env env) {
+        return DefineClass(env, "ParseJob", {
+            InstanceMethod("run", &ParseJob::Run),
+            InstanceMethod("partial", &ParseJob::Partial),
+            InstanceAccessor("tree", &ParseJob::GetTree, nullptr),
+            InstanceAccessor("done", &ParseJob::Done, nullptr),
+            InstanceAccessor("hasError", &ParseJob::HasError, nullptr),
+            InstanceAccessor("offset", &ParseJob::Offset, nullptr),
+            InstanceAccessor("length", &ParseJob::Length, nullptr),
+        });
+    }
+
+    explicit ParseJob(const Napi::CallbackInfo &info) : Napi::ObjectWrap<ParseJob>(info) {
+        Napi::Env env = info.Env();
+        // Copied, since JavaScript runs between slices and may detach or
+        // overwrite the array's backing store
+        CodonBuffer source = GetText(env, info[0], "source", text);
+        if (source.data != text.data()) text.assign(source.data, source.length);
+
+        TSTree *old_tree = nullptr;
+        if (info.Length() > 1 && !info[1].IsUndefined() && !info[1].IsNull()) {
+            old_tree = Tree::Get(info[1]);
+            if (old_tree == nullptr) {
+                throw Napi::TypeError::New(env, "oldTree must be a Tree returned by parseAsync");
+            }
+        }
+        // A job can be collected after the environment's pool is gone, so
+        // it keeps its own
+        codon_parser_pool_init(&parsers);
+        codon_parse_job_init(&job, &parsers, text.data(), static_cast<uint32_t>(text.size()), old_tree);
+    }
+
+    ~ParseJob() {
+        codon_parse_job_destroy(&job);
+        codon_parser_pool_destroy(&parsers);
+    }
+
+  private:
+    Napi::Value Run(const Napi::CallbackInfo &info) {
+        double seconds = -1;
+        if (info.Length() > 0 && !info[0].IsUndefined()) {
+            if (!info[0].IsNumber() || !(info[0].As<Napi::Number>().DoubleValue() >= 0)) {
+                throw Napi::TypeError::New(info.Env(), "budgetMs must be a non-negative number");
+            }
+            seconds = info[0].As<Napi::Number>().DoubleValue() / 1000;
+        }
+        return Napi::Boolean::New(info.Env(), codon_parse_job_run(&job, seconds));
+    }
+
+    // partial(maxBytes?) parses the statements before `offset`, or before
+    // maxBytes if that is lower, and returns their Tree. It reparses the
+    // prefix from scratch, so call it once for an early view.
+    Napi::Value Partial(const Napi::CallbackInfo &info) {
+        uint32_t max_bytes = UINT32_MAX;
+        if (info.Length() > 0 && !info[0].IsUndefined()) {
+            if (!info[0].IsNumber() || !(info[0].As<Napi::Number>().DoubleValue() >= 0)) {
+                throw Napi::TypeError::New(info.Env(), "maxBytes must be a non-negative number");
+            }
+            double value = info[0].As<Napi::Number>().DoubleValue();
+            if (value < UINT32_MAX) max_bytes = static_cast<uint32_t>(value);
+        }
+        TSTree *tree = codon_parse_job_partial(&job, max_bytes);
+        if (tree == nullptr) throw Napi::Error::New(info.Env(), "parsing failed");
+        return Tree::New(info.Env(), tree);
+    }
+
+    Napi::Value GetTree(const Napi::CallbackInfo &info) {
+        if (job.tree == nullptr) return info.Env().Null();
+        return Tree::New(info.Env(), ts_tree_copy(job.tree));
+    }
+
+    Napi::Value Done(const Napi::CallbackInfo &info) {
+        return Napi::Boolean::New(info.Env(), job.tree != nullptr);
+    }
+
+    Napi::Value HasError(const Napi::CallbackInfo &info) {
+        return Napi::Boolean::New(info.Env(), job.has_error);
+    }
+
+    Napi::Value Offset(const Napi::CallbackInfo &info) {
+        return Napi::Number::New(info.Env(), job.offset);
+    }
+
+    Napi::Value Length(const Napi::CallbackInfo &info) {
+        return Napi::Number::New(info.Env(), job.buffer.length);
+    }
+
+    std::string text;
+    CodonParserPool parsers;
+    CodonParseJob job;
+};
+
+/* Edit sessions */
+
+// A document kept as a piece table that is reparsed incrementally after
+// every edit. Offsets are UTF-8 byte offsets.
+class EditSession : public Napi::ObjectWrap<EditSession> {
+  public:
+    static Napi::Function Init(Napi::Env env) {
+        return DefineClass(env, "EditSession", {
+            InstanceMethod("edit", &EditSession::Edit),
+            InstanceMethod("text", &EditSession::Text),
+            InstanceAccessor("tree", &EditSession::GetTree, nullptr),
+            InstanceAccessor("length", &EditSession::Length, nullptr),
+        });
+    }
+
+    explicit EditSession(const Napi::CallbackInfo &info) : Napi::ObjectWrap<EditSession>(info) {
+        std::string text;
+        CodonBuffer source = GetText(info.Env(), info[0], "source", text);
+        if (!codon_edit_session_init(&session, source.data, source.length)) {
+            throw Napi::Error::New(info.Env(), "out of memory");
+        }
+        TSRange *ranges = nullptr;
+        uint32_t count = 0;
+        if (!codon_edit_session_parse(&session, PooledParser(info.Env()).get(), &ranges, &count)) {
+            // The destructor does not run for a constructor that throws
+            codon_edit_session_destroy(&session);
+            throw Napi::Error::New(info.Env(), "parsing failed");
+        }
+        free(ranges);
+    }
+
+    ~EditSession() { codon_edit_session_destroy(&session); }
+
+  private:
+    // edit(start, oldEnd, newText) replaces the bytes [start, oldEnd),
+    // reparses and returns the changed ranges
+    Napi::Value Edit(const Napi::CallbackInfo &info) {
+        Napi::Env env = info.Env();
+        if (info.Length() < 3 || !info[0].IsNumber() || !info[1].IsNumber()) {
+            throw Napi::TypeError::New(env, "edit(start, oldEnd, newText) needs two offsets and a text");
+        }
+        double start = info[0].As<Napi::Number>().DoubleValue();
+        double old_end = info[1].As<Napi::Number>().DoubleValue();
+        if (!(start >= 0 && start <= old_end && old_end <= session.length)) {
+            throw Napi::RangeError::New(env, "edit range is outside the document");
+        }
+        std::string storage;
+        CodonBuffer text = GetText(env, info[2], "newText", storage);
+
+        TSInputEdit edit;
+        if (!codon_edit_session_edit(&session, static_cast<uint32_t>(start), static_cast<uint32_t>(old_end),
+                                     text.data, text.length, &edit)) {
+            throw Napi::Error::New(env, "out of memory");
+        }
+        TSRange *ranges = nullptr;
+        uint32_t count = 0;
+        if (!codon_edit_session_parse(&session, PooledParser(env).get(), &ranges, &count)) {
+            throw Napi::Error::New(env, "parsing failed");
+        }
+        Napi::Array result = Napi::Array::New(env, count);
+        for (uint32_t i = 0; i < count; i++) {
+            Napi::Object range = Napi::Object::New(env);
+            range["startIndex"] = Napi::Number::New(env, ranges[i].start_byte);
+            range["endIndex"] = Napi::Number::New(env, ranges[i].end_byte);
+            range["startPosition"] = Point(env, ranges[i].start_point);
+            range["endPosition"] = Point(env, ranges[i].end_point);
+            result[i] = range;
+        }
+        free(ranges);
+        return result;
+    }
+
+    static Napi::Object Point(Napi::Env env, TSPoint point) {
+        Napi::Object result = Napi::Object::New(env);
+        result["row"] = Napi::Number::New(env, point.row);
+        result["column"] = Napi::Number::New(env, point.column);
+        return result;
+    }
+
+    Napi::Value Text(const Napi::CallbackInfo &info) {
+        std::string text(session.length, '\0');
+        codon_edit_session_read(&session, 0, session.length, &text[0]);
+        return Napi::String::New(info.Env(), text);
+    }
+
+    Napi::Value GetTree(const Napi::CallbackInfo &info) {
+        return Tree::New(info.Env(), ts_tree_copy(session.tree));
+    }
+
+    Napi::Value Length(const Napi::CallbackInfo &info) {
+        return Napi::Number::New(info.Env(), session.length);
+    }
+
+    CodonEditSession session;
+};
+
+/* Injections */
+
+// A byte budget: a non-negative number, where 0 means no budget
+static uint64_t GetBudget(Napi::Value value) {
+    if (!value.IsNumber() || !(value.As<Napi::Number>().DoubleValue() >= 0)) {
+        throw Napi::TypeError::New(value.Env(), "budget must be a non-negative number");
+    }
+    return static_cast<uint64_t>(value.As<Napi::Number>().DoubleValue());
+}
+
+// Trees of embedded regions parsed with another grammar on request, cached
+// by the region's text
+class InjectionCache : public Napi::ObjectWrap<InjectionCache> {
+  public:
+    static Napi::Function Init(Napi::Env env) {
+        return DefineClass(env, "InjectionCache", {
+            InstanceMethod("parse", &InjectionCache::Parse),
+            InstanceAccessor("hits", &InjectionCache::Hits, nullptr),
+            InstanceAccessor("misses", &InjectionCache::Misses, nullptr),
+            InstanceAccessor("bytes", &InjectionCache::Bytes, nullptr),
+        });
+    }
+
+    // new InjectionCache(capacity?, budget?) keeps at most `capacity` trees
+    // and, when a byte budget is given, at most that many bytes of them
+    explicit InjectionCache(const Napi::CallbackInfo &info) : Napi::ObjectWrap<InjectionCache>(info) {
+        uint32_t capacity = 64;
+        if (info.Length() > 0 && !info[0].IsUndefined()) {
+            if (!info[0].IsNumber()) throw Napi::TypeError::New(info.Env(), "capacity must be a number");
+            capacity = info[0].As<Napi::Number>().Uint32Value();
+        }
+        uint64_t budget = info.Length() > 1 && !info[1].IsUndefined() ? GetBudget(info[1]) : 0;
+        if (!codon_injection_cache_init(&cache, capacity, budget)) {
+            throw Napi::Error::New(info.Env(), "out of memory");
+        }
+    }
+
+    ~InjectionCache() { codon_injection_cache_destroy(&cache); }
+
+  private:
+    // A grammar module (as passed to Parser#setLanguage) or its language
+    static const TSLanguage *GetLanguage(Napi::Value value) {
+        if (value.IsObject() && !value.IsExternal()) value = value.As<Napi::Object>().Get("language");
+        if (!value.IsExternal()) {
+            throw Napi::TypeError::New(value.Env(), "language must be a tree-sitter grammar");
+        }
+        return static_cast<const TSLanguage *>(value.As<Napi::External<void>>().Data());
+    }
+
+    // parse(language, source, startIndex, endIndex) returns a Tree for the
+    // region, with offsets relative to startIndex
+    Napi::Value Parse(const Napi::CallbackInfo &info) {
+        Napi::Env env = info.Env();
+        if (info.Length() < 4 || !info[2].IsNumber() || !info[3].IsNumber()) {
+            throw Napi::TypeError::New(env, "parse(language, source, startIndex, endIndex)");
+        }
+        const TSLanguage *language = GetLanguage(info[0]);
+        std::string storage;
+        CodonBuffer source = GetText(env, info[1], "source", storage);
+        double start = info[2].As<Napi::Number>().DoubleValue();
+        double end = info[3].As<Napi::Number>().DoubleValue();
+        if (!(start >= 0 && start <= end && end <= source.length)) {
+            throw Napi::RangeError::New(env, "region is outside the source");
+        }
+
+        const TSTree *tree = codon_injection_parse(
+            &cache, language, source.data, static_cast<uint32_t>(start), static_cast<uint32_t>(end)
+        );
+        if (tree == nullptr) {
+            throw Napi::Error::New(env, "could not parse the region with this language");
+        }
+        return Tree::New(env, ts_tree_copy(tree));
+    }
+
+    Napi::Value Hits(const Napi::CallbackInfo &info) {
+        return Napi::Number::New(info.Env(), static_cast<double>(cache.hits));
+    }
+
+    Napi::Value Misses(const Napi::CallbackInfo &info) {
+        return Napi::Number::New(info.Env(), static_cast<double>(cache.misses));
+    }
+
+    Napi::Value Bytes(const Napi::CallbackInfo &info) {
+        return Napi::Number::New(info.Env(), static_cast<double>(cache.bytes));
+    }
+
+    CodonInjectionCache cache;
+};
+
+/* Tree cache */
+
+// Trees by key under a memory budget. Adding a tree past the budget evicts
+// the least recently used ones; with a loader, get() reparses them.
+class TreeCache : public Napi::ObjectWrap<TreeCache> {
+  public:
+    static Napi::Function Init(Napi::Env env) {
+        return DefineClass(env, "TreeCache", {
+            InstanceMethod("get", &TreeCache::Get),
+            InstanceMethod("set", &TreeCache::Set),
+            InstanceMethod("delete", &TreeCache::Delete),
+            InstanceAccessor("budget", &TreeCache::Budget, &TreeCache::SetBudget),
+            InstanceAccessor("bytes", &TreeCache::Bytes, nullptr),
+            InstanceAccessor("size", &TreeCache::Size, nullptr),
+            InstanceAccessor("hits", &TreeCache::Hits, nullptr),
+            InstanceAccessor("misses", &TreeCache::Misses, nullptr),
+            InstanceAccessor("evictions", &TreeCache::Evictions, nullptr),
+        });
+    }
+
+    // new TreeCache(budget, loader?): loader(key) returns the source of a
+    // missing tree, or undefined
+    explicit TreeCache(const Napi::CallbackInfo &info) : Napi::ObjectWrap<TreeCache>(info) {
+        if (info.Length() < 1) throw Napi::TypeError::New(info.Env(), "new TreeCache(budget, loader?)");
+        uint64_t budget = GetBudget(info[0]);
+        if (info.Length() > 1 && !info[1].IsUndefined() && !info[1].IsNull()) {
+            if (!info[1].IsFunction()) throw Napi::TypeError::New(info.Env(), "loader must be a function");
+            loader = Napi::Persistent(info[1].As<Napi::Function>());
+        }
+        codon_tree_cache_init(&cache, budget);
+    }
+
+    ~TreeCache() { codon_tree_cache_destroy(&cache); }
+
+  private:
+    static std::string GetKey(const Napi::CallbackInfo &info) {
+        if (info.Length() < 1 || !info[0].IsString()) {
+            throw Napi::TypeError::New(info.Env(), "key must be a string");
+        }
+        return info[0].As<Napi::String>().Utf8Value();
+    }
+
+    // get(key) returns the cached Tree, or one parsed from loader(key), or
+    // undefined
+    Napi::Value Get(const Napi::CallbackInfo &info) {
+        Napi::Env env = info.Env();
+        std::string key = GetKey(info);
+        const TSTree *cached = codon_tree_cache_get(&cache, key.data(), static_cast<uint32_t>(key.size()));
+        if (cached != nullptr) return Tree::New(env, ts_tree_copy(cached));
+        if (loader.IsEmpty()) return env.Undefined();
+
+        Napi::Value loaded = loader.Call({info[0]});
+        if (loaded.IsUndefined() || loaded.IsNull()) return env.Undefined();
+        std::string storage;
+        CodonBuffer source = GetText(env, loaded, "loader result", storage);
+        TSTree *tree = ts_parser_parse_string(PooledParser(env).get(), nullptr, source.data, source.length);
+        if (tree == nullptr) throw Napi::Error::New(env, "parsing failed");
+        Napi::Object result = Tree::New(env, tree);
+        Store(env, key, tree);
+        return result;
+    }
+
+    // set(key, tree) adds a copy of the tree, evicting past the budget
+    Napi::Value Set(const Napi::CallbackInfo &info) {
+        std::string key = GetKey(info);
+        TSTree *tree = info.Length() > 1 ? Tree::Get(info[1]) : nullptr;
+        if (tree == nullptr) throw Napi::TypeError::New(info.Env(), "tree must be a Tree");
+        Store(info.Env(), key, tree);
+        return info.This();
+    }
+
+    Napi::Value Delete(const Napi::CallbackInfo &info) {
+        std::string key = GetKey(info);
+        bool removed = codon_tree_cache_remove(&cache, key.data(), static_cast<uint32_t>(key.size()));
+        return Napi::Boolean::New(info.Env(), removed);
+    }
+
+    void Store(Napi::Env env, const std::string &key, const TSTree *tree) {
+        if (!codon_tree_cache_put(&cache, key.data(), static_cast<uint32_t>(key.size()), ts_tree_copy(tree))) {
+            throw Napi::Error::New(env, "out of memory");
+        }
+    }
+
+    Napi::Value Budget(const Napi::CallbackInfo &info) {
+        return Napi::Number::New(info.Env(), static_cast<double>(cache.budget));
+    }
+
+    void SetBudget(const Napi::CallbackInfo &info, const Napi::Value &value) {
+        codon_tree_cache_set_budget(&cache, GetBudget(value));
+    }
+
+    Napi::Value Bytes(const Napi::CallbackInfo &info) {
+        return Napi::Number::New(info.Env(), static_cast<double>(cache.bytes));
+    }
+
+    Napi::Value Size(const Napi::CallbackInfo &info) {
+        return Napi::Number::New(info.Env(), cache.size);
+    }
+
+    Napi::Value Hits(const Napi::CallbackInfo &info) {
+        return Napi::Number::New(info.Env(), static_cast<double>(cache.hits));
+    }
+
+    Napi::Value Misses(const Napi::CallbackInfo &info) {
+        return Napi::Number::New(info.Env(), static_cast<double>(cache.misses));
+    }
+
+    Napi::Value Evictions(const Napi::CallbackInfo &info) {
+        return Napi::Number::New(info.Env(), static_cast<double>(cache.evictions));
+    }
+
+    CodonTreeCache cache;
+    Napi::FunctionReference loader;
+};
+
+/* Highlighting */
+
+class Highlighter : public Napi::ObjectWrap<Highlighter> {
+  public:
+    static Napi::Function Init(Napi::Env env) {
+        return DefineClass(env, "Highlighter", {
+            InstanceMethod("highlight", &Highlighter::Highlight),
+            InstanceAccessor("captureNames", &Highlighter::CaptureNames, nullptr),
+        });
+    }
+
+    explicit Highlighter(const Napi::CallbackInfo &info) : Napi::ObjectWrap<Highlighter>(info) {
+        Napi::Env env = info.Env();
+        if (info.Length() < 1 || !info[0].IsString()) throw Napi::TypeError::New(env, "query must be a string");
+        std::string query = info[0].As<Napi::String>().Utf8Value();
+        uint32_t error_offset;
+        TSQueryError error_type;
+        highlighter = codon_highlighter_new(
+            tree_sitter_codon(), query.data(), static_cast<uint32_t>(query.size()), &error_offset, &error_type
+        );
+        if (highlighter == nullptr) {
+            if (error_type == TSQueryErrorNone) throw Napi::Error::New(env, "out of memory");
+            throw Napi::Error::New(
+                env, "invalid query at byte " + std::to_string(error_offset) + " (error " + std::to_string(error_type) + ")"
+            );
+        }
+    }
+
+    ~Highlighter() { codon_highlighter_delete(highlighter); }
+
+  private:
+    // highlight(tree, source, startIndex?, endIndex?) returns the captures
+    // of the nodes in the range as (startIndex, endIndex, capture) triples
+    Napi::Value Highlight(const Napi::CallbackInfo &info) {
+        Napi::Env env = info.Env();
+        TSTree *tree = info.Length() > 0 ? Tree::Get(info[0]) : nullptr;
+        if (tree == nullptr) throw Napi::TypeError::New(env, "highlight(tree, source, startIndex?, endIndex?)");
+        std::string storage;
+        CodonBuffer source = GetText(env, info[1], "source", storage);
+        double start = info.Length() > 2 && !info[2].IsUndefined() ? info[2].ToNumber().DoubleValue() : 0;
+        double end = info.Length() > 3 && !info[3].IsUndefined() ? info[3].ToNumber().DoubleValue() : UINT32_MAX;
+        if (!(start >= 0 && start <= end)) throw Napi::RangeError::New(env, "startIndex is after endIndex");
+        if (end > UINT32_MAX) end = UINT32_MAX;
+
+        CodonHighlightList list = {nullptr, 0, 0};
+        if (!codon_highlight(
+                highlighter, tree, source.data, source.length,
+                static_cast<uint32_t>(start), static_cast<uint32_t>(end), &list
+            )) {
+            codon_highlight_list_delete(&list);
+            throw Napi::Error::New(env, "out of memory");
+        }
+        size_t count = static_cast<size_t>(list.size) * CODON_HIGHLIGHT_FIELD_COUNT;
+        Napi::ArrayBuffer buffer = Napi::ArrayBuffer::New(env, count * sizeof(uint32_t));
+        if (count > 0) memcpy(buffer.Data(), list.highlights, count * sizeof(uint32_t));
+        codon_highlight_list_delete(&list);
+        return Napi::Uint32Array::New(env, count, buffer, 0);
+    }
+
+    Napi::Value CaptureNames(const Napi::CallbackInfo &info) {
+        uint32_t count = codon_highlighter_capture_count(highlighter);
+        Napi::Array names = Napi::Array::New(info.Env(), count);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t length;
+            const char *name = codon_highlighter_capture_name(highlighter, i, &length);
+            names.Set(i, Napi::String::New(info.Env(), name, length));
+        }
+        return names;
+    }
+
+    CodonHighlighter *highlighter;
+};
+
+/* Summary cache */
+
+// cachedSummary(source, cacheDir) summarizes `source` through the on-disk
+// summary cache. The arrays are copied out of the entry, so the mapping
+// can be released before returning.
+static Napi::Value CachedSummary(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 2 || !info[1].IsString()) {
+        throw Napi::TypeError::New(env, "cachedSummary(source, cacheDir)");
+    }
+    std::string storage;
+    CodonBuffer source = GetText(env, info[0], "source", storage);
+    std::string directory = info[1].As<Napi::String>().Utf8Value();
+
+    CodonCacheEntry entry;
+    if (!codon_cache_get(directory.c_str(), PooledParser(env).get(), source.data, source.length, &entry)) {
+        throw Napi::Error::New(env, "parsing failed");
+    }
+    size_t columns_size = static_cast<size_t>(entry.rows) * CODON_COLUMN_COUNT * sizeof(uint32_t);
+    Napi::ArrayBuffer columns = Napi::ArrayBuffer::New(env, columns_size);
+    if (columns_size > 0) memcpy(columns.Data(), entry.columns, columns_size);
+    size_t error_length = static_cast<size_t>(entry.error_range_count) * CODON_ERROR_RANGE_FIELD_COUNT;
+    Napi::Uint32Array errors = Napi::Uint32Array::New(env, error_length);
+    if (error_length > 0) memcpy(errors.Data(), entry.errors, error_length * sizeof(uint32_t));
+    size_t tag_length = static_cast<size_t>(entry.tag_count) * CODON_TAG_FIELD_COUNT;
+    Napi::Uint32Array tags = Napi::Uint32Array::New(env, tag_length);
+    if (tag_length > 0) memcpy(tags.Data(), entry.tags, tag_length * sizeof(uint32_t));
+
+    Napi::Object result = Napi::Object::New(env);
+    result["hit"] = Napi::Boolean::New(env, entry.hit);
+    result["summary"] = SummaryObject(env, entry.summary);
+    result["columns"] = ColumnsObject(env, columns, entry.rows);
+    result["errors"] = errors;
+    result["tags"] = tags;
+    codon_cache_entry_release(&entry);
+    return result;
+}
+
+/* Header pre-scan */
+
+// prescan(source) returns the directives and imports at the top of a
+// source without parsing it
+static Napi::Value Prescan(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    std::string storage;
+    CodonBuffer source = GetText(env, info[0], "source", storage);
+    const char *data = source.data;
+
+    CodonPrescanList list = {};
+    if (!codon_prescan(data, source.length, &list)) {
+        codon_prescan_list_delete(&list);
+        throw Napi::Error::New(env, "out of memory");
+    }
+    Napi::Array records = Napi::Array::New(env, list.size);
+    for (uint32_t i = 0; i < list.size; i++) {
+        const CodonPrescanRecord &record = list.records[i];
+        Napi::Object object = Napi::Object::New(env);
+        object["kind"] = Napi::String::New(env, codon_prescan_kind_names[record.kind]);
+        object["name"] = Napi::String::New(
+            env, data + record.name_start_byte, record.name_end_byte - record.name_start_byte
+        );
+        object["value"] = Napi::String::New(
+            env, data + record.value_start_byte, record.value_end_byte - record.value_start_byte
+        );
+        object["startIndex"] = Napi::Number::New(env, record.start_byte);
+        object["endIndex"] = Napi::Number::New(env, record.end_byte);
+        object["row"] = Napi::Number::New(env, record.row);
+        records[i] = object;
+    }
+    codon_prescan_list_delete(&list);
+    return records;
+}
+
+/* Scanner statistics */
+
+#ifdef CODON_SCANNER_STATS
+static Napi::Object ScannerStatsObject(Napi::Env env, const CodonScannerStats &stats) {
+    auto count = [env](uint64_t value) { return Napi::Number::New(env, static_cast<double>(value)); };
+    Napi::Object result = Napi::Object::New(env);
+    result["scanCalls"] = count(stats.scan_calls);
+    result["errorRecoveryCalls"] = count(stats.error_recovery_calls);
+    result["pendingDedentCalls"] = count(stats.pending_dedent_calls);
+    result["stringCalls"] = count(stats.string_calls);
+    result["newlineCalls"] = count(stats.newline_calls);
+    result["wastedCalls"] = count(stats.wasted_calls);
+    result["wastedChars"] = count(stats.wasted_chars);
+    result["chars"] = count(stats.chars);
+    result["serializeCalls"] = count(stats.serialize_calls);
+    result["serializeBytes"] = count(stats.serialize_bytes);
+    result["deserializeCalls"] = count(stats.deserialize_calls);
+    result["deserializeBytes"] = count(stats.deserialize_bytes);
+
+    Napi::Object tokens = Napi::Object::New(env);
+    for (int i = 0; i < CODON_SCANNER_TOKEN_COUNT; i++) {
+        tokens[codon_scanner_token_names[i]] = count(stats.tokens[i]);
+    }
+    result["tokens"] = tokens;
+
+    Napi::Array histogram = Napi::Array::New(env, CODON_SCANNER_HISTOGRAM_SIZE);
+    for (uint32_t i = 0; i < CODON_SCANNER_HISTOGRAM_SIZE; i++) {
+        histogram[i] = count(stats.chars_histogram[i]);
+    }
+    result["charsHistogram"] = histogram;
+    return result;
+}
+#endif
+
+// scannerStats() sums the external scanner counters of every scanner in the
+// process; token names match the Python binding
+static Napi::Value ScannerStats(const Napi::CallbackInfo &info) {
+#ifdef CODON_SCANNER_STATS
+    CodonScannerStats stats;
+    codon_scanner_stats_read(&stats);
+    return ScannerStatsObject(info.Env(), stats);
+#else
+    throw Napi::Error::New(info.Env(), "built without CODON_SCANNER_STATS");
+#endif
+}
+
+static void ResetScannerStats(const Napi::CallbackInfo &info) {
+#ifdef CODON_SCANNER_STATS
+    codon_scanner_stats_reset();
+#else
+    throw Napi::Error::New(info.Env(), "built without CODON_SCANNER_STATS");
+#endif
+}
 
 // "tree-sitter", "language" are Napi::Symbols
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
+    env.SetInstanceData(new AddonData());
     exports["name"] = Napi::String::New(env, "codon");
-    auto language = Napi::External<void>::New(env, const_cast<void*>(tree_sitter_codon()));
+    auto language = Napi::External<void>::New(env, const_cast<TSLanguage *>(tree_sitter_codon()));
     exports["language"] = language;
+    exports["Tree"] = Tree::Init(env);
+
+    Napi::Array tag_kinds = Napi::Array::New(env, CODON_TAG_KIND_COUNT);
+    for (uint32_t i = 0; i < CODON_TAG_KIND_COUNT; i++) {
+        tag_kinds[i] = Napi::String::New(env, codon_tag_kind_names[i]);
+    }
+    exports["tagKinds"] = tag_kinds;
+    Napi::Array tag_fields = Napi::Array::New(env, CODON_TAG_FIELD_COUNT);
+    const char *field_names[] = {
+        "kind", "parent", "nameStartIndex", "nameEndIndex", "startIndex", "endIndex", "startRow", "endRow",
+    };
+    for (uint32_t i = 0; i < CODON_TAG_FIELD_COUNT; i++) {
+        tag_fields[i] = Napi::String::New(env, field_names[i]);
+    }
+    exports["tagFields"] = tag_fields;
+
+    const TSLanguage *codon = tree_sitter_codon();
+    uint32_t symbol_count = ts_language_symbol_count(codon);
+    Napi::Array symbol_names = Napi::Array::New(env, symbol_count);
+    for (uint32_t i = 0; i < symbol_count; i++) {
+        symbol_names[i] = Napi::String::New(env, ts_language_symbol_name(codon, static_cast<TSSymbol>(i)));
+    }
+    exports["symbolNames"] = symbol_names;
+    // Field ids start at 1; fieldNames[0] is null
+    uint32_t field_count = ts_language_field_count(codon);
+    Napi::Array field_names = Napi::Array::New(env, field_count + 1);
+    field_names[uint32_t(0)] = env.Null();
+    for (uint32_t i = 1; i <= field_count; i++) {
+        field_names[i] = Napi::String::New(env, ts_language_field_name_for_id(codon, static_cast<TSFieldId>(i)));
+    }
+    exports["fieldNames"] = field_names;
+    exports["EditSession"] = EditSession::Init(env);
+    exports["ParseJob"] = ParseJob::Init(env);
+    exports["InjectionCache"] = InjectionCache::Init(env);
+    exports["TreeCache"] = TreeCache::Init(env);
+    exports["Highlighter"] = Highlighter::Init(env);
+    exports["parseAsync"] = Napi::Function::New(env, ParseAsync, "parseAsync");
+    exports["parseWithStats"] = Napi::Function::New(env, ParseWithStats, "parseWithStats");
+    exports["parseStream"] = Napi::Function::New(env, ParseStream, "parseStream");
+    exports["parseReadable"] = Napi::Function::New(env, ParseReadable, "parseReadable");
+    exports["prescan"] = Napi::Function::New(env, Prescan, "prescan");
+    exports["cachedSummary"] = Napi::Function::New(env, CachedSummary, "cachedSummary");
+    exports["scannerStats"] = Napi::Function::New(env, ScannerStats, "scannerStats");
+    exports["resetScannerStats"] = Napi::Function::New(env, ResetScannerStats, "resetScannerStats");
     return exports;
 }
 
@@ -0,0 +1,326 @@
+const assert = require("node:assert");
+const fs = require("node:fs");
+const os = require("node:os");
+const path = require("node:path");
+const { test } = require("node:test");
+
+const Codon = require(".");
+
+const source = "def add(a: int, b: int) -> int:\n    return a + b\n";
+
+test("parseAsync resolves with a tree", async () => {
+  const tree = await Codon.parseAsync(source);
+  assert.ok(tree instanceof Codon.Tree);
+  assert.strictEqual(tree.hasError, false);
+  assert.match(tree.rootString(), /^\(module \(function_definition/);
+  assert.strictEqual(tree.summary().byteLength, source.length);
+});
+
+test("parseAsync parses Buffers in place", async () => {
+  const tree = await Codon.parseAsync(Buffer.from(source));
+  assert.strictEqual(tree.summary().byteLength, source.length);
+});
+
+test("parseAsync reuses an edited tree", async () => {
+  const tree = await Codon.parseAsync(source);
+  const edited = source.replace("a + b", "a - b");
+  const index = source.indexOf("+");
+  const row = 1;
+  const column = index - source.indexOf("\n") - 1;
+  tree.edit({
+    startIndex: index,
+    oldEndIndex: index + 1,
+    newEndIndex: index + 1,
+    startPosition: { row, column },
+    oldEndPosition: { row, column: column + 1 },
+    newEndPosition: { row, column: column + 1 },
+  });
+  const reparsed = await Codon.parseAsync(edited, tree);
+  assert.strictEqual(reparsed.hasError, false);
+});
+
+test("parseAsync can be cancelled", async () => {
+  const large = source.repeat(20000);
+  const controller = new AbortController();
+  const promise = Codon.parseAsync(large, undefined, { signal: controller.signal });
+  controller.abort();
+  await assert.rejects(promise, { name: "AbortError" });
+
+  // The thread's parser is usable again afterwards
+  const tree = await Codon.parseAsync(source);
+  assert.strictEqual(tree.hasError, false);
+});
+
+test("parseAsync rejects bad arguments", () => {
+  assert.throws(() => Codon.parseAsync(42), TypeError);
+  assert.throws(() => Codon.parseAsync(source, {}), TypeError);
+  assert.throws(() => new Codon.Tree(), TypeError);
+});
+
+test("ParseJob resumes across slices", async () => {
+  const large = source.repeat(2000);
+  const job = new Codon.ParseJob(large);
+  let slices = 0;
+  // A zero budget stops at the first progress check of every slice
+  while (!job.run(0)) slices++;
+  assert.ok(slices > 1);
+  assert.strictEqual(job.done, true);
+  assert.strictEqual(job.offset, job.length);
+  assert.deepStrictEqual(job.tree.summary(), (await Codon.parseAsync(large)).summary());
+
+  const partial = new Codon.ParseJob(Buffer.from(large));
+  partial.run(0);
+  partial.run(0);
+  const prefix = partial.partial();
+  assert.strictEqual(prefix.hasError, false);
+  assert.ok(prefix.summary().byteLength <= partial.offset);
+  assert.strictEqual(partial.tree, null);
+  assert.throws(() => partial.run(-1), TypeError);
+
+  let reports = 0;
+  const tree = await Codon.parseInSlices(large, { budgetMs: 0, onProgress: () => reports++ });
+  assert.ok(reports > 0);
+  assert.strictEqual(tree.hasError, false);
+  const controller = new AbortController();
+  controller.abort();
+  await assert.rejects(Codon.parseInSlices(large, { signal: controller.signal }), { name: "AbortError" });
+});
+
+test("parseStream and parseReadable read sources in chunks", async () => {
+  const { Readable } = require("node:stream");
+  const large = Buffer.from(source.repeat(500));
+  const expected = (await Codon.parseAsync(large)).summary();
+  const provider = (index, size) => large.subarray(index, index + size);
+  assert.deepStrictEqual(Codon.parseStream(provider, { chunkSize: 64 }).summary(), expected);
+
+  const utf16 = Buffer.from(source.repeat(500), "utf16le");
+  const tree = Codon.parseStream((index, size) => utf16.subarray(index, index + size), { encoding: "utf16le" });
+  assert.strictEqual(tree.summary().byteLength, utf16.length);
+  assert.throws(() => Codon.parseStream(() => {
+    throw new Error("boom");
+  }), /boom/);
+  assert.throws(() => Codon.parseStream(provider, { encoding: "latin1" }), TypeError);
+
+  const chunks = [];
+  for (let i = 0; i < large.length; i += 1000) chunks.push(large.subarray(i, i + 1000));
+  assert.deepStrictEqual((await Codon.parseReadable(Readable.from(chunks))).summary(), expected);
+  const failing = new Readable({
+    read() {
+      this.destroy(new Error("connection reset"));
+    },
+  });
+  await assert.rejects(Codon.parseReadable(failing), /connection reset/);
+});
+
+test("parseWithStats profiles a parse", () => {
+  const { tree, stats } = Codon.parseWithStats("x = a |> f |> g\n");
+  assert.strictEqual(tree.hasError, false);
+  assert.ok(stats.lexCalls > 0);
+  assert.ok(stats.maxVersions >= 1);
+  assert.strictEqual(stats.errorsDetected, 0);
+  assert.strictEqual(stats.reductionsBySymbol.pipe_expression, 2);
+
+  // Reparsing an edited tree reuses the untouched definitions
+  const large = source.repeat(20);
+  const first = Codon.parseWithStats(large).tree;
+  first.edit({
+    startIndex: 4,
+    oldEndIndex: 7,
+    newEndIndex: 7,
+    startPosition: { row: 0, column: 4 },
+    oldEndPosition: { row: 0, column: 7 },
+    newEndPosition: { row: 0, column: 7 },
+  });
+  const reparsed = Codon.parseWithStats(large.replace("add", "sub"), first);
+  assert.ok(reparsed.stats.reusedNodes > 0);
+});
+
+test("scannerStats counts scanner calls", async (t) => {
+  try {
+    Codon.resetScannerStats();
+  } catch {
+    t.skip("built without CODON_SCANNER_STATS");
+    return;
+  }
+  await Codon.parseAsync("if x:\n    s = \"abc\"\n");
+  const stats = Codon.scannerStats();
+  assert.ok(stats.scanCalls > 0);
+  assert.ok(stats.tokens.indent > 0);
+  assert.strictEqual(stats.charsHistogram.reduce((a, b) => a + b, 0), stats.scanCalls);
+  Codon.resetScannerStats();
+  assert.strictEqual(Codon.scannerStats().scanCalls, 0);
+});
+
+test("Tree#tags packs definitions into a Uint32Array", async () => {
+  // Extern functions need another decorator before @python in the shipped parser
+  const text = "class Point:\n    def norm(self):\n        return 0\n@inline\n@python\ndef f():\n    pass\n";
+  const tags = (await Codon.parseAsync(text)).tags();
+  assert.ok(tags instanceof Uint32Array);
+  const size = Codon.tagFields.length;
+  const found = [];
+  for (let i = 0; i < tags.length; i += size) {
+    found.push([Codon.tagKinds[tags[i]], text.slice(tags[i + 2], tags[i + 3]), tags[i + 1]]);
+  }
+  assert.deepStrictEqual(found, [
+    ["class", "Point", 0xffffffff],
+    ["function", "norm", 0],
+    ["python_function", "f", 0xffffffff],
+  ]);
+});
+
+test("Tree#columns exports one Uint32Array per column", async () => {
+  const tree = await Codon.parseAsync("x = 1\n");
+  const columns = tree.columns();
+  assert.strictEqual(columns.rows, tree.summary().nodeCount);
+  assert.ok(columns.symbol instanceof Uint32Array);
+  assert.strictEqual(columns.symbol.buffer, columns.parent.buffer);
+  assert.deepStrictEqual(
+    Array.from(columns.symbol, (symbol) => Codon.symbolNames[symbol]),
+    ["module", "expression_statement", "assignment", "identifier", "=", "integer"],
+  );
+  assert.deepStrictEqual(Array.from(columns.parent), [0xffffffff, 0, 1, 2, 2, 2]);
+  assert.deepStrictEqual(Array.from(columns.field.slice(3), (field) => Codon.fieldNames[field]), ["left", null, "right"]);
+
+  const named = tree.columns(true);
+  assert.strictEqual(named.rows, 5);
+  assert.deepStrictEqual(Array.from(named.parent), [0xffffffff, 0, 1, 2, 2]);
+});
+
+test("prescan reads the header and stops after it", () => {
+  const source = "## codon: debug = 1\nimport os as o\nfrom C import puts(cobj) -> None\nx = 1\nimport late\n";
+  const records = Codon.prescan(source);
+  assert.deepStrictEqual(
+    records.map(({ kind, name, value }) => [kind, name, value]),
+    [["directive", "debug", "1"], ["import", "os", "o"], ["c_import", "puts", "(cobj) -> None"]],
+  );
+  assert.strictEqual(records[1].row, 1);
+  assert.strictEqual(source.slice(records[1].startIndex, records[1].endIndex), "import os as o");
+  assert.deepStrictEqual(Codon.prescan(Buffer.from("x = 1\n")), []);
+});
+
+test("cachedSummary serves the second lookup from disk", () => {
+  const directory = fs.mkdtempSync(path.join(os.tmpdir(), "codon-cache-"));
+  try {
+    const source = "def f(:\n    return 1\n";
+    const first = Codon.cachedSummary(source, directory);
+    const second = Codon.cachedSummary(Buffer.from(source), directory);
+    assert.strictEqual(first.hit, false);
+    assert.strictEqual(second.hit, true);
+    assert.deepStrictEqual(second.summary, first.summary);
+    assert.deepStrictEqual(Array.from(second.columns.symbol), Array.from(first.columns.symbol));
+    assert.strictEqual(second.errors.length / Codon.errorFields.length, second.summary.errorCount);
+  } finally {
+    fs.rmSync(directory, { recursive: true, force: true });
+  }
+});
+
+test("EditSession reparses after each edit", () => {
+  const session = new Codon.EditSession("def f():\n    return 1\n");
+  const ranges = session.edit(4, 5, "g");
+  assert.strictEqual(session.text(), "def g():\n    return 1\n");
+  assert.strictEqual(session.length, 22);
+  assert.ok(Array.isArray(ranges));
+  assert.strictEqual(session.tree.hasError, false);
+
+  session.edit(session.length, session.length, Buffer.from("x = (\n"));
+  assert.strictEqual(session.tree.hasError, true);
+  assert.throws(() => session.edit(3, 2, ""), RangeError);
+});
+
+test("InjectionCache parses a region once per distinct text", () => {
+  const cache = new Codon.InjectionCache();
+  const text = "@inline\n@python\ndef f():\n    x = 1\n    if x:\n        y()\n";
+  const start = text.indexOf("x = 1");
+  // Codon stands in for the Python grammar
+  const tree = cache.parse(Codon, text, start, text.length);
+  assert.strictEqual(tree.hasError, false);
+  assert.strictEqual(tree.summary().byteLength, text.length - start);
+
+  const moved = "import os\n" + text;
+  cache.parse(Codon, moved, moved.indexOf("x = 1"), moved.length);
+  assert.strictEqual(cache.hits, 1);
+  assert.strictEqual(cache.misses, 1);
+  assert.throws(() => cache.parse(Codon, text, 10, 5), RangeError);
+});
+
+test("TreeCache evicts past its budget and reloads on demand", () => {
+  const sources = new Map();
+  for (let i = 0; i < 8; i++) sources.set(`file${i}.codon`, `def f${i}(x):\n    return x + ${i}\n`);
+  const loaded = [];
+  const one = Codon.parseWithStats(sources.get("file0.codon")).tree.memory().totalBytes;
+  assert.ok(one > 0);
+  const cache = new Codon.TreeCache(2 * one, (key) => {
+    loaded.push(key);
+    return sources.get(key);
+  });
+  for (const key of sources.keys()) assert.strictEqual(cache.get(key).hasError, false);
+  assert.strictEqual(cache.size, 2);
+  assert.ok(cache.bytes <= cache.budget);
+  assert.ok(cache.evictions >= 6);
+
+  cache.get("file0.codon");
+  assert.strictEqual(loaded.filter((key) => key === "file0.codon").length, 2);
+  assert.strictEqual(cache.get("missing.codon"), undefined);
+
+  cache.budget = 1;
+  assert.strictEqual(cache.size, 0);
+  assert.throws(() => new Codon.TreeCache(-1), TypeError);
+});
+
+test("queries are compiled once and shared", (t) => {
+  try {
+    require.resolve("tree-sitter");
+  } catch {
+    t.skip("tree-sitter is not installed");
+    return;
+  }
+  const { Query } = require("tree-sitter");
+  assert.ok(Codon.highlightsQuery instanceof Query);
+  assert.strictEqual(Codon.highlightsQuery, Codon.highlightsQuery);
+  assert.ok(Codon.tagsQuery.captureNames.length > 0);
+  assert.notStrictEqual(Codon.injectionsQuery, Codon.tagsQuery);
+});
+
+test("highlight returns packed captures for a byte range", async () => {
+  const text = "def f(x):\n    return x.Upper\n";
+  const tree = await Codon.parseAsync(text);
+  const size = Codon.highlightFields.length;
+  const all = Codon.highlight(tree, text);
+  assert.ok(all instanceof Uint32Array);
+  assert.ok(all.length > 0 && all.length % size === 0);
+  assert.strictEqual(Codon.highlighter.captureNames[all[2]], "keyword");
+  assert.strictEqual(text.slice(all[0], all[1]), "def");
+
+  const start = text.indexOf("return");
+  const visible = Codon.highlight(tree, text, [start, text.length]);
+  assert.ok(visible.length < all.length);
+  for (let i = 0; i < visible.length; i += size) assert.ok(visible[i + 1] > start);
+
+  const highlighter = new Codon.Highlighter('((identifier) @constructor (#match? @constructor "^[A-Z]"))');
+  const captures = highlighter.highlight(tree, text);
+  assert.deepStrictEqual(Array.from(captures), [text.indexOf("Upper"), text.indexOf("Upper") + 5, 0]);
+  assert.throws(() => new Codon.Highlighter("(identifier"));
+});
+
+test("workers load their own instance and transfer columns back", async () => {
+  const { Worker } = require("node:worker_threads");
+  const worker = new Worker(`
+    const { parentPort } = require("node:worker_threads");
+    const Codon = require(${JSON.stringify(__dirname)});
+    parentPort.on("message", async (text) => {
+      const tree = await Codon.parseAsync(text);
+      const columns = tree.columns(true);
+      parentPort.postMessage(columns, [columns.buffer]);
+    });
+  `, { eval: true });
+  const columns = await new Promise((resolve, reject) => {
+    worker.once("message", resolve);
+    worker.once("error", reject);
+    worker.postMessage(source);
+  });
+  await worker.terminate();
+
+  // The views survive the transfer, and this thread's Tree class still works
+  assert.strictEqual(columns.symbol.buffer, columns.buffer);
+  assert.deepStrictEqual(columns, (await Codon.parseAsync(source)).columns(true));
+});
@@ -4,7 +4,231 @@
  * @module tree-sitter-codon
  */
 
+const fs = require("fs");
 const path = require("path");
 const binding = require("node-gyp-build")(path.dirname(__dirname));
 
+const nativeParseAsync = binding.parseAsync;
+const nativeCachedSummary = binding.cachedSummary;
+const nativeParseStream = binding.parseStream;
+const nativeParseReadable = binding.parseReadable;
+
+/**
+ * Parses `source` on the libuv thread pool, off the event loop.
+ *
+ * @param {string|Buffer|TypedArray} source - Source text, copied before the parse starts, so a
+ *   Buffer or typed array may be reused as soon as this returns. At most 4 GiB.
+ * @param {Tree} [oldTree] - A tree from a previous parseAsync, already edited to match `source`.
+ * @param {{signal?: AbortSignal}} [options] - Aborting the signal cancels the parse.
+ * @returns {Promise<Tree>} A promise with a `cancel()` method. Cancelled parses reject with an
+ *   `AbortError`.
+ */
+binding.parseAsync = function parseAsync(source, oldTree, options = {}) {
+  const { signal } = options;
+  const promise = nativeParseAsync(source, oldTree);
+  if (signal) {
+    if (signal.aborted) {
+      promise.cancel();
+    } else {
+      const onAbort = () => promise.cancel();
+      signal.addEventListener("abort", onAbort, { once: true });
+      promise.then(
+        () => signal.removeEventListener("abort", onAbort),
+        () => signal.removeEventListener("abort", onAbort),
+      );
+    }
+  }
+  return promise;
+};
+
+/**
+ * Summarizes `source` through the on-disk summary cache in `cacheDir`, which is created if
+ * missing. Entries are keyed by the source's hash and a fingerprint of the grammar and scanner,
+ * so a regenerated parser never reads stale entries.
+ *
+ * @param {string|Buffer|TypedArray} source - Source text.
+ * @param {string} cacheDir - Directory holding the cache entries.
+ * @returns {{hit: boolean, summary: object, columns: object, errors: Uint32Array, tags: Uint32Array}}
+ *   `columns` is shaped like `Tree#columns(true)`, `errors` holds `errorFields.length` values per
+ *   ERROR or MISSING node and `tags` is laid out like `Tree#tags()`.
+ */
+binding.cachedSummary = function cachedSummary(source, cacheDir) {
+  fs.mkdirSync(cacheDir, { recursive: true });
+  return nativeCachedSummary(source, cacheDir);
+};
+
+// parseWithStats(source, oldTree?) is native: it parses on the calling
+// thread with the parse log feeding counters, which makes it several
+// times slower, and returns {tree, stats}. `stats` has steps, forkedSteps,
+// forks, maxVersions, lexCalls, externalLexCalls, shifts, reductions,
+// reusedNodes (subtrees taken from oldTree), errorsDetected, recoveries and
+// reductionsBySymbol, keyed by node type name.
+
+/**
+ * Parses `source` in slices on the main thread, yielding to the event loop between them, so a
+ * huge file never blocks it for longer than one slice. Each slice resumes where the last stopped.
+ *
+ * @param {string|Buffer|TypedArray} source - Source text, copied when the job is created, so a
+ *   Buffer or typed array may be reused as soon as this returns. At most 4 GiB.
+ * @param {{budgetMs?: number, oldTree?: Tree, onProgress?: function(ParseJob): void,
+ *   signal?: AbortSignal}} [options] - `budgetMs` (default 10) bounds each slice. `onProgress` is
+ *   called with the job after every slice that did not finish; `job.offset / job.length` is how
+ *   far it has got, and `job.partial()` parses the statements before that point to show early.
+ *   Aborting `signal` rejects with an `AbortError`.
+ * @returns {Promise<Tree>}
+ */
+binding.parseInSlices = function parseInSlices(source, options = {}) {
+  const { budgetMs = 10, oldTree, onProgress, signal } = options;
+  const job = new binding.ParseJob(source, oldTree);
+  return new Promise((resolve, reject) => {
+    const slice = () => {
+      try {
+        if (signal && signal.aborted) {
+          const error = new Error("parse was cancelled");
+          error.name = "AbortError";
+          reject(error);
+        } else if (job.run(budgetMs)) {
+          resolve(job.tree);
+        } else {
+          if (onProgress) onProgress(job);
+          setImmediate(slice);
+        }
+      } catch (error) {
+        reject(error);
+      }
+    };
+    slice();
+  });
+};
+
+/**
+ * Parses a source read chunk by chunk through one reusable native buffer, on the calling thread,
+ * so the source is never held whole.
+ *
+ * @param {function(number, number): (string|Buffer|TypedArray|null)} provider - Called with a byte
+ *   index and a size; returns up to that many bytes of the source from the index, or null at the
+ *   end. Strings are encoded as `encoding`.
+ * @param {{encoding?: string, chunkSize?: number}} [options] - `encoding` is utf8 (the default),
+ *   utf16le or utf16be, and offsets in the tree are bytes in it. `chunkSize` defaults to 256 KiB.
+ * @returns {Tree}
+ */
+binding.parseStream = function parseStream(provider, options = {}) {
+  return nativeParseStream(provider, options.encoding, options.chunkSize);
+};
+
+/**
+ * Parses a `Readable` on the libuv thread pool as its chunks arrive. Chunks are read from the
+ * stream only as the parser needs them, so a fast stream is held back rather than buffered whole.
+ *
+ * @param {stream.Readable} readable - A stream of Buffers, or of strings in `encoding`.
+ * @param {{encoding?: string, chunkSize?: number, signal?: AbortSignal}} [options] - As for
+ *   parseStream; aborting `signal` cancels the parse.
+ * @returns {Promise<Tree>} Rejects with the stream's error if it fails, or an `AbortError`.
+ */
+binding.parseReadable = function parseReadable(readable, options = {}) {
+  const { encoding, chunkSize, signal } = options;
+  let wanted = false;
+  let ended = false;
+  let failure;
+  const pump = () => {
+    if (!wanted) return;
+    const chunk = readable.read();
+    if (chunk !== null || ended) {
+      wanted = false;
+      parse.feed(chunk);
+    }
+  };
+  const parse = nativeParseReadable(() => {
+    wanted = true;
+    pump();
+  }, encoding, chunkSize);
+  const onEnd = () => {
+    ended = true;
+    pump();
+  };
+  const onError = (error) => {
+    failure = error;
+    parse.abort();
+  };
+  const onAbort = () => parse.abort();
+  readable.on("readable", pump);
+  readable.once("end", onEnd);
+  readable.once("error", onError);
+  if (signal) {
+    if (signal.aborted) parse.abort();
+    else signal.addEventListener("abort", onAbort, { once: true });
+  }
+  const cleanup = () => {
+    readable.off("readable", pump);
+    readable.off("end", onEnd);
+    readable.off("error", onError);
+    if (signal) signal.removeEventListener("abort", onAbort);
+  };
+  return parse.promise.then(
+    (tree) => {
+      cleanup();
+      return tree;
+    },
+    (error) => {
+      cleanup();
+      throw failure || error;
+    },
+  );
+};
+
+binding.errorFields = ["startIndex", "endIndex", "startRow", "startColumn"];
+
+const queries = {};
+
+// Compiling a query walks the whole parse table, so each one is compiled
+// once per process, on first use, and shared by every parser
+function query(name) {
+  if (!(name in queries)) {
+    const { Query } = require("tree-sitter");
+    const source = fs.readFileSync(path.join(__dirname, "..", "..", "queries", `${name}.scm`), "utf8");
+    queries[name] = new Query(binding, source);
+  }
+  return queries[name];
+}
+
+// highlightsQuery, injectionsQuery and tagsQuery: tree-sitter Query
+// objects for the files in queries/. They need the optional tree-sitter
+// peer dependency.
+for (const name of ["highlights", "injections", "tags"]) {
+  Object.defineProperty(binding, `${name}Query`, {
+    enumerable: true,
+    get: () => query(name),
+  });
+}
+
+let highlighter;
+
+// The shared Highlighter for queries/highlights.scm, compiled on first use
+Object.defineProperty(binding, "highlighter", {
+  enumerable: true,
+  get() {
+    if (highlighter === undefined) {
+      const source = fs.readFileSync(path.join(__dirname, "..", "..", "queries", "highlights.scm"), "utf8");
+      highlighter = new binding.Highlighter(source);
+    }
+    return highlighter;
+  },
+});
+
+/**
+ * Highlights a tree in one native call. The query and its `#eq?`, `#match?` and `#any-of?`
+ * predicates run in C, so no object is created per capture.
+ *
+ * @param {Tree} tree - A tree from parseAsync.
+ * @param {string|Buffer|TypedArray} source - The text `tree` was parsed from.
+ * @param {[number, number]} [range] - Byte range to highlight, such as the visible lines.
+ * @returns {Uint32Array} `highlightFields.length` values per capture, ordered by start; `capture`
+ *   indexes `highlighter.captureNames`. Nodes that overlap `range` are reported whole.
+ */
+binding.highlight = function highlight(tree, source, range) {
+  return binding.highlighter.highlight(tree, source, ...(range || []));
+};
+
+binding.highlightFields = ["startIndex", "endIndex", "capture"];
+
 module.exports = binding;
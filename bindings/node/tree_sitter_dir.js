@@ -0,0 +1,37 @@
+/**
+ * Prints the tree-sitter checkout whose runtime binding.gyp compiles in.
+ *
+ * TREE_SITTER_DIR wins; otherwise the copy vendored by the tree-sitter
+ * peer dependency is used. Exits non-zero with a hint when neither exists,
+ * so `node-gyp configure` stops before compiling against a missing lib.c.
+ */
+
+const fs = require("fs");
+const path = require("path");
+
+function fail(message) {
+  console.error(`tree-sitter-codon: ${message}`);
+  console.error(
+    "install the tree-sitter package (npm install tree-sitter) or set " +
+      "TREE_SITTER_DIR to a tree-sitter checkout",
+  );
+  process.exit(1);
+}
+
+let root = process.env.TREE_SITTER_DIR;
+if (!root) {
+  let manifest;
+  try {
+    manifest = require.resolve("tree-sitter/package.json", {
+      paths: [path.join(__dirname, "..", "..")],
+    });
+  } catch {
+    fail("the tree-sitter runtime sources were not found");
+  }
+  root = path.join(path.dirname(manifest), "vendor", "tree-sitter");
+}
+
+if (!fs.existsSync(path.join(root, "lib", "src", "lib.c"))) {
+  fail(`${path.join(root, "lib", "src", "lib.c")} does not exist`);
+}
+console.log(root);
@@ -0,0 +1,541 @@
+import io
+import os
+import sys
+import sysconfig
+import tempfile
+from concurrent.futures import ThreadPoolExecutor
+from unittest import TestCase
+
+import tree_sitter_codon
+
+
+class TestParse(TestCase):
+    def test_parses_buffers_in_place(self):
+        for source in (b"x = 1\n", bytearray(b"x = 1\n"), memoryview(b"x = 1\n")):
+            tree = tree_sitter_codon.parse(source)
+            self.assertFalse(tree.has_error)
+
+    def test_pins_buffer_for_tree_lifetime(self):
+        source = bytearray(b"x = 1\n")
+        tree = tree_sitter_codon.parse(source)
+        with self.assertRaises(BufferError):
+            source.extend(b"y = 2\n")
+        del tree
+        source.extend(b"y = 2\n")
+
+
+class TestParseStats(TestCase):
+    def test_counts_parse_actions(self):
+        tree, stats = tree_sitter_codon.parse_with_stats(b"x = a |> f |> g\n")
+        self.assertFalse(tree.has_error)
+        self.assertGreater(stats["lex_calls"], 0)
+        self.assertGreater(stats["shifts"], 0)
+        self.assertGreaterEqual(stats["max_versions"], 1)
+        self.assertEqual(stats["errors_detected"], 0)
+        self.assertEqual(stats["reductions_by_symbol"]["pipe_expression"], 2)
+        self.assertLessEqual(sum(stats["reductions_by_symbol"].values()), stats["reductions"])
+
+    def test_counts_error_recovery(self):
+        tree, stats = tree_sitter_codon.parse_with_stats(b"x = (1\ny = 2\n")
+        self.assertTrue(tree.has_error)
+        self.assertGreater(stats["errors_detected"], 0)
+
+    def test_edit_reuses_subtrees(self):
+        source = "".join(f"def f{i}(x):\n    return x |> g\n" for i in range(20))
+        session = tree_sitter_codon.EditSession(source)
+        ranges, stats = session.edit_with_stats(4, 6, "h0")
+        self.assertGreater(stats["reused_nodes"], 0)
+        self.assertEqual(session.text()[:6], b"def h0")
+
+
+class TestParseJob(TestCase):
+    SOURCE = b"".join(b"def f%d(x):\n    return x + %d\n" % (i, i) for i in range(2000))
+
+    def test_resumes_until_done(self):
+        job = tree_sitter_codon.ParseJob(self.SOURCE)
+        offsets = []
+        # A zero budget stops at the first progress check of every slice
+        while not job.run(0):
+            offsets.append(job.offset)
+        self.assertGreater(len(offsets), 1)
+        self.assertEqual(offsets, sorted(offsets))
+        self.assertTrue(job.done)
+        self.assertEqual(job.offset, len(job))
+        self.assertEqual(job.tree.summary(), tree_sitter_codon.parse(self.SOURCE).summary())
+        self.assertTrue(job.run(0))
+
+    def test_partial_stops_between_statements(self):
+        job = tree_sitter_codon.ParseJob(self.SOURCE.decode())
+        self.assertIsNone(job.tree)
+        for _ in range(3):
+            job.run(0)
+        partial = job.partial()
+        self.assertFalse(partial.has_error)
+        self.assertLessEqual(partial.summary()["byte_length"], job.offset)
+        self.assertEqual(job.partial(max_bytes=0).summary()["byte_length"], 0)
+
+    def test_parse_in_slices(self):
+        seen = []
+        tree = tree_sitter_codon.parse_in_slices(self.SOURCE, 0, lambda job: seen.append(job.offset))
+        self.assertGreater(len(seen), 0)
+        self.assertFalse(tree.has_error)
+        self.assertIsNone(tree_sitter_codon.parse_in_slices(self.SOURCE, 0, lambda job: False))
+        with self.assertRaises(ValueError):
+            tree_sitter_codon.ParseJob(self.SOURCE).run(-1)
+
+
+class TestParseStream(TestCase):
+    SOURCE = "".join(f"def f{i}(s: str):\n    return s + 'π{i}'\n" for i in range(200))
+
+    def assertSameTree(self, tree, source):
+        self.assertEqual(tree.summary(), tree_sitter_codon.parse(source).summary())
+
+    def test_reads_files_in_chunks(self):
+        data = self.SOURCE.encode()
+        with tempfile.TemporaryFile() as f:
+            f.write(b"header")
+            f.write(data)
+            f.seek(6)
+            self.assertSameTree(tree_sitter_codon.parse_stream(f, chunk_size=64), data)
+
+    def test_reads_non_seekable_streams_once(self):
+        data = self.SOURCE.encode()
+
+        class Pipe:
+            def __init__(self):
+                self.stream = io.BytesIO(data)
+
+            # No seek: a step back past the buffer would raise
+            def read(self, size):
+                return self.stream.read(size)
+
+        pipe = Pipe()
+        self.assertSameTree(tree_sitter_codon.parse_stream(pipe, chunk_size=256), data)
+        self.assertEqual(pipe.stream.tell(), len(data))
+
+    def test_reader_callable_and_utf16(self):
+        data = self.SOURCE.encode("utf-16-le")
+        tree = tree_sitter_codon.parse_stream(lambda offset, size: data[offset:offset + size], "UTF-16LE", 100)
+        self.assertFalse(tree.has_error)
+        self.assertEqual(tree.summary()["byte_length"], len(data))
+
+    def test_errors(self):
+        def reader(offset, size):
+            raise OSError("connection reset")
+
+        with self.assertRaisesRegex(OSError, "connection reset"):
+            tree_sitter_codon.parse_stream(reader)
+        with self.assertRaises(TypeError):
+            tree_sitter_codon.parse_stream(io.StringIO(self.SOURCE))
+        with self.assertRaises(ValueError):
+            tree_sitter_codon.parse_stream(io.BytesIO(b""), "latin-1")
+
+
+class TestLanguage(TestCase):
+    def test_capsule_is_shared(self):
+        self.assertIs(tree_sitter_codon.language(), tree_sitter_codon.language())
+
+    def test_query_sources(self):
+        self.assertIn("@", tree_sitter_codon.HIGHLIGHTS_QUERY)
+        self.assertIn("@", tree_sitter_codon.TAGS_QUERY)
+        self.assertIn("@", tree_sitter_codon.INJECTIONS_QUERY)
+
+    def test_queries_are_compiled_once(self):
+        try:
+            from tree_sitter import Query
+        except ImportError:
+            self.skipTest("tree-sitter is not installed")
+        query = tree_sitter_codon.highlights_query()
+        self.assertIsInstance(query, Query)
+        self.assertIs(query, tree_sitter_codon.highlights_query())
+        self.assertIsNot(tree_sitter_codon.tags_query(), query)
+
+
+class TestThreads(TestCase):
+    def test_keeps_gil_disabled(self):
+        if not sysconfig.get_config_var("Py_GIL_DISABLED"):
+            self.skipTest("not a free-threaded interpreter")
+        self.assertFalse(sys._is_gil_enabled())
+
+    def test_concurrent_use(self):
+        source = b"def f(x):\n    return x + 1\n" * 50
+        session = tree_sitter_codon.EditSession(b"x = 1\n")
+        cache = tree_sitter_codon.InjectionCache()
+
+        def work(i):
+            tree = tree_sitter_codon.parse(source)
+            session.edit(len(session), len(session), b"y = 2\n")
+            cache.parse(tree_sitter_codon.language(), source, 0, len(source))
+            return tree.summary()["byte_length"]
+
+        with ThreadPoolExecutor(8) as pool:
+            self.assertEqual(set(pool.map(work, range(64))), {len(source)})
+        self.assertEqual(len(session), 6 + 64 * 6)
+        self.assertEqual(cache.hits + cache.misses, 64)
+
+
+class TestParseMany(TestCase):
+    def test_summaries_keep_source_order(self):
+        results = tree_sitter_codon.parse_many([b"x = 1\n", b"def (:\n"], threads=2)
+        self.assertEqual(len(results), 2)
+        self.assertFalse(results[0]["has_error"])
+        self.assertTrue(results[1]["has_error"])
+        self.assertGreater(results[1]["error_count"], 0)
+
+    def test_reads_paths(self):
+        with tempfile.TemporaryDirectory() as directory:
+            path = os.path.join(directory, "a.codon")
+            with open(path, "wb") as file:
+                file.write(b"data |> process\n")
+            [summary] = tree_sitter_codon.parse_many([path])
+        self.assertEqual(summary["byte_length"], 16)
+
+    def test_unreadable_path_gives_exception_instance(self):
+        [result] = tree_sitter_codon.parse_many(["/nonexistent/a.codon"])
+        self.assertIsInstance(result, FileNotFoundError)
+
+    def test_returns_trees(self):
+        [tree] = tree_sitter_codon.parse_many([b"1...10\n"], trees=True)
+        self.assertIsInstance(tree, tree_sitter_codon.Tree)
+        self.assertIn("range_expression", tree.sexp())
+
+
+class TestSummaryCache(TestCase):
+    def test_second_lookup_hits(self):
+        source = b"def f(:\n    return 1\n"
+        with tempfile.TemporaryDirectory() as directory:
+            first = tree_sitter_codon.cached_summary(source, directory)
+            second = tree_sitter_codon.cached_summary(source, directory)
+            self.assertFalse(first["hit"])
+            self.assertTrue(second["hit"])
+            self.assertEqual(first["summary"], second["summary"])
+            self.assertEqual(bytes(first["columns"]), bytes(second["columns"]))
+            self.assertEqual(second["columns"].rows, first["columns"].rows)
+            size = len(tree_sitter_codon.ERROR_FIELDS)
+            self.assertEqual(len(second["errors"]) // size, second["summary"]["error_count"])
+            self.assertEqual(list(second["tags"]), list(tree_sitter_codon.tags(tree_sitter_codon.parse(source))))
+
+    def test_parse_many_reports_cached_summaries(self):
+        with tempfile.TemporaryDirectory() as directory:
+            cache = os.path.join(directory, "cache")
+            [first] = tree_sitter_codon.parse_many([b"x = 1\n"], cache_dir=cache)
+            [second] = tree_sitter_codon.parse_many([b"x = 1\n"], cache_dir=cache)
+        self.assertFalse(first["cached"])
+        self.assertTrue(second["cached"])
+        self.assertEqual(first["node_count"], second["node_count"])
+
+
+class TestScannerStats(TestCase):
+    def setUp(self):
+        try:
+            tree_sitter_codon.reset_scanner_stats()
+        except RuntimeError:
+            self.skipTest("built without CODON_SCANNER_STATS")
+
+    def test_counts_scanner_calls(self):
+        tree_sitter_codon.parse(b'if x:\n    s = "abc"\n')
+        stats = tree_sitter_codon.scanner_stats()
+        self.assertGreater(stats["scan_calls"], 0)
+        self.assertGreater(stats["tokens"]["indent"], 0)
+        self.assertEqual(sum(stats["chars_histogram"]), stats["scan_calls"])
+
+    def test_reset_zeroes_counters(self):
+        tree_sitter_codon.parse(b"x = 1\n")
+        tree_sitter_codon.reset_scanner_stats()
+        self.assertEqual(tree_sitter_codon.scanner_stats()["scan_calls"], 0)
+
+
+class TestPrescan(TestCase):
+    def test_reads_header_records(self):
+        source = (
+            '"""Module."""\n'
+            "## codon: debug = 1\n"
+            "import os, sys.path as sp\n"
+            "from ..pkg import (a,\n    b)\n"
+            "from C import puts(cobj) -> None, strlen: int\n"
+            "from python import numpy as np\n"
+        )
+        records = [(r["kind"], r["name"], r["value"]) for r in tree_sitter_codon.prescan(source)]
+        self.assertEqual(records, [
+            ("directive", "debug", "1"),
+            ("import", "os", ""),
+            ("import", "sys.path", "sp"),
+            ("from_import", "..pkg", "a,\n    b"),
+            ("c_import", "puts", "(cobj) -> None"),
+            ("c_import", "strlen", ": int"),
+            ("python_import", "numpy", "as np"),
+        ])
+
+    def test_stops_at_first_other_statement(self):
+        records = tree_sitter_codon.prescan(b"import a\nx = 1\nimport b\n")
+        self.assertEqual([r["name"] for r in records], ["a"])
+        self.assertEqual(records[0]["end_byte"], len(b"import a"))
+        self.assertEqual(tree_sitter_codon.prescan(b"importlib = 1\n"), [])
+
+
+class TestTags(TestCase):
+    # The shipped parser lexes `## codon:` lines as comments and only reaches
+    # extern functions after another decorator
+    SOURCE = (
+        b"from C import puts, sqrt: float\n"
+        b"class Point:\n"
+        b"    def norm(self) -> float:\n"
+        b"        return 0.0\n"
+        b"@inline\n"
+        b"@llvm\n"
+        b"def add(a: int, b: int) -> int:\n"
+        b"    %r = add i64 %a, %b\n"
+        b"    ret i64 %r\n"
+    )
+
+    def records(self, source):
+        view = tree_sitter_codon.tags(tree_sitter_codon.parse(source))
+        size = len(tree_sitter_codon.TAG_FIELDS)
+        return [
+            dict(zip(tree_sitter_codon.TAG_FIELDS, view[i:i + size]))
+            for i in range(0, len(view), size)
+        ]
+
+    def test_kinds_and_names(self):
+        records = self.records(self.SOURCE)
+        found = [
+            (tree_sitter_codon.TAG_KINDS[r["kind"]],
+             self.SOURCE[r["name_start_byte"]:r["name_end_byte"]])
+            for r in records
+        ]
+        self.assertEqual(found, [
+            ("c_import", b"puts"),
+            ("c_import", b"sqrt"),
+            ("class", b"Point"),
+            ("function", b"norm"),
+            ("llvm_function", b"add"),
+        ])
+
+    def test_parents_and_rows(self):
+        records = self.records(self.SOURCE)
+        self.assertEqual(records[3]["parent"], 2)
+        self.assertEqual(records[2]["parent"], tree_sitter_codon.TAG_NO_PARENT)
+        self.assertEqual((records[2]["start_row"], records[2]["end_row"]), (1, 3))
+
+    def test_empty_tree(self):
+        self.assertEqual(self.records(b"x = 1\n"), [])
+
+
+class TestHighlight(TestCase):
+    source = b"def f(x):\n    return x.Upper\n"
+
+    def test_captures_in_source_order(self):
+        tree = tree_sitter_codon.parse(self.source)
+        records = tree_sitter_codon.highlight(tree, self.source)
+        size = len(tree_sitter_codon.HIGHLIGHT_FIELDS)
+        self.assertGreater(len(records), 0)
+        self.assertEqual(len(records) % size, 0)
+        starts = records[::size]
+        self.assertEqual(list(starts), sorted(starts))
+        names = tree_sitter_codon.highlighter().capture_names
+        self.assertEqual(names[records[2]], "keyword")
+        self.assertEqual(bytes(self.source[records[0]:records[1]]), b"def")
+
+    def test_byte_range_limits_captures(self):
+        tree = tree_sitter_codon.parse(self.source)
+        start = self.source.index(b"return")
+        records = tree_sitter_codon.highlight(tree, self.source, (start, len(self.source)))
+        size = len(tree_sitter_codon.HIGHLIGHT_FIELDS)
+        self.assertGreater(len(records), 0)
+        self.assertTrue(all(end > start for end in records[1::size]))
+
+    def test_evaluates_predicates(self):
+        highlighter = tree_sitter_codon.Highlighter(
+            '((identifier) @constructor (#match? @constructor "^[A-Z]"))'
+            '((identifier) @parameter (#eq? @parameter "x"))'
+            '((identifier) @function (#any-of? @function "f" "g"))'
+        )
+        tree = tree_sitter_codon.parse(self.source)
+        records = memoryview(highlighter.highlight(tree, self.source)).cast("I")
+        found = {
+            bytes(self.source[records[i]:records[i + 1]]): highlighter.capture_names[records[i + 2]]
+            for i in range(0, len(records), 3)
+        }
+        self.assertEqual(found, {b"f": "function", b"x": "parameter", b"Upper": "constructor"})
+
+    def test_rejects_invalid_query(self):
+        with self.assertRaises(ValueError):
+            tree_sitter_codon.Highlighter("(identifier")
+        with self.assertRaises(ValueError):
+            tree_sitter_codon.Highlighter('((identifier) @a (#match? @a))')
+
+
+class TestColumns(TestCase):
+    def column(self, view, name):
+        return view[tree_sitter_codon.COLUMNS.index(name)]
+
+    def test_one_row_per_node(self):
+        tree = tree_sitter_codon.parse(b"x = 1\n")
+        columns = tree_sitter_codon.columns(tree)
+        view = memoryview(columns)
+        self.assertEqual(view.format, "I")
+        self.assertEqual(view.shape, (len(tree_sitter_codon.COLUMNS), columns.rows))
+        self.assertEqual(columns.rows, tree.summary()["node_count"])
+
+        names = tree_sitter_codon.symbol_names()
+        fields = tree_sitter_codon.field_names()
+        rows = view.tolist()
+        symbols = [names[s] for s in self.column(rows, "symbol")]
+        self.assertEqual(symbols, ["module", "expression_statement", "assignment", "identifier", "=", "integer"])
+        self.assertEqual(self.column(rows, "parent"), [0xFFFFFFFF, 0, 1, 2, 2, 2])
+        self.assertEqual([fields[f] for f in self.column(rows, "field")][3:], ["left", None, "right"])
+        self.assertEqual(self.column(rows, "end_byte")[0], 6)
+
+    def test_named_only(self):
+        tree = tree_sitter_codon.parse(b"x = 1\n")
+        rows = memoryview(tree_sitter_codon.columns(tree, named_only=True)).tolist()
+        names = tree_sitter_codon.symbol_names()
+        self.assertNotIn("=", [names[s] for s in self.column(rows, "symbol")])
+        self.assertEqual(self.column(rows, "parent"), [0xFFFFFFFF, 0, 1, 2, 2])
+
+    def test_read_only(self):
+        columns = tree_sitter_codon.columns(tree_sitter_codon.parse(b"x = 1\n"))
+        with self.assertRaises(TypeError):
+            memoryview(columns)[0, 0] = 1
+
+
+class TestEditSession(TestCase):
+    def test_edits_and_reparses(self):
+        session = tree_sitter_codon.EditSession("def f():\n    return 1\n")
+        self.assertFalse(session.tree.has_error)
+        ranges = session.edit(4, 5, "g")
+        self.assertEqual(session.text(), b"def g():\n    return 1\n")
+        self.assertEqual(len(session), 22)
+        for start, end, start_point, end_point in ranges:
+            self.assertLessEqual(start, 4)
+            self.assertGreaterEqual(end, 5)
+
+    def test_typing_keeps_tree_in_sync(self):
+        session = tree_sitter_codon.EditSession(b"")
+        text = "x = [1, 2]\ny = x |> len\n"
+        for i, character in enumerate(text):
+            session.edit(i, i, character)
+        self.assertEqual(session.text(), text.encode())
+        fresh = tree_sitter_codon.parse(text.encode())
+        self.assertEqual(session.tree.sexp(), fresh.sexp())
+
+    def test_breaking_edit_reports_error(self):
+        session = tree_sitter_codon.EditSession(b"x = (1)\n")
+        session.edit(6, 7, b"")
+        self.assertTrue(session.tree.has_error)
+
+    def test_rejects_out_of_range(self):
+        session = tree_sitter_codon.EditSession(b"x = 1\n")
+        with self.assertRaises(IndexError):
+            session.edit(3, 2, "")
+        with self.assertRaises(IndexError):
+            session.edit(0, 7, "")
+
+
+class TestInjectionCache(TestCase):
+    # Codon parses Python well enough to stand in for the Python grammar
+    SOURCE = b"@inline\n@python\ndef f():\n    x = 1\n    if x:\n        y()\n"
+
+    def region(self, source):
+        return source.index(b"x = 1"), len(source)
+
+    def test_parses_indented_body_as_module(self):
+        cache = tree_sitter_codon.InjectionCache()
+        start, end = self.region(self.SOURCE)
+        tree = cache.parse(tree_sitter_codon.language(), self.SOURCE, start, end)
+        self.assertFalse(tree.has_error)
+        self.assertEqual(tree.sexp().count("if_statement"), 1)
+        self.assertEqual(tree.summary()["byte_length"], end - start)
+
+    def test_reuses_tree_for_unchanged_text(self):
+        cache = tree_sitter_codon.InjectionCache()
+        language = tree_sitter_codon.language()
+        start, end = self.region(self.SOURCE)
+        cache.parse(language, self.SOURCE, start, end)
+        moved = b"import os\n\n" + self.SOURCE
+        cache.parse(language, moved, *self.region(moved))
+        self.assertEqual((cache.hits, cache.misses), (1, 1))
+
+    def test_rejects_bad_region(self):
+        cache = tree_sitter_codon.InjectionCache()
+        with self.assertRaises(IndexError):
+            cache.parse(tree_sitter_codon.language(), self.SOURCE, 10, 5)
+
+    def test_budget_evicts_trees(self):
+        language = tree_sitter_codon.language()
+        sources = [b"@inline\n@python\ndef f():\n    x = %d\n" % i for i in range(4)]
+        one = tree_sitter_codon.parse(sources[0][sources[0].index(b"x"):]).memory()["total_bytes"]
+        cache = tree_sitter_codon.InjectionCache(budget=2 * one)
+        for source in sources:
+            cache.parse(language, source, source.index(b"x"), len(source))
+        self.assertLessEqual(cache.bytes, 2 * one)
+        cache.parse(language, sources[0], sources[0].index(b"x"), len(sources[0]))
+        self.assertEqual(cache.hits, 0)
+
+
+class TestTreeMemory(TestCase):
+    def test_grows_with_the_tree(self):
+        small = tree_sitter_codon.parse(b"x = 1\n").memory()
+        large = tree_sitter_codon.parse(b"def f(x):\n    return x |> g\n" * 100).memory()
+        self.assertGreater(small["total_bytes"], 0)
+        self.assertGreater(large["total_bytes"], 50 * small["total_bytes"])
+        self.assertGreaterEqual(
+            large["total_bytes"], large["subtree_bytes"] + large["scanner_state_bytes"]
+        )
+
+
+class TestTreeCache(TestCase):
+    SOURCES = {f"file{i}.codon": f"def f{i}(x):\n    return x + {i}\n" for i in range(8)}
+
+    def budget(self, count):
+        name = next(iter(self.SOURCES))
+        return count * tree_sitter_codon.parse(self.SOURCES[name].encode()).memory()["total_bytes"]
+
+    def test_evicts_least_recently_used(self):
+        cache = tree_sitter_codon.TreeCache(self.budget(3))
+        for name, source in self.SOURCES.items():
+            cache.put(name, tree_sitter_codon.parse(source.encode()))
+            # Keep the first file warm
+            cache.get("file0.codon")
+        self.assertEqual(len(cache), 3)
+        self.assertLessEqual(cache.bytes, cache.budget)
+        self.assertIsNotNone(cache.get("file0.codon"))
+        self.assertIsNone(cache.get("file1.codon"))
+        self.assertIsNotNone(cache.get("file7.codon"))
+        self.assertEqual(cache.evictions, 5)
+
+    def test_rebuilds_evicted_trees_with_loader(self):
+        loaded = []
+
+        def load(name):
+            loaded.append(name)
+            return self.SOURCES.get(name)
+
+        cache = tree_sitter_codon.TreeCache(self.budget(2), load)
+        for name in self.SOURCES:
+            self.assertFalse(cache.get(name).has_error)
+        self.assertEqual(len(cache), 2)
+        tree = cache.get("file0.codon")
+        self.assertEqual(tree.summary()["byte_length"], len(self.SOURCES["file0.codon"]))
+        self.assertEqual(loaded.count("file0.codon"), 2)
+        self.assertIsNone(cache.get("missing.codon"))
+
+    def test_lowering_budget_evicts(self):
+        cache = tree_sitter_codon.TreeCache(0)
+        for name, source in self.SOURCES.items():
+            cache.put(name, tree_sitter_codon.parse(source.encode()))
+        self.assertEqual(len(cache), len(self.SOURCES))
+        cache.budget = 1
+        # The budget is below one tree, and nothing was just added
+        self.assertEqual(len(cache), 0)
+        self.assertEqual(cache.bytes, 0)
+
+    def test_remove_and_bad_keys(self):
+        cache = tree_sitter_codon.TreeCache(0)
+        cache.put(b"a", tree_sitter_codon.parse(b"x = 1\n"))
+        self.assertTrue(cache.remove(b"a"))
+        self.assertFalse(cache.remove(b"a"))
+        with self.assertRaises(TypeError):
+            cache.get(1)
+        with self.assertRaises(TypeError):
+            cache.put("a", object())
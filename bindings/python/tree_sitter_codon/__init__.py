@@ -5,15 +5,69 @@ Codon is a high-performance Python compiler from Exaloop.
 https://docs.exaloop.io/
 """
 
+import os as _os
+import threading as _threading
 from importlib.resources import files as _files
 
+from ._binding import COLUMNS, TAG_KINDS, Columns, EditSession, Highlighter, InjectionCache, ParseJob, Tree, TreeCache
+from ._binding import cached_summary as _cached_summary
+from ._binding import field_names as _field_names
 from ._binding import language as _language
+from ._binding import parse as _parse
+from ._binding import parse_many as _parse_many
+from ._binding import parse_stream as _parse_stream
+from ._binding import parse_with_stats as _parse_with_stats
+from ._binding import prescan as _prescan
+from ._binding import reset_scanner_stats as _reset_scanner_stats
+from ._binding import scanner_stats as _scanner_stats
+from ._binding import symbol_names as _symbol_names
+
+
+_QUERY_FILES = {
+    "HIGHLIGHTS_QUERY": "highlights.scm",
+    "INJECTIONS_QUERY": "injections.scm",
+    "TAGS_QUERY": "tags.scm",
+}
+
+_ts_language = None
+_queries = {}
+_queries_lock = _threading.Lock()
 
 
 def _get_query(name: str, filename: str) -> str:
     """Load a query file from the queries directory."""
     query_path = _files("tree_sitter_codon") / "queries" / filename
-    return query_path.read_text()
+    if not query_path.is_file():
+        # Editable installs run from the checkout, where the queries live
+        # at the root
+        query_path = _files("tree_sitter_codon") / ".." / ".." / ".." / "queries" / filename
+    globals()[name] = query_path.read_text()
+    return globals()[name]
+
+
+def __getattr__(name):
+    # HIGHLIGHTS_QUERY, INJECTIONS_QUERY and TAGS_QUERY are read on first use
+    if name in _QUERY_FILES:
+        return _get_query(name, _QUERY_FILES[name])
+    raise AttributeError(f"module {__name__!r} has no attribute {name!r}")
+
+
+def _query(name):
+    # Compiling a query walks the whole parse table, so each one is
+    # compiled once per process and shared
+    global _ts_language
+    query = _queries.get(name)
+    if query is None:
+        with _queries_lock:
+            query = _queries.get(name)
+            if query is None:
+                from tree_sitter import Language, Query
+
+                if _ts_language is None:
+                    _ts_language = Language(_language())
+                query = Query(_ts_language, __getattr__(name))
+                _queries[name] = query
+    return query
 
 
 def language():
@@ -32,5 +86,460 @@ def language():
     return _language()
 
 
-__all__ = ["language"]
+def highlights_query():
+    """Get the compiled ``highlights.scm`` query.
+
+    The query is compiled on first use and the same ``tree_sitter.Query``
+    is returned afterwards, to every caller and thread.
+
+    Example:
+        >>> from tree_sitter import QueryCursor
+        >>> cursor = QueryCursor(tree_sitter_codon.highlights_query())
+        >>> captures = cursor.captures(tree.root_node)
+    """
+    return _query("HIGHLIGHTS_QUERY")
+
+
+def injections_query():
+    """Get the compiled ``injections.scm`` query, shared like
+    :func:`highlights_query`."""
+    return _query("INJECTIONS_QUERY")
+
+
+def tags_query():
+    """Get the compiled ``tags.scm`` query, shared like
+    :func:`highlights_query`."""
+    return _query("TAGS_QUERY")
+
+
+def parse(source):
+    """Parse a buffer in place, without copying it.
+
+    Args:
+        source: Any object supporting the buffer protocol, such as
+            ``bytes``, ``bytearray``, ``memoryview`` or ``mmap.mmap``.
+
+    Returns:
+        A :class:`Tree`. The buffer stays exported while the tree is alive,
+        so a ``bytearray`` cannot be resized and an ``mmap`` cannot be
+        closed until the tree is released.
+
+    Example:
+        >>> import mmap, tree_sitter_codon
+        >>> with open("kernel.codon", "rb") as f:
+        ...     source = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        >>> tree = tree_sitter_codon.parse(source)
+    """
+    return _parse(source)
+
+
+def parse_with_stats(source):
+    """Parse like :func:`parse` and profile the parse.
+
+    The counts come from the tree-sitter parse log, which makes the parse
+    several times slower, so use it to find out why a file is slow rather
+    than on every parse. For incremental reparses, where subtree reuse is
+    what matters, see :meth:`EditSession.edit_with_stats`.
+
+    Args:
+        source: Any object supporting the buffer protocol.
+
+    Returns:
+        ``(tree, stats)``. ``stats`` is a dict of counts: parser ``steps``,
+        ``forked_steps`` taken with more than one GLR version alive,
+        ``forks`` and the ``max_versions`` alive at once, ``lex_calls`` and
+        the ``external_lex_calls`` among them, ``shifts``, ``reductions``,
+        ``reused_nodes``, ``errors_detected`` and error ``recoveries``.
+        ``reductions_by_symbol`` maps node type names to the reductions to
+        them, which points at the rules a slow file spends its time in.
+
+    Example:
+        >>> import tree_sitter_codon
+        >>> tree, stats = tree_sitter_codon.parse_with_stats(b"x = a |> f |> g\n")
+        >>> stats["reductions_by_symbol"]["pipe_expression"]
+        2
+    """
+    return _parse_with_stats(source)
+
+
+def parse_in_slices(source, budget=0.05, progress=None, old_tree=None):
+    """Parse in time slices, reporting progress between them.
+
+    Each slice parses for about ``budget`` seconds without the GIL, then
+    the parser stops where it is and the next slice resumes from there, so
+    a UI thread can keep drawing while a 50 MB file parses. For control of
+    each slice, use :class:`ParseJob` directly.
+
+    Args:
+        source: A ``str`` or buffer-protocol object.
+        budget: Seconds per slice.
+        progress: Called with the :class:`ParseJob` after every slice that
+            did not finish the parse. ``job.offset / len(job)`` is how far
+            it has got, and ``job.partial()`` parses the statements before
+            that point to show something early. Returning ``False`` stops
+            the parse.
+        old_tree: A :class:`Tree` of the previous version of the source,
+            already edited to match it, to reparse incrementally.
+
+    Returns:
+        The :class:`Tree`, or ``None`` if ``progress`` stopped the parse.
+
+    Example:
+        >>> import tree_sitter_codon
+        >>> shown = []
+        >>> def report(job):
+        ...     if not shown:
+        ...         shown.append(job.partial())
+        >>> tree = tree_sitter_codon.parse_in_slices(source, 0.01, report)
+    """
+    job = ParseJob(source, old_tree)
+    while not job.run(budget):
+        if progress is not None and progress(job) is False:
+            return None
+    return job.tree
+
+
+def parse_stream(source, encoding="utf-8", chunk_size=1 << 18):
+    """Parse a source read chunk by chunk, without holding it in memory.
+
+    The parser reads through one buffer of ``chunk_size`` bytes that is
+    reused for every chunk, and runs without the GIL between reads. The
+    lexer sometimes steps back a little. The last quarter of the buffer is
+    kept for that, so a non-seekable stream is still read just once, front
+    to back.
+
+    Args:
+        source: A binary file-like object, parsed from its current
+            position. ``readinto`` fills the buffer in place when it
+            exists; otherwise ``read(size)`` is used. Or a callable
+            ``reader(offset, size)`` returning up to ``size`` bytes at byte
+            ``offset``, and ``b""`` or ``None`` at the end.
+        encoding: ``"utf-8"``, ``"utf-16-le"`` or ``"utf-16-be"``. Offsets
+            in the tree are byte offsets in this encoding.
+        chunk_size: Bytes per read.
+
+    Returns:
+        A :class:`Tree`. It holds no reference to the source.
+
+    Raises:
+        Whatever the source raises, which stops the parse.
+
+    Example:
+        >>> import gzip, tree_sitter_codon
+        >>> with gzip.open("generated.codon.gz") as f:
+        ...     tree = tree_sitter_codon.parse_stream(f, chunk_size=1 << 20)
+    """
+    return _parse_stream(source, encoding, chunk_size)
+
+
+def parse_many(sources, threads=None, trees=False, cache_dir=None):
+    """Parse many files or buffers in parallel without holding the GIL.
+
+    Each worker thread parses with its own native parser, and parsers are
+    reused across calls.
+
+    Args:
+        sources: Paths (``str`` or ``os.PathLike``) to read, or
+            buffer-protocol objects to parse in place.
+        threads: Number of worker threads. Defaults to ``os.cpu_count()``.
+        trees: Return :class:`Tree` objects instead of summaries.
+        cache_dir: Directory of the summary cache (see
+            :func:`cached_summary`). Summaries of unchanged sources are read
+            from it without parsing. Ignored when ``trees`` is true.
+
+    Returns:
+        A list in source order. Each entry is a summary dict with
+        ``node_count``, ``error_count``, ``byte_length`` and ``has_error``
+        (or a :class:`Tree` when ``trees`` is true), plus ``cached`` when
+        ``cache_dir`` is given. Sources that could not be read give an
+        ``OSError`` instance instead.
+
+    Example:
+        >>> import tree_sitter_codon
+        >>> results = tree_sitter_codon.parse_many(["a.codon", b"x = 1\\n"])
+        >>> results[1]["has_error"]
+        False
+    """
+    if threads is None:
+        threads = _os.cpu_count() or 1
+    items = [
+        _os.fsdecode(source) if isinstance(source, _os.PathLike) else source
+        for source in sources
+    ]
+    if cache_dir is not None and not trees:
+        _os.makedirs(cache_dir, exist_ok=True)
+    return _parse_many(items, threads, trees, cache_dir)
+
+
+ERROR_FIELDS = ("start_byte", "end_byte", "start_row", "start_column")
+"""Fields of each record in the ``errors`` of :func:`cached_summary`."""
+
+
+def cached_summary(source, cache_dir):
+    """Summarize a source through an on-disk, content-addressed cache.
+
+    Entries are keyed by a hash of the source together with a fingerprint
+    of the grammar and the external scanner, so regenerating the parser
+    invalidates them without any cleanup. A hit maps the entry file and
+    parses nothing. A miss parses the source and writes the entry; if the
+    directory is not writable the result is still returned.
+
+    Args:
+        source: A ``str`` or any object supporting the buffer protocol.
+        cache_dir: Directory holding the entries. Created if missing.
+
+    Returns:
+        A dict with ``hit``, the ``summary`` dict of :func:`parse_many`,
+        ``columns`` (a :class:`Columns` of the named nodes, read straight
+        from the mapped file), ``errors`` (a flat ``memoryview`` of
+        unsigned ints, ``len(ERROR_FIELDS)`` per ERROR or MISSING node) and
+        ``tags`` (as returned by :func:`tags`).
+
+    Example:
+        >>> import tree_sitter_codon
+        >>> source = open("kernel.codon", "rb").read()
+        >>> result = tree_sitter_codon.cached_summary(source, ".codon-cache")
+        >>> result["summary"]["has_error"], result["hit"]
+        (False, True)
+    """
+    _os.makedirs(cache_dir, exist_ok=True)
+    result = _cached_summary(source, cache_dir)
+    result["errors"] = memoryview(result["errors"]).cast("I")
+    result["tags"] = memoryview(result["tags"]).cast("I")
+    return result
+
+
+TAG_FIELDS = (
+    "kind",
+    "parent",
+    "name_start_byte",
+    "name_end_byte",
+    "start_byte",
+    "end_byte",
+    "start_row",
+    "end_row",
+)
+"""Fields of each record returned by :func:`tags`, in order."""
+
+TAG_NO_PARENT = 0xFFFFFFFF
+"""``parent`` of top-level definitions."""
+
+
+def prescan(source):
+    """Read the directives and imports at the top of a source.
+
+    A dedicated lexer reads statements from the top of the file and stops
+    at the first one that is not an import, a ``## codon:`` directive or a
+    bare string such as the module docstring, so nothing after the header
+    is looked at. Build tools can use it to find dependencies and flags
+    far faster than a full :func:`parse`.
+
+    Args:
+        source: A ``str`` or any object supporting the buffer protocol.
+
+    Returns:
+        A list of dicts in source order, each with ``kind``, ``name``,
+        ``value``, ``start_byte``, ``end_byte`` and ``row``. ``kind`` is
+        ``"directive"`` (``name = value``), ``"import"`` (``value`` is the
+        alias), ``"from_import"`` (``name`` is the module, ``value`` the
+        imported names), or ``"c_import"`` or ``"python_import"``, one per
+        name in a ``from C import`` or ``from python import`` with
+        ``value`` holding its type, signature or alias. ``value`` is empty
+        when absent. Byte offsets are into the (UTF-8 encoded) source.
+
+    Example:
+        >>> import tree_sitter_codon
+        >>> source = "## codon: debug = 1\\nimport os\\nfrom C import puts(cobj)\\nx = 1\\n"
+        >>> [(r["kind"], r["name"], r["value"]) for r in tree_sitter_codon.prescan(source)]
+        [('directive', 'debug', '1'), ('import', 'os', ''), ('c_import', 'puts', '(cobj)')]
+    """
+    return _prescan(source)
+
+
+def tags(tree):
+    """Extract the definitions of a tree in one native pass.
+
+    Reports the definitions matched by ``queries/tags.scm``: functions,
+    classes, ``@llvm`` and ``@python`` extern functions and each name of a
+    ``from C import``. No Python objects are created per definition.
+
+    Args:
+        tree: A :class:`Tree` from :func:`parse` or :func:`parse_many`.
+
+    Returns:
+        A flat ``memoryview`` of unsigned ints holding one record of
+        ``len(TAG_FIELDS)`` values per definition, in source order.
+        ``kind`` indexes :data:`TAG_KINDS`, ``parent`` is the record index
+        of the enclosing function or class (or :data:`TAG_NO_PARENT`), and
+        ranges are byte offsets into the source.
+
+    Example:
+        >>> import tree_sitter_codon
+        >>> source = b"class A:\n    def f(self): pass\n"
+        >>> records = tree_sitter_codon.tags(tree_sitter_codon.parse(source))
+        >>> size = len(tree_sitter_codon.TAG_FIELDS)
+        >>> [tree_sitter_codon.TAG_KINDS[k] for k in records[::size]]
+        ['class', 'function']
+    """
+    return memoryview(tree.tags()).cast("I")
+
+
+HIGHLIGHT_FIELDS = ("start_byte", "end_byte", "capture")
+"""Fields of each record returned by :func:`highlight`, in order."""
+
+
+def highlighter():
+    """Get the shared :class:`Highlighter` for ``queries/highlights.scm``.
+
+    It is compiled on first use. Its ``capture_names`` map the capture ids
+    of :func:`highlight` to names such as ``"keyword"``.
+    """
+    highlighter = _queries.get("highlighter")
+    if highlighter is None:
+        with _queries_lock:
+            highlighter = _queries.get("highlighter")
+            if highlighter is None:
+                highlighter = Highlighter(__getattr__("HIGHLIGHTS_QUERY"))
+                _queries["highlighter"] = highlighter
+    return highlighter
+
+
+def highlight(tree, source, byte_range=None):
+    """Highlight a tree in one native pass, without holding the GIL.
+
+    The highlights query runs natively and its ``#eq?``, ``#match?`` and
+    ``#any-of?`` predicates are evaluated in C, so no Python objects are
+    created per capture.
+
+    Args:
+        tree: A :class:`Tree` from :func:`parse` or :func:`parse_many`.
+        source: The buffer ``tree`` was parsed from.
+        byte_range: ``(start, end)`` of the region to highlight, such as
+            the visible part of an editor. Defaults to the whole source.
+
+    Returns:
+        A flat ``memoryview`` of unsigned ints holding one record of
+        ``len(HIGHLIGHT_FIELDS)`` values per capture, ordered by start.
+        Nodes that overlap ``byte_range`` are reported whole. ``capture``
+        indexes ``highlighter().capture_names``; a node captured by several
+        patterns gets the capture of the first.
+
+    Example:
+        >>> import tree_sitter_codon
+        >>> source = b"def f(): pass\n"
+        >>> records = tree_sitter_codon.highlight(tree_sitter_codon.parse(source), source)
+        >>> names = tree_sitter_codon.highlighter().capture_names
+        >>> names[records[2]]
+        'keyword'
+    """
+    start, end = byte_range if byte_range is not None else (0, 0xFFFFFFFF)
+    return memoryview(highlighter().highlight(tree, source, start, end)).cast("I")
+
+
+def columns(tree, named_only=False):
+    """Export every node of a tree as columns in one native pass.
+
+    Args:
+        tree: A :class:`Tree` from :func:`parse` or :func:`parse_many`.
+        named_only: Leave out anonymous nodes (punctuation and keywords).
+            Parents are then the nearest named ancestor.
+
+    Returns:
+        A :class:`Columns` buffer of unsigned 32-bit ints with shape
+        ``(len(COLUMNS), rows)``, one row per node in pre-order. Pass it to
+        ``numpy.asarray`` or ``memoryview`` to read it without a copy.
+        ``symbol`` indexes :func:`symbol_names` (``ERROR`` nodes are
+        ``0xFFFF``), ``parent`` is a row index (root is ``0xFFFFFFFF``) and
+        ``field`` indexes :func:`field_names`.
+
+    Example:
+        >>> import numpy, tree_sitter_codon
+        >>> tree = tree_sitter_codon.parse(b"x = 1\n")
+        >>> symbol, parent, *_ = numpy.asarray(tree_sitter_codon.columns(tree))
+        >>> names = tree_sitter_codon.symbol_names()
+        >>> [names[s] for s in symbol[:3]]
+        ['module', 'expression_statement', 'assignment']
+    """
+    return tree.columns(named_only=named_only)
+
+
+def symbol_names():
+    """Node type names, as in ``node-types.json``, indexed by symbol id."""
+    return _symbol_names()
+
+
+def field_names():
+    """Field names indexed by field id. Id 0, for no field, is ``None``."""
+    return _field_names()
+
+
+def scanner_stats():
+    """Read the external scanner counters.
+
+    The counters are only compiled in when the extension is built with
+    ``CODON_SCANNER_STATS=1`` in the environment. They are kept per scanner
+    instance and summed over every scanner in the process, including
+    those of parsers that have since been deleted.
+
+    Returns:
+        A dict of counts: ``scan_calls``, calls per scanning branch
+        (``string_calls``, ``newline_calls``, ``pending_dedent_calls``),
+        ``error_recovery_calls``, ``tokens`` by external token name,
+        ``wasted_calls`` and ``wasted_chars`` for calls that advanced but
+        returned no token, ``chars`` consumed and a ``chars_histogram`` of
+        calls by characters consumed (0, 1, 2-3, 4-7, ...), and
+        ``serialize_*``/``deserialize_*`` calls and bytes.
+
+    Raises:
+        RuntimeError: The extension was built without the counters.
+    """
+    return _scanner_stats()
+
+
+def reset_scanner_stats():
+    """Zero the external scanner counters.
+
+    Raises:
+        RuntimeError: The extension was built without the counters.
+    """
+    _reset_scanner_stats()
+
+
+__all__ = [
+    "COLUMNS",
+    "Columns",
+    "ERROR_FIELDS",
+    "EditSession",
+    "HIGHLIGHTS_QUERY",
+    "HIGHLIGHT_FIELDS",
+    "Highlighter",
+    "INJECTIONS_QUERY",
+    "InjectionCache",
+    "ParseJob",
+    "TAG_FIELDS",
+    "TAG_KINDS",
+    "TAG_NO_PARENT",
+    "TAGS_QUERY",
+    "Tree",
+    "TreeCache",
+    "cached_summary",
+    "columns",
+    "field_names",
+    "highlight",
+    "highlighter",
+    "highlights_query",
+    "injections_query",
+    "language",
+    "parse",
+    "parse_in_slices",
+    "parse_many",
+    "parse_stream",
+    "parse_with_stats",
+    "prescan",
+    "reset_scanner_stats",
+    "scanner_stats",
+    "symbol_names",
+    "tags",
+    "tags_query",
+]
 __version__ = "0.1.0"
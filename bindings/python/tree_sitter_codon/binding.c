@@ -1,40 +1,2209 @@
 /**
  * Tree-sitter Codon Python binding.
  * 
- * This module exposes the Codon tree-sitter language to Python.
+ * This module exposes the Codon tree-sitter language to Python, plus a
+ * native API that parses without holding the GIL. Sources can be any
+ * buffer-protocol object and are parsed in place, without a copy.
  */
 
 #include <Python.h>
 
-// Forward declaration - implemented in parser.c
-const void *tree_sitter_codon(void);
+#include <stddef.h>
+#include <string.h>
+
+#include "codon.h"
+
+// Per-module state, so each interpreter that imports the module gets its
+// own types and parsers
+typedef struct {
+    PyObject *tree_type;
+    PyObject *columns_type;
+    PyObject *edit_session_type;
+    PyObject *injection_cache_type;
+    PyObject *highlighter_type;
+    PyObject *tree_cache_type;
+    PyObject *parse_job_type;
+    // Created once at import, so every Language built from it wraps the
+    // same capsule
+    PyObject *language_capsule;
+    // Parsers shared by every native parse in the interpreter. The pool is
+    // locked only to take or return a parser, never while parsing.
+    CodonParserPool parser_pool;
+} ModuleState;
+
+static ModuleState *
+module_state(PyObject *module)
+{
+    return (ModuleState *)PyModule_GetState(module);
+}
+
+// State of the module that defined `type`, for methods of its instances
+static ModuleState *
+type_state(PyTypeObject *type)
+{
+    return (ModuleState *)PyType_GetModuleState(type);
+}
 
 static PyObject *
 py_language(PyObject *self, PyObject *args)
 {
-    return PyCapsule_New((void *)tree_sitter_codon(), "tree_sitter.Language", NULL);
+    ModuleState *state = module_state(self);
+    Py_INCREF(state->language_capsule);
+    return state->language_capsule;
+}
+
+/* Columns */
+
+// Read-only (CODON_COLUMN_COUNT, rows) uint32 array exported through the
+// buffer protocol
+typedef struct {
+    PyObject_HEAD
+    uint32_t *data;   // PyMem_Malloc'd unless owned by `owner`
+    PyObject *owner;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+} Columns;
+
+static PyObject *
+columns_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    PyErr_SetString(PyExc_TypeError, "Columns objects are created by Tree.columns");
+    return NULL;
+}
+
+static void
+columns_dealloc(Columns *self)
+{
+    PyTypeObject *type = Py_TYPE((PyObject *)self);
+    if (self->owner != NULL) {
+        Py_DECREF(self->owner);
+    } else {
+        PyMem_Free(self->data);
+    }
+    freefunc tp_free = (freefunc)PyType_GetSlot(type, Py_tp_free);
+    tp_free(self);
+    Py_DECREF(type);
+}
+
+static int
+columns_getbuffer(Columns *self, Py_buffer *view, int flags)
+{
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "columns are read-only");
+        view->obj = NULL;
+        return -1;
+    }
+    Py_INCREF((PyObject *)self);
+    view->obj = (PyObject *)self;
+    view->buf = self->data;
+    view->len = self->shape[0] * self->shape[1] * (Py_ssize_t)sizeof(uint32_t);
+    view->readonly = 1;
+    view->itemsize = sizeof(uint32_t);
+    view->format = (flags & PyBUF_FORMAT) ? "I" : NULL;
+    // Consumers that do not ask for a shape see flat bytes
+    view->ndim = (flags & PyBUF_ND) ? 2 : 1;
+    view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static PyObject *
+columns_get_rows(Columns *self, void *closure)
+{
+    return PyLong_FromSsize_t(self->shape[1]);
+}
+
+static PyGetSetDef columns_getset[] = {
+    {"rows", (getter)columns_get_rows, NULL, "Number of nodes.", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyType_Slot columns_slots[] = {
+    {Py_tp_doc, "Per-node columns of a tree, as a (columns, rows) uint32 buffer."},
+    {Py_tp_new, columns_new},
+    {Py_tp_dealloc, columns_dealloc},
+    {Py_tp_getset, columns_getset},
+    {Py_bf_getbuffer, columns_getbuffer},
+    {0, NULL}
+};
+
+static PyType_Spec columns_spec = {
+    "tree_sitter_codon._binding.Columns",
+    sizeof(Columns),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    columns_slots
+};
+
+/* Tree */
+
+typedef struct {
+    PyObject_HEAD
+    TSTree *tree;
+    // The parsed buffer stays exported (and so cannot be resized or
+    // closed) for the lifetime of the tree
+    Py_buffer source;
+    bool has_source;
+} Tree;
+
+// Takes ownership of `tree` and, when given, of the `source` view
+static PyObject *
+tree_wrap(ModuleState *state, TSTree *tree, Py_buffer *source)
+{
+    PyTypeObject *type = (PyTypeObject *)state->tree_type;
+    allocfunc alloc = (allocfunc)PyType_GetSlot(type, Py_tp_alloc);
+    Tree *self = (Tree *)alloc(type, 0);
+    if (self == NULL) {
+        ts_tree_delete(tree);
+        if (source != NULL) PyBuffer_Release(source);
+        return NULL;
+    }
+    self->tree = tree;
+    self->has_source = source != NULL;
+    if (source != NULL) self->source = *source;
+    return (PyObject *)self;
+}
+
+static PyObject *
+tree_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    PyErr_SetString(PyExc_TypeError, "Tree objects are created by the parse functions");
+    return NULL;
+}
+
+static void
+tree_dealloc(Tree *self)
+{
+    PyTypeObject *type = Py_TYPE((PyObject *)self);
+    ts_tree_delete(self->tree);
+    if (self->has_source) PyBuffer_Release(&self->source);
+    freefunc tp_free = (freefunc)PyType_GetSlot(type, Py_tp_free);
+    tp_free(self);
+    Py_DECREF(type);
+}
+
+static PyObject *
+summary_to_dict(const CodonSummary *summary)
+{
+    return Py_BuildValue(
+        "{sIsIsIsO}",
+        "node_count", summary->node_count,
+        "error_count", summary->error_count,
+        "byte_length", summary->byte_length,
+        "has_error", summary->has_error ? Py_True : Py_False
+    );
+}
+
+static PyObject *
+tree_summary(Tree *self, PyObject *args)
+{
+    CodonSummary summary;
+    codon_summarize(self->tree, &summary);
+    return summary_to_dict(&summary);
+}
+
+static PyObject *
+tree_sexp(Tree *self, PyObject *args)
+{
+    char *string = ts_node_string(ts_tree_root_node(self->tree));
+    PyObject *result = PyUnicode_FromString(string);
+    free(string);
+    return result;
+}
+
+static PyObject *
+tree_get_has_error(Tree *self, void *closure)
+{
+    return PyBool_FromLong(ts_node_has_error(ts_tree_root_node(self->tree)));
+}
+
+// Packed CodonTag records, eight native-endian uint32 each
+static PyObject *
+tree_tags(Tree *self, PyObject *args)
+{
+    CodonTagList list = {NULL, 0, 0};
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = codon_tags(self->tree, &list);
+    Py_END_ALLOW_THREADS
+
+    if (!ok) {
+        codon_tag_list_delete(&list);
+        return PyErr_NoMemory();
+    }
+    PyObject *result = PyBytes_FromStringAndSize(
+        (const char *)list.tags, (Py_ssize_t)list.size * (Py_ssize_t)sizeof(CodonTag)
+    );
+    codon_tag_list_delete(&list);
+    return result;
+}
+
+static PyObject *
+tree_columns(Tree *self, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = {"named_only", NULL};
+    int named_only = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|p", keywords, &named_only)) return NULL;
+
+    uint32_t capacity = codon_columns_capacity(self->tree);
+    uint32_t *data = PyMem_Malloc((size_t)capacity * CODON_COLUMN_COUNT * sizeof(uint32_t));
+    if (data == NULL) return PyErr_NoMemory();
+    uint32_t rows;
+    Py_BEGIN_ALLOW_THREADS
+    rows = codon_columns(self->tree, named_only, capacity, data);
+    Py_END_ALLOW_THREADS
+    if (rows == UINT32_MAX) {
+        PyMem_Free(data);
+        return PyErr_NoMemory();
+    }
+
+    PyTypeObject *type = (PyTypeObject *)type_state(Py_TYPE((PyObject *)self))->columns_type;
+    allocfunc alloc = (allocfunc)PyType_GetSlot(type, Py_tp_alloc);
+    Columns *columns = (Columns *)alloc(type, 0);
+    if (columns == NULL) {
+        PyMem_Free(data);
+        return NULL;
+    }
+    columns->data = data;
+    columns->shape[0] = CODON_COLUMN_COUNT;
+    columns->shape[1] = rows;
+    columns->strides[0] = (Py_ssize_t)rows * (Py_ssize_t)sizeof(uint32_t);
+    columns->strides[1] = sizeof(uint32_t);
+    return (PyObject *)columns;
+}
+
+static PyObject *
+memory_to_dict(const CodonTreeMemory *memory)
+{
+    return Py_BuildValue(
+        "{s:K,s:K,s:K,s:K,s:K}",
+        "heap_subtrees", (unsigned long long)memory->heap_subtrees,
+        "inline_subtrees", (unsigned long long)memory->inline_subtrees,
+        "subtree_bytes", (unsigned long long)memory->subtree_bytes,
+        "scanner_state_bytes", (unsigned long long)memory->scanner_state_bytes,
+        "total_bytes", (unsigned long long)memory->total_bytes
+    );
+}
+
+static PyObject *
+tree_memory(Tree *self, PyObject *args)
+{
+    CodonTreeMemory memory;
+    Py_BEGIN_ALLOW_THREADS
+    codon_tree_memory(self->tree, &memory);
+    Py_END_ALLOW_THREADS
+    return memory_to_dict(&memory);
+}
+
+static PyMethodDef tree_methods[] = {
+    {"summary", (PyCFunction)tree_summary, METH_NOARGS,
+     "Node count, error count, byte length and error flag of the tree."},
+    {"tags", (PyCFunction)tree_tags, METH_NOARGS,
+     "Definitions in the tree as packed (kind, parent, name range, range, rows) records."},
+    {"columns", (PyCFunction)(void (*)(void))tree_columns, METH_VARARGS | METH_KEYWORDS,
+     "Every node of the tree as one row of a (columns, rows) uint32 buffer."},
+    {"sexp", (PyCFunction)tree_sexp, METH_NOARGS,
+     "S-expression of the syntax tree."},
+    {"memory", (PyCFunction)tree_memory, METH_NOARGS,
+     "Estimated bytes held by the tree, with the subtree and scanner state counts behind them."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef tree_getset[] = {
+    {"has_error", (getter)tree_get_has_error, NULL,
+     "Whether the tree contains ERROR or MISSING nodes.", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyType_Slot tree_slots[] = {
+    {Py_tp_doc, "A Codon syntax tree produced by the native parse functions."},
+    {Py_tp_new, tree_new},
+    {Py_tp_dealloc, tree_dealloc},
+    {Py_tp_methods, tree_methods},
+    {Py_tp_getset, tree_getset},
+    {0, NULL}
+};
+
+static PyType_Spec tree_spec = {
+    "tree_sitter_codon._binding.Tree",
+    sizeof(Tree),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    tree_slots
+};
+
+/* Parsing */
+
+// Exports a contiguous byte view of `object` that fits a tree-sitter length
+static int
+get_source_buffer(PyObject *object, Py_buffer *view)
+{
+    if (PyObject_GetBuffer(object, view, PyBUF_SIMPLE) < 0) return -1;
+    if ((size_t)view->len > UINT32_MAX) {
+        PyBuffer_Release(view);
+        PyErr_SetString(PyExc_ValueError, "source is larger than 4 GiB");
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject *
+py_parse(PyObject *self, PyObject *source)
+{
+    Py_buffer view;
+    if (get_source_buffer(source, &view) < 0) return NULL;
+
+    ModuleState *state = module_state(self);
+    TSTree *tree;
+    Py_BEGIN_ALLOW_THREADS
+    TSParser *parser = codon_parser_pool_acquire(&state->parser_pool);
+    tree = ts_parser_parse_string(parser, NULL, view.buf, (uint32_t)view.len);
+    codon_parser_pool_release(&state->parser_pool, parser);
+    Py_END_ALLOW_THREADS
+
+    if (tree == NULL) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_RuntimeError, "parsing failed");
+        return NULL;
+    }
+    return tree_wrap(state, tree, &view);
+}
+
+/* Parse statistics */
+
+static int
+dict_set_count(PyObject *dict, const char *key, uint64_t value)
+{
+    PyObject *number = PyLong_FromUnsignedLongLong(value);
+    if (number == NULL) return -1;
+    int result = PyDict_SetItemString(dict, key, number);
+    Py_DECREF(number);
+    return result;
+}
+
+// Adds `value` to the count under `key`, which aliased symbols share
+static int
+dict_add_count(PyObject *dict, PyObject *key, uint64_t value)
+{
+    PyObject *previous = PyDict_GetItemWithError(dict, key);
+    if (previous == NULL && PyErr_Occurred()) return -1;
+    if (previous != NULL) value += PyLong_AsUnsignedLongLong(previous);
+    PyObject *number = PyLong_FromUnsignedLongLong(value);
+    if (number == NULL) return -1;
+    int result = PyDict_SetItem(dict, key, number);
+    Py_DECREF(number);
+    return result;
+}
+
+static PyObject *
+parse_stats_to_dict(const CodonParseStats *stats)
+{
+    PyObject *dict = PyDict_New();
+    PyObject *by_symbol = PyDict_New();
+    if (dict == NULL || by_symbol == NULL) goto error;
+
+    if (dict_set_count(dict, "steps", stats->steps) < 0 ||
+        dict_set_count(dict, "forked_steps", stats->forked_steps) < 0 ||
+        dict_set_count(dict, "forks", stats->forks) < 0 ||
+        dict_set_count(dict, "max_versions", stats->max_versions) < 0 ||
+        dict_set_count(dict, "lex_calls", stats->lex_calls) < 0 ||
+        dict_set_count(dict, "external_lex_calls", stats->external_lex_calls) < 0 ||
+        dict_set_count(dict, "shifts", stats->shifts) < 0 ||
+        dict_set_count(dict, "reductions", stats->reductions) < 0 ||
+        dict_set_count(dict, "reused_nodes", stats->reused_nodes) < 0 ||
+        dict_set_count(dict, "errors_detected", stats->errors_detected) < 0 ||
+        dict_set_count(dict, "recoveries", stats->recoveries) < 0) {
+        goto error;
+    }
+    if (stats->symbol_reductions != NULL) {
+        uint32_t count = ts_language_symbol_count(stats->language);
+        for (uint32_t i = 0; i < count; i++) {
+            if (stats->symbol_reductions[i] == 0) continue;
+            PyObject *name = PyUnicode_FromString(ts_language_symbol_name(stats->language, (TSSymbol)i));
+            if (name == NULL) goto error;
+            int result = dict_add_count(by_symbol, name, stats->symbol_reductions[i]);
+            Py_DECREF(name);
+            if (result < 0) goto error;
+        }
+    }
+    if (PyDict_SetItemString(dict, "reductions_by_symbol", by_symbol) < 0) goto error;
+    Py_DECREF(by_symbol);
+    return dict;
+
+error:
+    Py_XDECREF(dict);
+    Py_XDECREF(by_symbol);
+    return NULL;
+}
+
+// Per-symbol reduction counters for the stats logger
+static uint64_t *
+new_symbol_reductions(void)
+{
+    uint64_t *counts = PyMem_Calloc(ts_language_symbol_count(tree_sitter_codon()), sizeof(uint64_t));
+    if (counts == NULL) PyErr_NoMemory();
+    return counts;
+}
+
+static PyObject *
+py_parse_with_stats(PyObject *self, PyObject *source)
+{
+    Py_buffer view;
+    if (get_source_buffer(source, &view) < 0) return NULL;
+    uint64_t *symbol_reductions = new_symbol_reductions();
+    if (symbol_reductions == NULL) {
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+
+    ModuleState *state = module_state(self);
+    CodonParseStats stats;
+    TSTree *tree;
+    Py_BEGIN_ALLOW_THREADS
+    TSParser *parser = codon_parser_pool_acquire(&state->parser_pool);
+    ts_parser_set_logger(parser, codon_parse_stats_logger(&stats, tree_sitter_codon(), symbol_reductions));
+    tree = ts_parser_parse_string(parser, NULL, view.buf, (uint32_t)view.len);
+    ts_parser_set_logger(parser, (TSLogger){NULL, NULL});
+    codon_parser_pool_release(&state->parser_pool, parser);
+    Py_END_ALLOW_THREADS
+
+    if (tree == NULL) {
+        PyMem_Free(symbol_reductions);
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_RuntimeError, "parsing failed");
+        return NULL;
+    }
+    PyObject *dict = parse_stats_to_dict(&stats);
+    PyMem_Free(symbol_reductions);
+    if (dict == NULL) {
+        ts_tree_delete(tree);
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+    PyObject *wrapped = tree_wrap(state, tree, &view);
+    if (wrapped == NULL) {
+        Py_DECREF(dict);
+        return NULL;
+    }
+    PyObject *result = PyTuple_Pack(2, wrapped, dict);
+    Py_DECREF(wrapped);
+    Py_DECREF(dict);
+    return result;
+}
+
+/* Edit sessions */
+
+typedef struct {
+    PyObject_HEAD
+    CodonEditSession session;
+    // Held, without the GIL, around every use of the session
+    CodonMutex lock;
+} EditSession;
+
+// Like get_source_buffer, but also takes a str as its UTF-8 encoding
+static int
+get_text_buffer(PyObject *object, Py_buffer *view)
+{
+    if (!PyUnicode_Check(object)) return get_source_buffer(object, view);
+    PyObject *encoded = PyUnicode_AsUTF8String(object);
+    if (encoded == NULL) return -1;
+    int result = get_source_buffer(encoded, view);
+    Py_DECREF(encoded);
+    return result;
+}
+
+static PyObject *
+changed_ranges_to_list(const TSRange *ranges, uint32_t count)
+{
+    PyObject *list = PyList_New(count);
+    if (list == NULL) return NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        PyObject *range = Py_BuildValue(
+            "(II(II)(II))",
+            ranges[i].start_byte, ranges[i].end_byte,
+            ranges[i].start_point.row, ranges[i].start_point.column,
+            ranges[i].end_point.row, ranges[i].end_point.column
+        );
+        if (range == NULL) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SetItem(list, i, range);
+    }
+    return list;
+}
+
+static PyObject *
+edit_session_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = {"source", NULL};
+    PyObject *source;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", keywords, &source)) return NULL;
+    Py_buffer view;
+    if (get_text_buffer(source, &view) < 0) return NULL;
+
+    allocfunc alloc = (allocfunc)PyType_GetSlot(type, Py_tp_alloc);
+    EditSession *self = (EditSession *)alloc(type, 0);
+    if (self == NULL) {
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+    CodonParserPool *pool = &type_state(type)->parser_pool;
+    bool ok;
+    TSRange *ranges = NULL;
+    uint32_t count = 0;
+    Py_BEGIN_ALLOW_THREADS
+    ok = codon_edit_session_init(&self->session, view.buf, (uint32_t)view.len);
+    if (ok) {
+        TSParser *parser = codon_parser_pool_acquire(pool);
+        ok = codon_edit_session_parse(&self->session, parser, &ranges, &count);
+        codon_parser_pool_release(pool, parser);
+    }
+    Py_END_ALLOW_THREADS
+    free(ranges);
+    PyBuffer_Release(&view);
+    codon_mutex_init(&self->lock);
+    if (!ok) {
+        Py_DECREF(self);
+        PyErr_SetString(PyExc_RuntimeError, "parsing failed");
+        return NULL;
+    }
+    return (PyObject *)self;
+}
+
+static void
+edit_session_dealloc(EditSession *self)
+{
+    PyTypeObject *type = Py_TYPE((PyObject *)self);
+    codon_edit_session_destroy(&self->session);
+    codon_mutex_destroy(&self->lock);
+    freefunc tp_free = (freefunc)PyType_GetSlot(type, Py_tp_free);
+    tp_free(self);
+    Py_DECREF(type);
+}
+
+// Applies an edit and reparses. With `stats`, the reparse runs under the
+// stats logger, which also counts the reductions to each symbol.
+static PyObject *
+edit_session_apply(EditSession *self, PyObject *args, PyObject *kwargs, CodonParseStats *stats)
+{
+    static char *keywords[] = {"start", "old_end", "new_text", NULL};
+    Py_ssize_t start, old_end;
+    PyObject *new_text;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "nnO", keywords, &start, &old_end, &new_text)) return NULL;
+    Py_buffer view;
+    if (get_text_buffer(new_text, &view) < 0) return NULL;
+    uint64_t *symbol_reductions = NULL;
+    if (stats != NULL && (symbol_reductions = new_symbol_reductions()) == NULL) {
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+
+    CodonParserPool *pool = &type_state(Py_TYPE((PyObject *)self))->parser_pool;
+    enum { EDITED, OUT_OF_RANGE, NO_MEMORY, PARSE_FAILED } status = EDITED;
+    TSRange *ranges = NULL;
+    uint32_t count = 0;
+    Py_BEGIN_ALLOW_THREADS
+    codon_mutex_lock(&self->lock);
+    TSInputEdit edit;
+    if (start < 0 || start > old_end || old_end > (Py_ssize_t)self->session.length) {
+        status = OUT_OF_RANGE;
+    } else if (!codon_edit_session_edit(&self->session, (uint32_t)start, (uint32_t)old_end,
+                                        view.buf, (uint32_t)view.len, &edit)) {
+        status = NO_MEMORY;
+    } else {
+        TSParser *parser = codon_parser_pool_acquire(pool);
+        if (stats != NULL) {
+            ts_parser_set_logger(parser, codon_parse_stats_logger(stats, tree_sitter_codon(), symbol_reductions));
+        }
+        if (!codon_edit_session_parse(&self->session, parser, &ranges, &count)) status = PARSE_FAILED;
+        if (stats != NULL) ts_parser_set_logger(parser, (TSLogger){NULL, NULL});
+        codon_parser_pool_release(pool, parser);
+    }
+    codon_mutex_unlock(&self->lock);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&view);
+
+    PyObject *result = NULL;
+    switch (status) {
+        case OUT_OF_RANGE:
+            PyErr_SetString(PyExc_IndexError, "edit range is outside the document");
+            break;
+        case NO_MEMORY:
+            PyErr_NoMemory();
+            break;
+        case PARSE_FAILED:
+            PyErr_SetString(PyExc_RuntimeError, "parsing failed");
+            break;
+        default:
+            result = changed_ranges_to_list(ranges, count);
+            break;
+    }
+    free(ranges);
+    if (result != NULL && stats != NULL) {
+        PyObject *dict = parse_stats_to_dict(stats);
+        PyObject *pair = dict != NULL ? PyTuple_Pack(2, result, dict) : NULL;
+        Py_XDECREF(dict);
+        Py_DECREF(result);
+        result = pair;
+    }
+    PyMem_Free(symbol_reductions);
+    return result;
+}
+
+static PyObject *
+edit_session_edit(EditSession *self, PyObject *args, PyObject *kwargs)
+{
+    return edit_session_apply(self, args, kwargs, NULL);
+}
+
+static PyObject *
+edit_session_edit_with_stats(EditSession *self, PyObject *args, PyObject *kwargs)
+{
+    CodonParseStats stats;
+    return edit_session_apply(self, args, kwargs, &stats);
+}
+
+static PyObject *
+edit_session_text(EditSession *self, PyObject *args)
+{
+    codon_mutex_lock(&self->lock);
+    PyObject *text = PyBytes_FromStringAndSize(NULL, self->session.length);
+    if (text != NULL) {
+        codon_edit_session_read(&self->session, 0, self->session.length, PyBytes_AsString(text));
+    }
+    codon_mutex_unlock(&self->lock);
+    return text;
+}
+
+static PyObject *
+edit_session_get_tree(EditSession *self, void *closure)
+{
+    codon_mutex_lock(&self->lock);
+    TSTree *tree = ts_tree_copy(self->session.tree);
+    codon_mutex_unlock(&self->lock);
+    return tree_wrap(type_state(Py_TYPE((PyObject *)self)), tree, NULL);
+}
+
+static Py_ssize_t
+edit_session_length(EditSession *self)
+{
+    codon_mutex_lock(&self->lock);
+    Py_ssize_t length = self->session.length;
+    codon_mutex_unlock(&self->lock);
+    return length;
+}
+
+static PyMethodDef edit_session_methods[] = {
+    {"edit", (PyCFunction)(void (*)(void))edit_session_edit, METH_VARARGS | METH_KEYWORDS,
+     "Replace bytes [start, old_end) with new_text, reparse, and return the changed ranges."},
+    {"edit_with_stats", (PyCFunction)(void (*)(void))edit_session_edit_with_stats, METH_VARARGS | METH_KEYWORDS,
+     "Like edit, but return (changed ranges, parse statistics) for the reparse."},
+    {"text", (PyCFunction)edit_session_text, METH_NOARGS,
+     "The current document as bytes."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef edit_session_getset[] = {
+    {"tree", (getter)edit_session_get_tree, NULL,
+     "A Tree for the current document.", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyType_Slot edit_session_slots[] = {
+    {Py_tp_doc, "A document that is reparsed incrementally as it is edited."},
+    {Py_tp_new, edit_session_new},
+    {Py_tp_dealloc, edit_session_dealloc},
+    {Py_tp_methods, edit_session_methods},
+    {Py_tp_getset, edit_session_getset},
+    {Py_sq_length, edit_session_length},
+    {0, NULL}
+};
+
+static PyType_Spec edit_session_spec = {
+    "tree_sitter_codon._binding.EditSession",
+    sizeof(EditSession),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    edit_session_slots
+};
+
+/* Streamed parsing */
+
+typedef enum {
+    READER_CALL,      // reader(offset, size) returns the bytes at offset
+    READER_READINTO,  // a binary file: readinto() straight into the chunk buffer
+    READER_READ,      // anything else with read(size)
+} ReaderKind;
+
+typedef struct {
+    PyObject *source;
+    ReaderKind kind;
+    bool seekable;
+    long long base;         // file position the source starts at
+    uint32_t position;      // offset the next read returns without a seek
+    PyThreadState *thread;  // saved while the parser runs without the GIL
+} Reader;
+
+// Copies a bytes-like chunk into the stream buffer
+static uint32_t
+reader_copy(PyObject *chunk, char *buffer, uint32_t capacity)
+{
+    if (chunk == Py_None) return 0;
+    Py_buffer view;
+    if (PyObject_GetBuffer(chunk, &view, PyBUF_SIMPLE) < 0) return CODON_STREAM_FAILED;
+    uint32_t count = (size_t)view.len < capacity ? (uint32_t)view.len : capacity;
+    memcpy(buffer, view.buf, count);
+    PyBuffer_Release(&view);
+    return count;
+}
+
+static uint32_t
+reader_readinto(Reader *reader, char *buffer, uint32_t capacity)
+{
+    PyObject *memory = PyMemoryView_FromMemory(buffer, capacity, PyBUF_WRITE);
+    if (memory == NULL) return CODON_STREAM_FAILED;
+    PyObject *result = PyObject_CallMethod(reader->source, "readinto", "O", memory);
+    // The buffer is reused for the next chunk, so nothing may keep a view
+    PyObject *released = PyObject_CallMethod(memory, "release", NULL);
+    Py_DECREF(memory);
+    if (result == NULL || released == NULL) {
+        Py_XDECREF(result);
+        Py_XDECREF(released);
+        return CODON_STREAM_FAILED;
+    }
+    Py_DECREF(released);
+    if (result == Py_None) {
+        Py_DECREF(result);
+        PyErr_SetString(PyExc_BlockingIOError, "source has no data ready; streams must be blocking");
+        return CODON_STREAM_FAILED;
+    }
+    Py_ssize_t count = PyLong_AsSsize_t(result);
+    Py_DECREF(result);
+    if (count < 0) {
+        if (!PyErr_Occurred()) PyErr_SetString(PyExc_ValueError, "readinto returned a negative count");
+        return CODON_STREAM_FAILED;
+    }
+    return (size_t)count < capacity ? (uint32_t)count : capacity;
+}
+
+static uint32_t
+reader_fill(Reader *reader, uint32_t offset, char *buffer, uint32_t capacity)
+{
+    if (reader->kind == READER_CALL) {
+        PyObject *chunk = PyObject_CallFunction(reader->source, "II", offset, capacity);
+        if (chunk == NULL) return CODON_STREAM_FAILED;
+        uint32_t count = reader_copy(chunk, buffer, capacity);
+        Py_DECREF(chunk);
+        return count;
+    }
+
+    if (offset != reader->position) {
+        if (!reader->seekable) {
+            PyErr_SetString(
+                PyExc_ValueError,
+                "the parser stepped back past the buffered chunk of a non-seekable source; "
+                "use a larger chunk_size"
+            );
+            return CODON_STREAM_FAILED;
+        }
+        PyObject *result = PyObject_CallMethod(reader->source, "seek", "L", reader->base + offset);
+        if (result == NULL) return CODON_STREAM_FAILED;
+        Py_DECREF(result);
+        reader->position = offset;
+    }
+
+    uint32_t count;
+    if (reader->kind == READER_READINTO) {
+        count = reader_readinto(reader, buffer, capacity);
+    } else {
+        PyObject *chunk = PyObject_CallMethod(reader->source, "read", "I", capacity);
+        if (chunk == NULL) return CODON_STREAM_FAILED;
+        if (PyUnicode_Check(chunk)) {
+            Py_DECREF(chunk);
+            PyErr_SetString(PyExc_TypeError, "source must be opened in binary mode");
+            return CODON_STREAM_FAILED;
+        }
+        count = reader_copy(chunk, buffer, capacity);
+        Py_DECREF(chunk);
+    }
+    if (count != CODON_STREAM_FAILED) reader->position += count;
+    return count;
+}
+
+// Called by the parser, without the GIL
+static uint32_t
+reader_read(void *payload, uint32_t offset, char *buffer, uint32_t capacity)
+{
+    Reader *reader = (Reader *)payload;
+    PyEval_RestoreThread(reader->thread);
+    uint32_t count = reader_fill(reader, offset, buffer, capacity);
+    reader->thread = PyEval_SaveThread();
+    return count;
+}
+
+// Reads "utf-8", "utf-16-le" or "utf-16-be", in any case, with or without
+// the separators
+static int
+get_encoding(const char *name, TSInputEncoding *encoding)
+{
+    char normalized[16];
+    size_t length = 0;
+    for (const char *c = name; *c != '\0'; c++) {
+        if (*c == '-' || *c == '_') continue;
+        if (length + 1 == sizeof(normalized)) break;
+        normalized[length++] = (char)(*c >= 'A' && *c <= 'Z' ? *c - 'A' + 'a' : *c);
+    }
+    normalized[length] = '\0';
+    if (strcmp(normalized, "utf8") == 0) {
+        *encoding = TSInputEncodingUTF8;
+    } else if (strcmp(normalized, "utf16le") == 0) {
+        *encoding = TSInputEncodingUTF16LE;
+    } else if (strcmp(normalized, "utf16be") == 0) {
+        *encoding = TSInputEncodingUTF16BE;
+    } else {
+        PyErr_Format(PyExc_ValueError, "unsupported encoding %s; use utf-8, utf-16-le or utf-16-be", name);
+        return -1;
+    }
+    return 0;
+}
+
+// Fills in how to read `source`: a binary file from its current position,
+// or a reader callable
+static int
+reader_init(Reader *reader, PyObject *source)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->source = source;
+    if (PyObject_HasAttrString(source, "readinto")) {
+        reader->kind = READER_READINTO;
+    } else if (PyObject_HasAttrString(source, "read")) {
+        reader->kind = READER_READ;
+    } else if (PyCallable_Check(source)) {
+        reader->kind = READER_CALL;
+        return 0;
+    } else {
+        PyErr_SetString(PyExc_TypeError, "source must be a binary file or a reader(offset, size) callable");
+        return -1;
+    }
+
+    PyObject *seekable = PyObject_HasAttrString(source, "seekable")
+        ? PyObject_CallMethod(source, "seekable", NULL)
+        : NULL;
+    reader->seekable = seekable != NULL && PyObject_IsTrue(seekable) == 1;
+    Py_XDECREF(seekable);
+    PyErr_Clear();
+    if (reader->seekable) {
+        PyObject *position = PyObject_CallMethod(source, "tell", NULL);
+        if (position == NULL) return -1;
+        reader->base = PyLong_AsLongLong(position);
+        Py_DECREF(position);
+        if (reader->base == -1 && PyErr_Occurred()) return -1;
+    }
+    return 0;
+}
+
+static PyObject *
+py_parse_stream(PyObject *self, PyObject *args)
+{
+    PyObject *source;
+    const char *encoding_name;
+    unsigned int chunk_size;
+    if (!PyArg_ParseTuple(args, "OsI", &source, &encoding_name, &chunk_size)) return NULL;
+    TSInputEncoding encoding;
+    Reader reader;
+    if (get_encoding(encoding_name, &encoding) < 0 || reader_init(&reader, source) < 0) return NULL;
+    CodonStream stream;
+    if (!codon_stream_init(&stream, chunk_size, reader_read, &reader)) return PyErr_NoMemory();
+
+    // The GIL is taken back only to read each chunk
+    ModuleState *state = module_state(self);
+    TSParser *parser = codon_parser_pool_acquire(&state->parser_pool);
+    reader.thread = PyEval_SaveThread();
+    TSTree *tree = ts_parser_parse(parser, NULL, codon_stream_input(&stream, encoding));
+    PyEval_RestoreThread(reader.thread);
+    codon_parser_pool_release(&state->parser_pool, parser);
+
+    bool failed = stream.failed;
+    codon_stream_destroy(&stream);
+    if (failed) {
+        ts_tree_delete(tree);
+        return NULL;
+    }
+    if (tree == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "parsing failed");
+        return NULL;
+    }
+    return tree_wrap(state, tree, NULL);
+}
+
+/* Parse jobs */
+
+typedef struct {
+    PyObject_HEAD
+    CodonParseJob job;
+    // Exported for the life of the job, which parses it in place
+    Py_buffer source;
+    // Held, without the GIL, around every use of the job
+    CodonMutex lock;
+} ParseJob;
+
+static PyObject *
+parse_job_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = {"source", "old_tree", NULL};
+    PyObject *source, *old_tree = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", keywords, &source, &old_tree)) return NULL;
+    ModuleState *state = type_state(type);
+    if (old_tree != Py_None && !PyObject_TypeCheck(old_tree, (PyTypeObject *)state->tree_type)) {
+        PyErr_SetString(PyExc_TypeError, "old_tree must be a Tree or None");
+        return NULL;
+    }
+    Py_buffer view;
+    if (get_text_buffer(source, &view) < 0) return NULL;
+
+    allocfunc alloc = (allocfunc)PyType_GetSlot(type, Py_tp_alloc);
+    ParseJob *self = (ParseJob *)alloc(type, 0);
+    if (self == NULL) {
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+    self->source = view;
+    codon_parse_job_init(
+        &self->job, &state->parser_pool, view.buf, (uint32_t)view.len,
+        old_tree != Py_None ? ((Tree *)old_tree)->tree : NULL
+    );
+    codon_mutex_init(&self->lock);
+    return (PyObject *)self;
+}
+
+static void
+parse_job_dealloc(ParseJob *self)
+{
+    PyTypeObject *type = Py_TYPE((PyObject *)self);
+    codon_parse_job_destroy(&self->job);
+    codon_mutex_destroy(&self->lock);
+    PyBuffer_Release(&self->source);
+    freefunc tp_free = (freefunc)PyType_GetSlot(type, Py_tp_free);
+    tp_free(self);
+    Py_DECREF(type);
+}
+
+// Wraps `tree`, a tree of a prefix of the job's source, with its own
+// export of the source
+static PyObject *
+parse_job_wrap(ParseJob *self, TSTree *tree)
+{
+    ModuleState *state = type_state(Py_TYPE((PyObject *)self));
+    Py_buffer view;
+    if (get_source_buffer(self->source.obj, &view) < 0) {
+        ts_tree_delete(tree);
+        return NULL;
+    }
+    return tree_wrap(state, tree, &view);
+}
+
+static PyObject *
+parse_job_run(ParseJob *self, PyObject *args)
+{
+    PyObject *budget = Py_None;
+    if (!PyArg_ParseTuple(args, "|O", &budget)) return NULL;
+    double seconds = -1;
+    if (budget != Py_None) {
+        seconds = PyFloat_AsDouble(budget);
+        if (seconds == -1 && PyErr_Occurred()) return NULL;
+        if (seconds < 0) {
+            PyErr_SetString(PyExc_ValueError, "budget must not be negative");
+            return NULL;
+        }
+    }
+    bool done;
+    Py_BEGIN_ALLOW_THREADS
+    codon_mutex_lock(&self->lock);
+    done = codon_parse_job_run(&self->job, seconds);
+    codon_mutex_unlock(&self->lock);
+    Py_END_ALLOW_THREADS
+    return PyBool_FromLong(done);
+}
+
+static PyObject *
+parse_job_partial(ParseJob *self, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = {"max_bytes", NULL};
+    PyObject *limit = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", keywords, &limit)) return NULL;
+    uint32_t max_bytes = UINT32_MAX;
+    if (limit != Py_None) {
+        unsigned long value = PyLong_AsUnsignedLong(limit);
+        if (value == (unsigned long)-1 && PyErr_Occurred()) return NULL;
+        if (value < UINT32_MAX) max_bytes = (uint32_t)value;
+    }
+    TSTree *tree;
+    Py_BEGIN_ALLOW_THREADS
+    codon_mutex_lock(&self->lock);
+    tree = codon_parse_job_partial(&self->job, max_bytes);
+    codon_mutex_unlock(&self->lock);
+    Py_END_ALLOW_THREADS
+    if (tree == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "parsing failed");
+        return NULL;
+    }
+    return parse_job_wrap(self, tree);
+}
+
+static PyObject *
+parse_job_get_tree(ParseJob *self, void *closure)
+{
+    codon_mutex_lock(&self->lock);
+    TSTree *tree = self->job.tree != NULL ? ts_tree_copy(self->job.tree) : NULL;
+    codon_mutex_unlock(&self->lock);
+    if (tree == NULL) Py_RETURN_NONE;
+    return parse_job_wrap(self, tree);
+}
+
+static PyObject *
+parse_job_get_done(ParseJob *self, void *closure)
+{
+    codon_mutex_lock(&self->lock);
+    bool done = self->job.tree != NULL;
+    codon_mutex_unlock(&self->lock);
+    return PyBool_FromLong(done);
+}
+
+static PyObject *
+parse_job_get_has_error(ParseJob *self, void *closure)
+{
+    codon_mutex_lock(&self->lock);
+    bool has_error = self->job.has_error;
+    codon_mutex_unlock(&self->lock);
+    return PyBool_FromLong(has_error);
+}
+
+static PyObject *
+parse_job_get_offset(ParseJob *self, void *closure)
+{
+    codon_mutex_lock(&self->lock);
+    uint32_t offset = self->job.offset;
+    codon_mutex_unlock(&self->lock);
+    return PyLong_FromUnsignedLong(offset);
+}
+
+static Py_ssize_t
+parse_job_length(ParseJob *self)
+{
+    return self->source.len;
+}
+
+static PyMethodDef parse_job_methods[] = {
+    {"run", (PyCFunction)parse_job_run, METH_VARARGS,
+     "Parse for up to budget seconds, or to the end without one; returns whether the tree is done."},
+    {"partial", (PyCFunction)(void (*)(void))parse_job_partial, METH_VARARGS | METH_KEYWORDS,
+     "Parse the statements before offset (or max_bytes) on their own and return the Tree."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef parse_job_getset[] = {
+    {"tree", (getter)parse_job_get_tree, NULL,
+     "The finished Tree, or None until run returns True.", NULL},
+    {"done", (getter)parse_job_get_done, NULL,
+     "Whether the whole source has been parsed.", NULL},
+    {"has_error", (getter)parse_job_get_has_error, NULL,
+     "Whether the parser has met a syntax error so far.", NULL},
+    {"offset", (getter)parse_job_get_offset, NULL,
+     "Furthest byte the parser has reached.", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyType_Slot parse_job_slots[] = {
+    {Py_tp_doc, "A parse of one source that runs in time-budgeted slices."},
+    {Py_tp_new, parse_job_new},
+    {Py_tp_dealloc, parse_job_dealloc},
+    {Py_tp_methods, parse_job_methods},
+    {Py_tp_getset, parse_job_getset},
+    {Py_sq_length, parse_job_length},
+    {0, NULL}
+};
+
+static PyType_Spec parse_job_spec = {
+    "tree_sitter_codon._binding.ParseJob",
+    sizeof(ParseJob),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    parse_job_slots
+};
+
+/* Injections */
+
+typedef struct {
+    PyObject_HEAD
+    CodonInjectionCache cache;
+    CodonMutex lock;
+} InjectionCache;
+
+static PyObject *
+injection_cache_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = {"capacity", "budget", NULL};
+    unsigned int capacity = 64;
+    unsigned long long budget = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|IK", keywords, &capacity, &budget)) return NULL;
+
+    allocfunc alloc = (allocfunc)PyType_GetSlot(type, Py_tp_alloc);
+    InjectionCache *self = (InjectionCache *)alloc(type, 0);
+    if (self == NULL) return NULL;
+    codon_mutex_init(&self->lock);
+    if (!codon_injection_cache_init(&self->cache, capacity, budget)) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    return (PyObject *)self;
+}
+
+static void
+injection_cache_dealloc(InjectionCache *self)
+{
+    PyTypeObject *type = Py_TYPE((PyObject *)self);
+    codon_injection_cache_destroy(&self->cache);
+    codon_mutex_destroy(&self->lock);
+    freefunc tp_free = (freefunc)PyType_GetSlot(type, Py_tp_free);
+    tp_free(self);
+    Py_DECREF(type);
+}
+
+static PyObject *
+injection_cache_parse(InjectionCache *self, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = {"language", "source", "start", "end", NULL};
+    PyObject *capsule, *source;
+    Py_ssize_t start, end;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOnn", keywords, &capsule, &source, &start, &end)) {
+        return NULL;
+    }
+    const TSLanguage *language = PyCapsule_GetPointer(capsule, "tree_sitter.Language");
+    if (language == NULL) return NULL;
+    Py_buffer view;
+    if (get_source_buffer(source, &view) < 0) return NULL;
+    if (start < 0 || start > end || end > view.len) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_IndexError, "region is outside the source");
+        return NULL;
+    }
+
+    TSTree *tree = NULL;
+    Py_BEGIN_ALLOW_THREADS
+    codon_mutex_lock(&self->lock);
+    const TSTree *cached = codon_injection_parse(&self->cache, language, view.buf, (uint32_t)start, (uint32_t)end);
+    if (cached != NULL) tree = ts_tree_copy(cached);
+    codon_mutex_unlock(&self->lock);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&view);
+
+    if (tree == NULL) {
+        PyErr_SetString(PyExc_ValueError, "could not parse the region with this language");
+        return NULL;
+    }
+    return tree_wrap(type_state(Py_TYPE((PyObject *)self)), tree, NULL);
+}
+
+static PyObject *
+injection_cache_get_hits(InjectionCache *self, void *closure)
+{
+    codon_mutex_lock(&self->lock);
+    uint64_t hits = self->cache.hits;
+    codon_mutex_unlock(&self->lock);
+    return PyLong_FromUnsignedLongLong(hits);
+}
+
+static PyObject *
+injection_cache_get_misses(InjectionCache *self, void *closure)
+{
+    codon_mutex_lock(&self->lock);
+    uint64_t misses = self->cache.misses;
+    codon_mutex_unlock(&self->lock);
+    return PyLong_FromUnsignedLongLong(misses);
+}
+
+static PyObject *
+injection_cache_get_bytes(InjectionCache *self, void *closure)
+{
+    codon_mutex_lock(&self->lock);
+    uint64_t bytes = self->cache.bytes;
+    codon_mutex_unlock(&self->lock);
+    return PyLong_FromUnsignedLongLong(bytes);
+}
+
+static PyMethodDef injection_cache_methods[] = {
+    {"parse", (PyCFunction)(void (*)(void))injection_cache_parse, METH_VARARGS | METH_KEYWORDS,
+     "Tree of source[start:end] parsed with language, reused while the region's text is unchanged."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef injection_cache_getset[] = {
+    {"hits", (getter)injection_cache_get_hits, NULL, "Parses answered from the cache.", NULL},
+    {"misses", (getter)injection_cache_get_misses, NULL, "Parses that ran the parser.", NULL},
+    {"bytes", (getter)injection_cache_get_bytes, NULL, "Estimated bytes held by the cached trees.", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyType_Slot injection_cache_slots[] = {
+    {Py_tp_doc, "Trees of embedded regions, parsed on request and cached by content."},
+    {Py_tp_new, injection_cache_new},
+    {Py_tp_dealloc, injection_cache_dealloc},
+    {Py_tp_methods, injection_cache_methods},
+    {Py_tp_getset, injection_cache_getset},
+    {0, NULL}
+};
+
+static PyType_Spec injection_cache_spec = {
+    "tree_sitter_codon._binding.InjectionCache",
+    sizeof(InjectionCache),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    injection_cache_slots
+};
+
+/* Tree cache */
+
+typedef struct {
+    PyObject_HEAD
+    CodonTreeCache cache;
+    CodonMutex lock;
+    PyObject *loader;  // called with a key to get the source of a missing tree
+} TreeCache;
+
+// The UTF-8 or raw bytes of a str or bytes key, owned by `key`
+static int
+get_key(PyObject *key, const char **data, uint32_t *length)
+{
+    Py_ssize_t size;
+    if (PyUnicode_Check(key)) {
+        *data = PyUnicode_AsUTF8AndSize(key, &size);
+        if (*data == NULL) return -1;
+    } else if (PyBytes_Check(key)) {
+        char *bytes;
+        if (PyBytes_AsStringAndSize(key, &bytes, &size) < 0) return -1;
+        *data = bytes;
+    } else {
+        PyErr_SetString(PyExc_TypeError, "keys must be str or bytes");
+        return -1;
+    }
+    if ((size_t)size > UINT32_MAX) {
+        PyErr_SetString(PyExc_ValueError, "key is larger than 4 GiB");
+        return -1;
+    }
+    *length = (uint32_t)size;
+    return 0;
+}
+
+static PyObject *
+tree_cache_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = {"budget", "loader", NULL};
+    unsigned long long budget;
+    PyObject *loader = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "K|O", keywords, &budget, &loader)) return NULL;
+    if (loader != Py_None && !PyCallable_Check(loader)) {
+        PyErr_SetString(PyExc_TypeError, "loader must be callable or None");
+        return NULL;
+    }
+
+    allocfunc alloc = (allocfunc)PyType_GetSlot(type, Py_tp_alloc);
+    TreeCache *self = (TreeCache *)alloc(type, 0);
+    if (self == NULL) return NULL;
+    codon_tree_cache_init(&self->cache, budget);
+    codon_mutex_init(&self->lock);
+    if (loader != Py_None) {
+        Py_INCREF(loader);
+        self->loader = loader;
+    }
+    return (PyObject *)self;
+}
+
+static int
+tree_cache_traverse(TreeCache *self, visitproc visit, void *arg)
+{
+    Py_VISIT(Py_TYPE((PyObject *)self));
+    Py_VISIT(self->loader);
+    return 0;
+}
+
+static int
+tree_cache_clear(TreeCache *self)
+{
+    Py_CLEAR(self->loader);
+    return 0;
+}
+
+static void
+tree_cache_dealloc(TreeCache *self)
+{
+    PyTypeObject *type = Py_TYPE((PyObject *)self);
+    PyObject_GC_UnTrack(self);
+    tree_cache_clear(self);
+    codon_tree_cache_destroy(&self->cache);
+    codon_mutex_destroy(&self->lock);
+    freefunc tp_free = (freefunc)PyType_GetSlot(type, Py_tp_free);
+    tp_free(self);
+    Py_DECREF(type);
+}
+
+// Adds a copy of `tree` under the key
+static int
+tree_cache_store(TreeCache *self, const char *key, uint32_t length, const TSTree *tree)
+{
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    TSTree *copy = ts_tree_copy(tree);
+    codon_mutex_lock(&self->lock);
+    ok = codon_tree_cache_put(&self->cache, key, length, copy);
+    codon_mutex_unlock(&self->lock);
+    Py_END_ALLOW_THREADS
+    if (!ok) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject *
+tree_cache_get(TreeCache *self, PyObject *key)
+{
+    const char *data;
+    uint32_t length;
+    if (get_key(key, &data, &length) < 0) return NULL;
+    ModuleState *state = type_state(Py_TYPE((PyObject *)self));
+
+    TSTree *tree = NULL;
+    Py_BEGIN_ALLOW_THREADS
+    codon_mutex_lock(&self->lock);
+    const TSTree *cached = codon_tree_cache_get(&self->cache, data, length);
+    if (cached != NULL) tree = ts_tree_copy(cached);
+    codon_mutex_unlock(&self->lock);
+    Py_END_ALLOW_THREADS
+    if (tree != NULL) return tree_wrap(state, tree, NULL);
+    if (self->loader == NULL) Py_RETURN_NONE;
+
+    // Rebuild the tree. The lock is not held while the loader runs, so two
+    // threads missing the same key may both parse it.
+    PyObject *source = PyObject_CallFunctionObjArgs(self->loader, key, NULL);
+    if (source == NULL) return NULL;
+    if (source == Py_None) return source;
+    Py_buffer view;
+    int status = get_text_buffer(source, &view);
+    Py_DECREF(source);
+    if (status < 0) return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    TSParser *parser = codon_parser_pool_acquire(&state->parser_pool);
+    tree = ts_parser_parse_string(parser, NULL, view.buf, (uint32_t)view.len);
+    codon_parser_pool_release(&state->parser_pool, parser);
+    Py_END_ALLOW_THREADS
+    if (tree == NULL) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_RuntimeError, "parsing failed");
+        return NULL;
+    }
+    if (tree_cache_store(self, data, length, tree) < 0) {
+        ts_tree_delete(tree);
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+    return tree_wrap(state, tree, &view);
+}
+
+static PyObject *
+tree_cache_put(TreeCache *self, PyObject *args)
+{
+    PyObject *key, *tree;
+    if (!PyArg_ParseTuple(args, "OO", &key, &tree)) return NULL;
+    const char *data;
+    uint32_t length;
+    if (get_key(key, &data, &length) < 0) return NULL;
+    ModuleState *state = type_state(Py_TYPE((PyObject *)self));
+    if (!PyObject_TypeCheck(tree, (PyTypeObject *)state->tree_type)) {
+        PyErr_SetString(PyExc_TypeError, "tree must be a Tree");
+        return NULL;
+    }
+    if (tree_cache_store(self, data, length, ((Tree *)tree)->tree) < 0) return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+tree_cache_remove(TreeCache *self, PyObject *key)
+{
+    const char *data;
+    uint32_t length;
+    if (get_key(key, &data, &length) < 0) return NULL;
+    bool removed;
+    Py_BEGIN_ALLOW_THREADS
+    codon_mutex_lock(&self->lock);
+    removed = codon_tree_cache_remove(&self->cache, data, length);
+    codon_mutex_unlock(&self->lock);
+    Py_END_ALLOW_THREADS
+    return PyBool_FromLong(removed);
+}
+
+static Py_ssize_t
+tree_cache_length(TreeCache *self)
+{
+    codon_mutex_lock(&self->lock);
+    Py_ssize_t size = self->cache.size;
+    codon_mutex_unlock(&self->lock);
+    return size;
+}
+
+// Reads the uint64_t counter at offset `closure` of the cache
+static PyObject *
+tree_cache_get_count(TreeCache *self, void *closure)
+{
+    codon_mutex_lock(&self->lock);
+    uint64_t value = *(const uint64_t *)((const char *)&self->cache + (size_t)closure);
+    codon_mutex_unlock(&self->lock);
+    return PyLong_FromUnsignedLongLong(value);
+}
+
+static int
+tree_cache_set_budget(TreeCache *self, PyObject *value, void *closure)
+{
+    if (value == NULL) {
+        PyErr_SetString(PyExc_AttributeError, "budget cannot be deleted");
+        return -1;
+    }
+    unsigned long long budget = PyLong_AsUnsignedLongLong(value);
+    if (budget == (unsigned long long)-1 && PyErr_Occurred()) return -1;
+    Py_BEGIN_ALLOW_THREADS
+    codon_mutex_lock(&self->lock);
+    codon_tree_cache_set_budget(&self->cache, budget);
+    codon_mutex_unlock(&self->lock);
+    Py_END_ALLOW_THREADS
+    return 0;
+}
+
+static PyMethodDef tree_cache_methods[] = {
+    {"get", (PyCFunction)tree_cache_get, METH_O,
+     "The tree under key; on a miss, parsed from loader(key) and added, or None without a loader."},
+    {"put", (PyCFunction)tree_cache_put, METH_VARARGS,
+     "Add a copy of tree under key, evicting least recently used trees past the budget."},
+    {"remove", (PyCFunction)tree_cache_remove, METH_O,
+     "Drop the tree under key; returns whether there was one."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef tree_cache_getset[] = {
+    {"budget", (getter)tree_cache_get_count, (setter)tree_cache_set_budget,
+     "Byte budget; 0 keeps every tree. Lowering it evicts at once.",
+     (void *)offsetof(CodonTreeCache, budget)},
+    {"bytes", (getter)tree_cache_get_count, NULL, "Estimated bytes held by the cached trees.",
+     (void *)offsetof(CodonTreeCache, bytes)},
+    {"hits", (getter)tree_cache_get_count, NULL, "Lookups answered from the cache.",
+     (void *)offsetof(CodonTreeCache, hits)},
+    {"misses", (getter)tree_cache_get_count, NULL, "Lookups of missing or evicted trees.",
+     (void *)offsetof(CodonTreeCache, misses)},
+    {"evictions", (getter)tree_cache_get_count, NULL, "Trees evicted to stay within the budget.",
+     (void *)offsetof(CodonTreeCache, evictions)},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyType_Slot tree_cache_slots[] = {
+    {Py_tp_doc, "Trees by key under a memory budget, evicting the least recently used."},
+    {Py_tp_new, tree_cache_new},
+    {Py_tp_dealloc, tree_cache_dealloc},
+    {Py_tp_traverse, tree_cache_traverse},
+    {Py_tp_clear, tree_cache_clear},
+    {Py_tp_methods, tree_cache_methods},
+    {Py_tp_getset, tree_cache_getset},
+    {Py_sq_length, tree_cache_length},
+    {0, NULL}
+};
+
+static PyType_Spec tree_cache_spec = {
+    "tree_sitter_codon._binding.TreeCache",
+    sizeof(TreeCache),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    tree_cache_slots
+};
+
+/* Highlighting */
+
+typedef struct {
+    PyObject_HEAD
+    CodonHighlighter *highlighter;
+    PyObject *capture_names;
+} Highlighter;
+
+static PyObject *
+highlighter_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = {"query", NULL};
+    PyObject *query;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", keywords, &query)) return NULL;
+    Py_buffer view;
+    if (get_text_buffer(query, &view) < 0) return NULL;
+
+    uint32_t error_offset;
+    TSQueryError error_type;
+    CodonHighlighter *highlighter;
+    Py_BEGIN_ALLOW_THREADS
+    highlighter = codon_highlighter_new(
+        tree_sitter_codon(), view.buf, (uint32_t)view.len, &error_offset, &error_type
+    );
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&view);
+    if (highlighter == NULL) {
+        if (error_type == TSQueryErrorNone) return PyErr_NoMemory();
+        return PyErr_Format(PyExc_ValueError, "invalid query at byte %u (error %d)", error_offset, (int)error_type);
+    }
+
+    uint32_t count = codon_highlighter_capture_count(highlighter);
+    PyObject *names = PyTuple_New(count);
+    for (uint32_t i = 0; names != NULL && i < count; i++) {
+        uint32_t length;
+        const char *name = codon_highlighter_capture_name(highlighter, i, &length);
+        PyObject *string = PyUnicode_FromStringAndSize(name, length);
+        if (string == NULL) {
+            Py_CLEAR(names);
+            break;
+        }
+        PyTuple_SetItem(names, i, string);
+    }
+    allocfunc alloc = (allocfunc)PyType_GetSlot(type, Py_tp_alloc);
+    Highlighter *self = names != NULL ? (Highlighter *)alloc(type, 0) : NULL;
+    if (self == NULL) {
+        Py_XDECREF(names);
+        codon_highlighter_delete(highlighter);
+        return NULL;
+    }
+    self->highlighter = highlighter;
+    self->capture_names = names;
+    return (PyObject *)self;
+}
+
+static void
+highlighter_dealloc(Highlighter *self)
+{
+    PyTypeObject *type = Py_TYPE((PyObject *)self);
+    codon_highlighter_delete(self->highlighter);
+    Py_XDECREF(self->capture_names);
+    freefunc tp_free = (freefunc)PyType_GetSlot(type, Py_tp_free);
+    tp_free(self);
+    Py_DECREF(type);
+}
+
+// Packed CodonHighlight records, three native-endian uint32 each
+static PyObject *
+highlighter_highlight(Highlighter *self, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = {"tree", "source", "start", "end", NULL};
+    PyObject *tree, *source;
+    unsigned int start = 0, end = UINT32_MAX;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwargs, "O!O|II", keywords, (PyTypeObject *)type_state(Py_TYPE((PyObject *)self))->tree_type,
+            &tree, &source, &start, &end
+        )) {
+        return NULL;
+    }
+    if (start > end) {
+        PyErr_SetString(PyExc_ValueError, "start is after end");
+        return NULL;
+    }
+    Py_buffer view;
+    if (get_source_buffer(source, &view) < 0) return NULL;
+
+    // Trees are never modified in place, so the highlighter and the tree
+    // can both be used from other threads meanwhile
+    CodonHighlightList list = {NULL, 0, 0};
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = codon_highlight(
+        self->highlighter, ((Tree *)tree)->tree, view.buf, (uint32_t)view.len, start, end, &list
+    );
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&view);
+
+    if (!ok) {
+        codon_highlight_list_delete(&list);
+        return PyErr_NoMemory();
+    }
+    PyObject *result = PyBytes_FromStringAndSize(
+        (const char *)list.highlights, (Py_ssize_t)list.size * (Py_ssize_t)sizeof(CodonHighlight)
+    );
+    codon_highlight_list_delete(&list);
+    return result;
+}
+
+static PyObject *
+highlighter_get_capture_names(Highlighter *self, void *closure)
+{
+    Py_INCREF(self->capture_names);
+    return self->capture_names;
+}
+
+static PyMethodDef highlighter_methods[] = {
+    {"highlight", (PyCFunction)(void (*)(void))highlighter_highlight, METH_VARARGS | METH_KEYWORDS,
+     "Captures of the tree's nodes in [start, end) as packed (start, end, capture) records."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef highlighter_getset[] = {
+    {"capture_names", (getter)highlighter_get_capture_names, NULL,
+     "Names of the query's captures, indexed by capture id.", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyType_Slot highlighter_slots[] = {
+    {Py_tp_doc, "A compiled highlights query whose predicates are evaluated natively."},
+    {Py_tp_new, highlighter_new},
+    {Py_tp_dealloc, highlighter_dealloc},
+    {Py_tp_methods, highlighter_methods},
+    {Py_tp_getset, highlighter_getset},
+    {0, NULL}
+};
+
+static PyType_Spec highlighter_spec = {
+    "tree_sitter_codon._binding.Highlighter",
+    sizeof(Highlighter),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    highlighter_slots
+};
+
+/* Header pre-scan */
+
+static PyObject *
+prescan_text(const char *text, uint32_t start, uint32_t end)
+{
+    return PyUnicode_DecodeUTF8(text + start, (Py_ssize_t)(end - start), "replace");
+}
+
+static PyObject *
+prescan_record_to_dict(const char *text, const CodonPrescanRecord *record)
+{
+    PyObject *name = prescan_text(text, record->name_start_byte, record->name_end_byte);
+    PyObject *value = prescan_text(text, record->value_start_byte, record->value_end_byte);
+    PyObject *dict = NULL;
+    if (name != NULL && value != NULL) {
+        dict = Py_BuildValue(
+            "{s:s,s:O,s:O,s:I,s:I,s:I}",
+            "kind", codon_prescan_kind_names[record->kind],
+            "name", name,
+            "value", value,
+            "start_byte", record->start_byte,
+            "end_byte", record->end_byte,
+            "row", record->row
+        );
+    }
+    Py_XDECREF(name);
+    Py_XDECREF(value);
+    return dict;
+}
+
+static PyObject *
+py_prescan(PyObject *self, PyObject *source)
+{
+    Py_buffer view;
+    if (get_text_buffer(source, &view) < 0) return NULL;
+
+    // Headers are short, so this does not release the GIL
+    CodonPrescanList list = {0};
+    PyObject *records = NULL;
+    if (!codon_prescan(view.buf, (uint32_t)view.len, &list)) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    records = PyList_New(list.size);
+    if (records == NULL) goto done;
+    for (uint32_t i = 0; i < list.size; i++) {
+        PyObject *record = prescan_record_to_dict(view.buf, &list.records[i]);
+        if (record == NULL) {
+            Py_CLEAR(records);
+            goto done;
+        }
+        PyList_SetItem(records, i, record);
+    }
+
+done:
+    codon_prescan_list_delete(&list);
+    PyBuffer_Release(&view);
+    return records;
+}
+
+/* Summary cache */
+
+static void
+cache_entry_destroy(PyObject *capsule)
+{
+    CodonCacheEntry *entry = PyCapsule_GetPointer(capsule, "tree_sitter_codon.CacheEntry");
+    codon_cache_entry_release(entry);
+    PyMem_Free(entry);
+}
+
+static PyObject *
+py_cached_summary(PyObject *self, PyObject *args)
+{
+    PyObject *source, *directory;
+    if (!PyArg_ParseTuple(args, "OO&:cached_summary", &source, PyUnicode_FSConverter, &directory)) {
+        return NULL;
+    }
+    Py_buffer view;
+    if (get_text_buffer(source, &view) < 0) {
+        Py_DECREF(directory);
+        return NULL;
+    }
+    CodonCacheEntry *entry = PyMem_Malloc(sizeof(CodonCacheEntry));
+    if (entry == NULL) {
+        PyBuffer_Release(&view);
+        Py_DECREF(directory);
+        return PyErr_NoMemory();
+    }
+
+    ModuleState *state = module_state(self);
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    TSParser *parser = codon_parser_pool_acquire(&state->parser_pool);
+    ok = codon_cache_get(PyBytes_AsString(directory), parser, view.buf, (uint32_t)view.len, entry);
+    codon_parser_pool_release(&state->parser_pool, parser);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&view);
+    Py_DECREF(directory);
+    if (!ok) {
+        PyMem_Free(entry);
+        PyErr_SetString(PyExc_RuntimeError, "parsing failed");
+        return NULL;
+    }
+
+    // The capsule owns the entry; the columns keep it, and so the
+    // mapped file, alive
+    PyObject *capsule = PyCapsule_New(entry, "tree_sitter_codon.CacheEntry", cache_entry_destroy);
+    if (capsule == NULL) {
+        codon_cache_entry_release(entry);
+        PyMem_Free(entry);
+        return NULL;
+    }
+    PyTypeObject *type = (PyTypeObject *)state->columns_type;
+    allocfunc alloc = (allocfunc)PyType_GetSlot(type, Py_tp_alloc);
+    Columns *columns = (Columns *)alloc(type, 0);
+    if (columns == NULL) {
+        Py_DECREF(capsule);
+        return NULL;
+    }
+    columns->data = (uint32_t *)entry->columns;
+    columns->owner = capsule;
+    columns->shape[0] = CODON_COLUMN_COUNT;
+    columns->shape[1] = entry->rows;
+    columns->strides[0] = (Py_ssize_t)entry->rows * (Py_ssize_t)sizeof(uint32_t);
+    columns->strides[1] = sizeof(uint32_t);
+
+    PyObject *summary = summary_to_dict(&entry->summary);
+    PyObject *errors = PyBytes_FromStringAndSize(
+        (const char *)entry->errors, (Py_ssize_t)(entry->error_range_count * sizeof(CodonErrorRange))
+    );
+    PyObject *tags = PyBytes_FromStringAndSize(
+        (const char *)entry->tags, (Py_ssize_t)(entry->tag_count * sizeof(CodonTag))
+    );
+    PyObject *result = NULL;
+    if (summary != NULL && errors != NULL && tags != NULL) {
+        result = Py_BuildValue(
+            "{s:O,s:O,s:O,s:O,s:O}",
+            "hit", entry->hit ? Py_True : Py_False,
+            "summary", summary,
+            "columns", (PyObject *)columns,
+            "errors", errors,
+            "tags", tags
+        );
+    }
+    Py_XDECREF(summary);
+    Py_XDECREF(errors);
+    Py_XDECREF(tags);
+    Py_DECREF((PyObject *)columns);
+    return result;
+}
+
+/* Batch parsing */
+
+static PyObject *
+py_parse_many(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = {"sources", "threads", "trees", "cache_dir", NULL};
+    PyObject *sources;
+    unsigned int threads = 1;
+    int keep_trees = 0;
+    PyObject *cache_dir = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|IpO:parse_many", keywords,
+                                     &sources, &threads, &keep_trees, &cache_dir)) {
+        return NULL;
+    }
+    PyObject *directory = NULL;
+    if (cache_dir != Py_None && !PyUnicode_FSConverter(cache_dir, &directory)) return NULL;
+
+    // Both lists keep the source buffers and encoded paths alive while the
+    // GIL is released
+    PyObject *items = PySequence_List(sources);
+    if (items == NULL) {
+        Py_XDECREF(directory);
+        return NULL;
+    }
+    PyObject *paths = PyList_New(0);
+    if (paths == NULL) {
+        Py_DECREF(items);
+        Py_XDECREF(directory);
+        return NULL;
+    }
+
+    Py_ssize_t count = PyList_Size(items);
+    Py_ssize_t view_count = 0;
+    CodonSource *inputs = PyMem_Calloc(count ? count : 1, sizeof(CodonSource));
+    CodonResult *results = PyMem_Calloc(count ? count : 1, sizeof(CodonResult));
+    Py_buffer *views = PyMem_Calloc(count ? count : 1, sizeof(Py_buffer));
+    PyObject *output = NULL;
+    if (inputs == NULL || results == NULL || views == NULL) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    for (Py_ssize_t i = 0; i < count; i++) {
+        PyObject *item = PyList_GetItem(items, i);
+        if (PyUnicode_Check(item)) {
+            PyObject *path = PyUnicode_EncodeFSDefault(item);
+            if (path == NULL) goto done;
+            int appended = PyList_Append(paths, path);
+            Py_DECREF(path);
+            if (appended < 0) goto done;
+            inputs[i].path = PyBytes_AsString(path);
+        } else if (PyObject_CheckBuffer(item)) {
+            Py_buffer *view = &views[view_count];
+            if (get_source_buffer(item, view) < 0) goto done;
+            view_count++;
+            inputs[i].data = view->buf;
+            inputs[i].length = (uint32_t)view->len;
+        } else {
+            PyErr_Format(PyExc_TypeError, "sources[%zd] must be a path string or a buffer", i);
+            goto done;
+        }
+    }
+
+    ModuleState *state = module_state(self);
+    Py_BEGIN_ALLOW_THREADS
+    codon_parse_many(
+        &state->parser_pool, inputs, (size_t)count, threads, keep_trees,
+        directory != NULL ? PyBytes_AsString(directory) : NULL, results
+    );
+    Py_END_ALLOW_THREADS
+
+    output = PyList_New(count);
+    if (output == NULL) goto done;
+    for (Py_ssize_t i = 0; i < count; i++) {
+        PyObject *value;
+        if (results[i].error) {
+            // Failed sources become exception instances, in place
+            value = PyObject_CallFunction(
+                PyExc_OSError, "isO", results[i].error, strerror(results[i].error),
+                PyList_GetItem(items, i)
+            );
+        } else if (keep_trees) {
+            value = tree_wrap(state, results[i].tree, NULL);
+            results[i].tree = NULL;
+        } else {
+            value = summary_to_dict(&results[i].summary);
+            if (value != NULL && directory != NULL &&
+                PyDict_SetItemString(value, "cached", results[i].cached ? Py_True : Py_False) < 0) {
+                Py_CLEAR(value);
+            }
+        }
+        if (value == NULL) {
+            Py_CLEAR(output);
+            goto done;
+        }
+        PyList_SetItem(output, i, value);
+    }
+
+done:
+    if (results != NULL) {
+        for (Py_ssize_t i = 0; i < count; i++) {
+            ts_tree_delete(results[i].tree);
+        }
+    }
+    for (Py_ssize_t i = 0; i < view_count; i++) {
+        PyBuffer_Release(&views[i]);
+    }
+    PyMem_Free(views);
+    PyMem_Free(inputs);
+    PyMem_Free(results);
+    Py_DECREF(paths);
+    Py_DECREF(items);
+    Py_XDECREF(directory);
+    return output;
+}
+
+/* Scanner statistics */
+
+#ifdef CODON_SCANNER_STATS
+static PyObject *
+scanner_stats_to_dict(const CodonScannerStats *stats)
+{
+    PyObject *dict = PyDict_New();
+    PyObject *tokens = PyDict_New();
+    PyObject *histogram = PyList_New(CODON_SCANNER_HISTOGRAM_SIZE);
+    if (dict == NULL || tokens == NULL || histogram == NULL) goto error;
+
+    if (dict_set_count(dict, "scan_calls", stats->scan_calls) < 0 ||
+        dict_set_count(dict, "error_recovery_calls", stats->error_recovery_calls) < 0 ||
+        dict_set_count(dict, "pending_dedent_calls", stats->pending_dedent_calls) < 0 ||
+        dict_set_count(dict, "string_calls", stats->string_calls) < 0 ||
+        dict_set_count(dict, "newline_calls", stats->newline_calls) < 0 ||
+        dict_set_count(dict, "wasted_calls", stats->wasted_calls) < 0 ||
+        dict_set_count(dict, "wasted_chars", stats->wasted_chars) < 0 ||
+        dict_set_count(dict, "chars", stats->chars) < 0 ||
+        dict_set_count(dict, "serialize_calls", stats->serialize_calls) < 0 ||
+        dict_set_count(dict, "serialize_bytes", stats->serialize_bytes) < 0 ||
+        dict_set_count(dict, "deserialize_calls", stats->deserialize_calls) < 0 ||
+        dict_set_count(dict, "deserialize_bytes", stats->deserialize_bytes) < 0) {
+        goto error;
+    }
+    for (int i = 0; i < CODON_SCANNER_TOKEN_COUNT; i++) {
+        if (dict_set_count(tokens, codon_scanner_token_names[i], stats->tokens[i]) < 0) goto error;
+    }
+    for (int i = 0; i < CODON_SCANNER_HISTOGRAM_SIZE; i++) {
+        PyObject *number = PyLong_FromUnsignedLongLong(stats->chars_histogram[i]);
+        if (number == NULL) goto error;
+        PyList_SetItem(histogram, i, number);
+    }
+    if (PyDict_SetItemString(dict, "tokens", tokens) < 0 ||
+        PyDict_SetItemString(dict, "chars_histogram", histogram) < 0) {
+        goto error;
+    }
+    Py_DECREF(tokens);
+    Py_DECREF(histogram);
+    return dict;
+
+error:
+    Py_XDECREF(dict);
+    Py_XDECREF(tokens);
+    Py_XDECREF(histogram);
+    return NULL;
+}
+#endif
+
+static PyObject *
+py_scanner_stats(PyObject *self, PyObject *args)
+{
+#ifdef CODON_SCANNER_STATS
+    CodonScannerStats stats;
+    codon_scanner_stats_read(&stats);
+    return scanner_stats_to_dict(&stats);
+#else
+    PyErr_SetString(PyExc_RuntimeError, "built without CODON_SCANNER_STATS");
+    return NULL;
+#endif
+}
+
+static PyObject *
+py_reset_scanner_stats(PyObject *self, PyObject *args)
+{
+#ifdef CODON_SCANNER_STATS
+    codon_scanner_stats_reset();
+    Py_RETURN_NONE;
+#else
+    PyErr_SetString(PyExc_RuntimeError, "built without CODON_SCANNER_STATS");
+    return NULL;
+#endif
+}
+
+/* Symbol tables */
+
+static PyObject *
+py_symbol_names(PyObject *self, PyObject *args)
+{
+    const TSLanguage *language = tree_sitter_codon();
+    uint32_t count = ts_language_symbol_count(language);
+    PyObject *names = PyTuple_New(count);
+    if (names == NULL) return NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        PyObject *name = PyUnicode_FromString(ts_language_symbol_name(language, (TSSymbol)i));
+        if (name == NULL) {
+            Py_DECREF(names);
+            return NULL;
+        }
+        PyTuple_SetItem(names, i, name);
+    }
+    return names;
+}
+
+static PyObject *
+py_field_names(PyObject *self, PyObject *args)
+{
+    const TSLanguage *language = tree_sitter_codon();
+    uint32_t count = ts_language_field_count(language);
+    PyObject *names = PyTuple_New((Py_ssize_t)count + 1);
+    if (names == NULL) return NULL;
+    // Field ids start at 1
+    Py_INCREF(Py_None);
+    PyTuple_SetItem(names, 0, Py_None);
+    for (uint32_t i = 1; i <= count; i++) {
+        PyObject *name = PyUnicode_FromString(ts_language_field_name_for_id(language, (TSFieldId)i));
+        if (name == NULL) {
+            Py_DECREF(names);
+            return NULL;
+        }
+        PyTuple_SetItem(names, i, name);
+    }
+    return names;
 }
 
 static PyMethodDef module_methods[] = {
     {"language", py_language, METH_NOARGS,
      "Get the tree-sitter Language object for Codon."},
+    {"parse", py_parse, METH_O,
+     "Parse a buffer-protocol object in place, without copying it."},
+    {"parse_with_stats", py_parse_with_stats, METH_O,
+     "Parse like parse, and return (tree, statistics from the parse log)."},
+    {"parse_stream", py_parse_stream, METH_VARARGS,
+     "Parse a binary file or reader callable chunk by chunk, reading only with the GIL."},
+    {"parse_many", (PyCFunction)(void (*)(void))py_parse_many, METH_VARARGS | METH_KEYWORDS,
+     "Parse paths or bytes on a thread pool with the GIL released."},
+    {"cached_summary", py_cached_summary, METH_VARARGS,
+     "Summarize a source through the on-disk summary cache in a directory."},
+    {"prescan", py_prescan, METH_O,
+     "Read the directives and imports at the top of a source without parsing it."},
+    {"scanner_stats", py_scanner_stats, METH_NOARGS,
+     "External scanner counters summed over every scanner in the process."},
+    {"reset_scanner_stats", py_reset_scanner_stats, METH_NOARGS,
+     "Zero the external scanner counters."},
+    {"symbol_names", py_symbol_names, METH_NOARGS,
+     "Node type names indexed by symbol id."},
+    {"field_names", py_field_names, METH_NOARGS,
+     "Field names indexed by field id; id 0 (no field) is None."},
     {NULL, NULL, 0, NULL}
 };
 
+// Adds a tuple of `count` strings to `module`
+static int
+add_names(PyObject *module, const char *attribute, const char *const *names, Py_ssize_t count)
+{
+    PyObject *tuple = PyTuple_New(count);
+    if (tuple == NULL) return -1;
+    for (Py_ssize_t i = 0; i < count; i++) {
+        PyObject *name = PyUnicode_FromString(names[i]);
+        if (name == NULL) {
+            Py_DECREF(tuple);
+            return -1;
+        }
+        PyTuple_SetItem(tuple, i, name);
+    }
+    if (PyModule_AddObject(module, attribute, tuple) < 0) {
+        Py_DECREF(tuple);
+        return -1;
+    }
+    return 0;
+}
+
+// Creates the type of `spec`, bound to `module`, and adds it under `name`.
+// The state keeps its own reference.
+static int
+add_type(PyObject *module, PyType_Spec *spec, const char *name, PyObject **slot)
+{
+    *slot = PyType_FromModuleAndSpec(module, spec, NULL);
+    if (*slot == NULL) return -1;
+    Py_INCREF(*slot);
+    if (PyModule_AddObject(module, name, *slot) < 0) {
+        Py_DECREF(*slot);
+        return -1;
+    }
+    return 0;
+}
+
+static int
+module_exec(PyObject *module)
+{
+    ModuleState *state = module_state(module);
+    codon_parser_pool_init(&state->parser_pool);
+
+    if (add_type(module, &tree_spec, "Tree", &state->tree_type) < 0
+        || add_type(module, &columns_spec, "Columns", &state->columns_type) < 0
+        || add_type(module, &edit_session_spec, "EditSession", &state->edit_session_type) < 0
+        || add_type(module, &injection_cache_spec, "InjectionCache", &state->injection_cache_type) < 0
+        || add_type(module, &highlighter_spec, "Highlighter", &state->highlighter_type) < 0
+        || add_type(module, &tree_cache_spec, "TreeCache", &state->tree_cache_type) < 0
+        || add_type(module, &parse_job_spec, "ParseJob", &state->parse_job_type) < 0) {
+        return -1;
+    }
+
+    if (add_names(module, "TAG_KINDS", codon_tag_kind_names, CODON_TAG_KIND_COUNT) < 0
+        || add_names(module, "COLUMNS", codon_column_names, CODON_COLUMN_COUNT) < 0) {
+        return -1;
+    }
+
+    state->language_capsule = PyCapsule_New((void *)tree_sitter_codon(), "tree_sitter.Language", NULL);
+    return state->language_capsule != NULL ? 0 : -1;
+}
+
+static int
+module_traverse(PyObject *module, visitproc visit, void *arg)
+{
+    ModuleState *state = module_state(module);
+    Py_VISIT(state->tree_type);
+    Py_VISIT(state->columns_type);
+    Py_VISIT(state->edit_session_type);
+    Py_VISIT(state->injection_cache_type);
+    Py_VISIT(state->highlighter_type);
+    Py_VISIT(state->tree_cache_type);
+    Py_VISIT(state->parse_job_type);
+    Py_VISIT(state->language_capsule);
+    return 0;
+}
+
+static int
+module_clear(PyObject *module)
+{
+    ModuleState *state = module_state(module);
+    Py_CLEAR(state->tree_type);
+    Py_CLEAR(state->columns_type);
+    Py_CLEAR(state->edit_session_type);
+    Py_CLEAR(state->injection_cache_type);
+    Py_CLEAR(state->highlighter_type);
+    Py_CLEAR(state->tree_cache_type);
+    Py_CLEAR(state->parse_job_type);
+    Py_CLEAR(state->language_capsule);
+    return 0;
+}
+
+static void
+module_free(void *module)
+{
+    module_clear((PyObject *)module);
+    codon_parser_pool_destroy(&module_state((PyObject *)module)->parser_pool);
+}
+
+static PyModuleDef_Slot module_slots[] = {
+    {Py_mod_exec, module_exec},
+#ifdef Py_mod_multiple_interpreters
+    {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+#ifdef Py_mod_gil
+    // Native state is either immutable (trees, columns, highlighters) or
+    // guarded by its own mutex (edit sessions, parse jobs, injection and
+    // tree caches, the parser pool), so the module runs without the GIL on
+    // free-threaded builds
+    {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+    {0, NULL}
+};
+
 static struct PyModuleDef module_def = {
     PyModuleDef_HEAD_INIT,
     "_binding",
     "Codon tree-sitter grammar binding",
-    -1,
+    sizeof(ModuleState),
     module_methods,
-    NULL,
-    NULL,
-    NULL,
-    NULL
+    module_slots,
+    module_traverse,
+    module_clear,
+    module_free
 };
 
 PyMODINIT_FUNC
 PyInit__binding(void)
 {
-    return PyModule_Create(&module_def);
+    return PyModuleDef_Init(&module_def);
 }
@@ -764,10 +764,12 @@ module.exports = grammar({
     // Codon: pipe expression (a |> b, a ||> b)
     pipe_expression: $ => prec.left(PREC.pipe, seq(
       field('left', $.expression),
-      field('operator', choice('|>', '||>')),
+      field('operator', $.pipe_operator),
       field('right', $.expression),
     )),
 
+    pipe_operator: $ => choice('|>', '||>'),
+
     primary_expression: $ => choice(
       $.binary_operator,
       $.identifier,
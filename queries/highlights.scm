@@ -183,13 +183,6 @@
 ; Codon: range operator
 "..." @operator.range
 
-; Codon: directive
-(directive
-  "##" @keyword.directive
-  "codon:" @keyword.directive
-  key: (identifier) @property
-  value: _ @constant)
-
 ; Codon: C import
 (c_typed_import
   name: (dotted_name) @variable
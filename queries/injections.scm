@@ -0,0 +1,13 @@
+; Codon injections queries for tree-sitter
+;
+; Bodies of @llvm and @python extern functions are LLVM IR and Python.
+
+((extern_function
+  extern_type: "llvm"
+  body: (extern_block) @injection.content)
+ (#set! injection.language "llvm"))
+
+((extern_function
+  extern_type: "python"
+  body: (extern_block) @injection.content)
+ (#set! injection.language "python"))
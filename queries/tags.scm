@@ -0,0 +1,37 @@
+; Codon tags queries for tree-sitter
+;
+; The native extractor in bindings/c/codon_tags.c reports the same
+; definitions without running a query.
+
+(function_definition
+  name: (identifier) @name) @definition.function
+
+(class_definition
+  name: (identifier) @name) @definition.class
+
+; Codon: @llvm / @python extern functions, by extern_type
+(extern_function
+  extern_type: "llvm"
+  name: (identifier) @name) @definition.llvm_function
+
+(extern_function
+  extern_type: "python"
+  name: (identifier) @name) @definition.python_function
+
+; Codon: from C import foo, bar: int, baz as qux
+(import_from_statement
+  module_name: "C"
+  name: [
+    (dotted_name) @name
+    (c_typed_import
+      name: (dotted_name) @name)
+    (aliased_import
+      alias: (identifier) @name)
+  ] @definition.c_import)
+
+(call
+  function: [
+    (identifier) @name
+    (attribute
+      attribute: (identifier) @name)
+  ]) @reference.call
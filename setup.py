@@ -1,8 +1,110 @@
 from setuptools import Extension, setup
 from setuptools.command.build_ext import build_ext
+from setuptools.command.build_py import build_py
 from pathlib import Path
+import os
+import shutil
 import subprocess
+import hashlib
 import sys
+import sysconfig
+import tarfile
+import tempfile
+import urllib.request
+
+
+# The runtime release compiled into the native API when TREE_SITTER_DIR is
+# unset; keep it in step with the cibuildwheel before-all in pyproject.toml
+TREE_SITTER_VERSION = "0.25.0"
+
+# SHA-256 of the TREE_SITTER_VERSION source archive. A download is only
+# extracted when it matches; TREE_SITTER_SHA256 in the environment overrides
+# it, and with neither set nothing is fetched and TREE_SITTER_DIR is required
+TREE_SITTER_SHA256 = ""
+
+
+def fetch_tree_sitter():
+    """Download the runtime sources of TREE_SITTER_VERSION into build/, once."""
+    root = Path("build") / f"tree-sitter-{TREE_SITTER_VERSION}"
+    if (root / "lib" / "src" / "lib.c").exists():
+        return root
+
+    url = (
+        "https://github.com/tree-sitter/tree-sitter/archive/refs/tags/"
+        f"v{TREE_SITTER_VERSION}.tar.gz"
+    )
+    expected = os.environ.get("TREE_SITTER_SHA256", TREE_SITTER_SHA256).lower()
+    if not expected:
+        sys.exit(
+            f"no SHA-256 is pinned for the tree-sitter v{TREE_SITTER_VERSION} "
+            "archive; set TREE_SITTER_DIR to a tree-sitter checkout, or "
+            "TREE_SITTER_SHA256 to the digest of the release archive"
+        )
+
+    top = f"tree-sitter-{TREE_SITTER_VERSION}/"
+    print(f"fetching the tree-sitter runtime from {url}")
+    root.parent.mkdir(parents=True, exist_ok=True)
+    staging = Path(tempfile.mkdtemp(prefix="tree-sitter-", dir=root.parent))
+    download = staging / "archive.tar.gz"
+    try:
+        digest = hashlib.sha256()
+        with urllib.request.urlopen(url, timeout=60) as response, \
+                open(download, "wb") as out:
+            for chunk in iter(lambda: response.read(1 << 16), b""):
+                digest.update(chunk)
+                out.write(chunk)
+        if digest.hexdigest() != expected:
+            shutil.rmtree(staging, ignore_errors=True)
+            sys.exit(
+                f"the tree-sitter archive from {url} has SHA-256 "
+                f"{digest.hexdigest()}, expected {expected}"
+            )
+        with tarfile.open(download, mode="r:gz") as archive:
+            # Only lib/ is needed; skip links and anything escaping the tree
+            for member in archive:
+                name = member.name
+                if not name.startswith(top + "lib/") or ".." in Path(name).parts:
+                    continue
+                if not (member.isfile() or member.isdir()):
+                    continue
+                member.name = name[len(top):]
+                archive.extract(member, staging)
+    except (OSError, tarfile.TarError) as error:
+        shutil.rmtree(staging, ignore_errors=True)
+        sys.exit(
+            f"could not download the tree-sitter runtime ({error}); "
+            "set TREE_SITTER_DIR to a tree-sitter checkout to build offline"
+        )
+    download.unlink()
+    shutil.rmtree(root, ignore_errors=True)
+    staging.rename(root)
+    return root
+
+
+def tree_sitter_runtime():
+    """Locate the tree-sitter runtime sources compiled into the native API.
+
+    TREE_SITTER_DIR may point at a tree-sitter checkout; otherwise the
+    TREE_SITTER_VERSION release is fetched into build/. Either way lib.c is
+    compiled into the extension, so wheels never depend on a system
+    libtree-sitter.
+    """
+    root = os.environ.get("TREE_SITTER_DIR")
+    lib = (Path(root) if root else fetch_tree_sitter()) / "lib"
+    return {
+        "sources": [str(lib / "src" / "lib.c")],
+        "include_dirs": [str(lib / "include"), str(lib / "src")],
+    }
+
+
+# CODON_SCANNER_STATS=1 compiles the external scanner counters in
+scanner_stats = os.environ.get("CODON_SCANNER_STATS", "") not in ("", "0")
+
+# The buffer protocol joined the limited API in 3.11, so older interpreters
+# build against the full API instead of abi3. Free-threaded interpreters
+# (3.13t) have no limited API and get a wheel of their own.
+free_threaded = bool(sysconfig.get_config_var("Py_GIL_DISABLED"))
+limited_api = sys.version_info >= (3, 11) and not free_threaded
 
 class TreeSitterBuildExt(build_ext):
     """Custom build command to generate parser before building."""
@@ -15,7 +117,22 @@ class TreeSitterBuildExt(build_ext):
                 [sys.executable, "-m", "tree_sitter_cli", "generate"],
                 check=True,
             )
+        # Resolved here rather than at import, so sdist and metadata
+        # commands never fetch the runtime
+        runtime = tree_sitter_runtime()
+        for ext in self.extensions:
+            ext.sources.extend(runtime["sources"])
+            ext.include_dirs.extend(runtime["include_dirs"])
+        super().run()
+
+
+class TreeSitterBuildPy(build_py):
+    """Ship the query files inside the package, where _get_query reads them."""
+
+    def run(self):
         super().run()
+        if not self.dry_run:
+            self.copy_tree("queries", str(Path(self.build_lib) / "tree_sitter_codon" / "queries"))
 
 
 setup(
@@ -39,6 +156,8 @@ setup(
         "Programming Language :: Python :: 3.10",
         "Programming Language :: Python :: 3.11",
         "Programming Language :: Python :: 3.12",
+        "Programming Language :: Python :: 3.13",
+        "Programming Language :: Python :: Free Threading :: 2 - Beta",
         "Topic :: Software Development :: Compilers",
         "Topic :: Text Processing :: Linguistic",
     ],
@@ -50,20 +169,38 @@ setup(
             name="tree_sitter_codon._binding",
             sources=[
                 "bindings/python/tree_sitter_codon/binding.c",
+                "bindings/c/codon_cache.c",
+                "bindings/c/codon_columns.c",
+                "bindings/c/codon_edit.c",
+                "bindings/c/codon_highlight.c",
+                "bindings/c/codon_injection.c",
+                "bindings/c/codon_job.c",
+                "bindings/c/codon_memory.c",
+                "bindings/c/codon_parse.c",
+                "bindings/c/codon_prescan.c",
+                "bindings/c/codon_stats.c",
+                "bindings/c/codon_stream.c",
+                "bindings/c/codon_summary.c",
+                "bindings/c/codon_tags.c",
                 "src/parser.c",
                 "src/scanner.c",
             ],
-            extra_compile_args=["-std=c11"] if sys.platform != "win32" else [],
+            extra_compile_args=["-std=c11", "-pthread"] if sys.platform != "win32" else [],
+            extra_link_args=["-pthread"] if sys.platform != "win32" else [],
             define_macros=[
-                ("Py_LIMITED_API", "0x03090000"),
+                *([("Py_LIMITED_API", "0x030B0000")] if limited_api else []),
                 ("PY_SSIZE_T_CLEAN", None),
+                *([("CODON_SCANNER_STATS", None)] if scanner_stats else []),
             ],
-            include_dirs=["src"],
-            py_limited_api=True,
+            include_dirs=["src", "bindings/c"],
+            py_limited_api=limited_api,
         )
     ],
-    cmdclass={"build_ext": TreeSitterBuildExt},
-    install_requires=["tree-sitter>=0.23,<1.0"],
+    cmdclass={"build_ext": TreeSitterBuildExt, "build_py": TreeSitterBuildPy},
+    # One cp311-abi3 wheel serves every later GIL-enabled interpreter
+    options={"bdist_wheel": {"py_limited_api": "cp311"}} if limited_api else {},
+    # The language is ABI 15, which py-tree-sitter loads from 0.25 on
+    install_requires=["tree-sitter>=0.25,<1.0"],
     extras_require={
         "dev": ["tree-sitter-cli>=0.23"],
     },
@@ -5,8 +5,10 @@
  * - NEWLINE tokens
  * - INDENT tokens
  * - DEDENT tokens
- * - String handling (prefix, content, escape sequences)
- * - Extern block content (for @llvm/@python decorators)
+ * - String handling (prefix, content up to each interpolation)
+ *
+ * Extern (@llvm/@python) bodies are not scanned here: the grammar lexes
+ * them one extern_line at a time between INDENT and DEDENT.
  */
 
 #include "tree_sitter/parser.h"
@@ -16,22 +18,88 @@
 #include <string.h>
 #include <stdio.h>
 
+#ifdef CODON_SCANNER_STATS
+#include "codon.h"
+#define STAT(scanner, expression) ((void)((scanner)->stats.expression))
+#else
+#define STAT(scanner, expression) ((void)0)
+#endif
+
 enum TokenType {
     NEWLINE,
     INDENT,
     DEDENT,
     STRING_START,
     STRING_CONTENT,
+    // No longer produced: `{{` and `}}` are part of STRING_CONTENT. Kept,
+    // with its grammar external, until src/ is regenerated, so the token
+    // numbers match the externals in the generated parser.
     ESCAPE_INTERPOLATION,
     STRING_END,
+    // Declared in the grammar but valid in no parse state, so never
+    // produced. Keeps the token numbers aligned with src/parser.c.
     EXTERN_CONTENT,
     PREC,
 };
 
-typedef struct {
-    Array(uint16_t) indents;
-    Array(int32_t) delimiters;
-    bool inside_f_string;
+// Delimiter flags, stored above the quote character
+enum {
+    DELIMITER_TRIPLE = 0x100,
+    DELIMITER_RAW = 0x200,
+    DELIMITER_FORMAT = 0x400,
+};
+
+// Characters of string content scanned per call during error recovery
+#define ERROR_RECOVERY_LOOKAHEAD 256
+
+// Inline storage sized for realistic nesting; deeper stacks spill to the heap
+#define INLINE_INDENT_CAPACITY 32
+#define INLINE_DELIMITER_CAPACITY 8
+
+// Array with inline storage. The leading fields match Array, so the
+// read-only array_* macros (array_get, array_back, array_pop, array_clear)
+// work on it; only init, push and delete need the stack_* versions.
+#define Stack(T, N) \
+    struct { T *contents; uint32_t size; uint32_t capacity; T storage[N]; }
+
+#define stack_init(self) \
+    ((self)->contents = (self)->storage, (self)->size = 0, \
+     (self)->capacity = sizeof((self)->storage) / sizeof(*(self)->storage))
+
+#define stack_push(self, element) \
+    ((self)->size == (self)->capacity \
+         ? stack__grow((void **)&(self)->contents, &(self)->capacity, (self)->size, \
+                       array_elem_size(self), (self)->storage) \
+         : (void)0, \
+     (self)->contents[(self)->size++] = (element))
+
+#define stack_delete(self) \
+    ((self)->contents != (self)->storage ? ts_free((self)->contents) : (void)0, \
+     stack_init(self))
+
+static void stack__grow(void **contents, uint32_t *capacity, uint32_t size,
+                        size_t element_size, void *storage) {
+    uint32_t new_capacity = *capacity * 2;
+    if (*contents == storage) {
+        void *heap = ts_malloc(new_capacity * element_size);
+        memcpy(heap, storage, size * element_size);
+        *contents = heap;
+    } else {
+        *contents = ts_realloc(*contents, new_capacity * element_size);
+    }
+    *capacity = new_capacity;
+}
+
+typedef struct Scanner {
+    Stack(uint16_t, INLINE_INDENT_CAPACITY) indents;
+    Stack(int32_t, INLINE_DELIMITER_CAPACITY) delimiters;
+    // Levels already closed by the last NEWLINE but not yet emitted as DEDENT
+    uint32_t pending_dedents;
+#ifdef CODON_SCANNER_STATS
+    CodonScannerStats stats;
+    struct Scanner *stats_previous;
+    struct Scanner *stats_next;
+#endif
 } Scanner;
 
 static inline void advance(TSLexer *lexer) { lexer->advance(lexer, false); }
@@ -45,103 +113,230 @@ static inline bool is_newline(int32_t c) {
     return c == '\n' || c == '\r';
 }
 
+static inline void consume_newline(TSLexer *lexer, bool skip) {
+    bool is_cr = lexer->lookahead == '\r';
+    lexer->advance(lexer, skip);
+    if (is_cr && lexer->lookahead == '\n') {
+        lexer->advance(lexer, skip);
+    }
+}
+
+// PREC never appears in a grammar rule, so it is only valid while the
+// parser is recovering from an error and every external token is valid.
+static inline bool in_error_recovery(const bool *valid_symbols) {
+    return valid_symbols[PREC];
+}
+
+#ifdef CODON_SCANNER_STATS
+
+// Every live scanner is linked into one list so the counters can be read
+// and reset without access to the parsers that own them. Destroyed
+// scanners fold their counters into `stats_retired`.
+static CodonMutex stats_lock = CODON_MUTEX_INITIALIZER;
+static Scanner *stats_live = NULL;
+static CodonScannerStats stats_retired;
+
+const char *const codon_scanner_token_names[CODON_SCANNER_TOKEN_COUNT] = {
+    "newline", "indent", "dedent", "string_start", "string_content",
+    "escape_interpolation", "string_end", "extern_content",
+};
+
+static void stats_add(CodonScannerStats *total, const CodonScannerStats *stats) {
+    // Every field is a uint64_t counter
+    uint64_t *to = (uint64_t *)total;
+    const uint64_t *from = (const uint64_t *)stats;
+    for (size_t i = 0; i < sizeof(CodonScannerStats) / sizeof(uint64_t); i++) {
+        to[i] += from[i];
+    }
+}
+
+static void stats_register(Scanner *scanner) {
+    codon_mutex_lock(&stats_lock);
+    scanner->stats_previous = NULL;
+    scanner->stats_next = stats_live;
+    if (stats_live != NULL) stats_live->stats_previous = scanner;
+    stats_live = scanner;
+    codon_mutex_unlock(&stats_lock);
+}
+
+static void stats_unregister(Scanner *scanner) {
+    codon_mutex_lock(&stats_lock);
+    stats_add(&stats_retired, &scanner->stats);
+    if (scanner->stats_previous != NULL) {
+        scanner->stats_previous->stats_next = scanner->stats_next;
+    } else {
+        stats_live = scanner->stats_next;
+    }
+    if (scanner->stats_next != NULL) scanner->stats_next->stats_previous = scanner->stats_previous;
+    codon_mutex_unlock(&stats_lock);
+}
+
+void codon_scanner_stats_read(CodonScannerStats *stats) {
+    codon_mutex_lock(&stats_lock);
+    *stats = stats_retired;
+    for (Scanner *scanner = stats_live; scanner != NULL; scanner = scanner->stats_next) {
+        stats_add(stats, &scanner->stats);
+    }
+    codon_mutex_unlock(&stats_lock);
+}
+
+void codon_scanner_stats_reset(void) {
+    codon_mutex_lock(&stats_lock);
+    memset(&stats_retired, 0, sizeof(stats_retired));
+    for (Scanner *scanner = stats_live; scanner != NULL; scanner = scanner->stats_next) {
+        memset(&scanner->stats, 0, sizeof(scanner->stats));
+    }
+    codon_mutex_unlock(&stats_lock);
+}
+
+#endif
+
 void *tree_sitter_codon_external_scanner_create(void) {
     Scanner *scanner = ts_calloc(1, sizeof(Scanner));
-    array_init(&scanner->indents);
-    array_init(&scanner->delimiters);
-    scanner->inside_f_string = false;
+    stack_init(&scanner->indents);
+    stack_init(&scanner->delimiters);
+    scanner->pending_dedents = 0;
+#ifdef CODON_SCANNER_STATS
+    stats_register(scanner);
+#endif
     return scanner;
 }
 
 void tree_sitter_codon_external_scanner_destroy(void *payload) {
     Scanner *scanner = (Scanner *)payload;
-    array_delete(&scanner->indents);
-    array_delete(&scanner->delimiters);
+#ifdef CODON_SCANNER_STATS
+    stats_unregister(scanner);
+#endif
+    stack_delete(&scanner->indents);
+    stack_delete(&scanner->delimiters);
     ts_free(scanner);
 }
 
-unsigned tree_sitter_codon_external_scanner_serialize(void *payload, char *buffer) {
-    Scanner *scanner = (Scanner *)payload;
-    unsigned size = 0;
+// Serialized state layout (all counts and indents are LEB128 varints):
+//   indent count, indent deltas from the previous level,
+//   delimiter count, one packed byte per delimiter,
+//   pending dedent count (omitted when zero).
+// An empty state serializes to zero bytes.
+enum {
+    PACKED_SINGLE_QUOTE = 0x01,
+    PACKED_TRIPLE = 0x02,
+    PACKED_RAW = 0x04,
+    PACKED_FORMAT = 0x08,
+};
+
+static inline uint8_t pack_delimiter(int32_t delim) {
+    return ((delim & 0xFF) == '\'' ? PACKED_SINGLE_QUOTE : 0) |
+           ((delim & DELIMITER_TRIPLE) ? PACKED_TRIPLE : 0) |
+           ((delim & DELIMITER_RAW) ? PACKED_RAW : 0) |
+           ((delim & DELIMITER_FORMAT) ? PACKED_FORMAT : 0);
+}
+
+static inline int32_t unpack_delimiter(uint8_t packed) {
+    return ((packed & PACKED_SINGLE_QUOTE) ? '\'' : '"') |
+           ((packed & PACKED_TRIPLE) ? DELIMITER_TRIPLE : 0) |
+           ((packed & PACKED_RAW) ? DELIMITER_RAW : 0) |
+           ((packed & PACKED_FORMAT) ? DELIMITER_FORMAT : 0);
+}
+
+// Returns the new size, or 0 if the value does not fit in the buffer.
+static inline unsigned write_varint(char *buffer, unsigned size, uint32_t value) {
+    do {
+        if (size >= TREE_SITTER_SERIALIZATION_BUFFER_SIZE) return 0;
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        buffer[size++] = (char)(value ? byte | 0x80 : byte);
+    } while (value);
+    return size;
+}
+
+// Returns false if the buffer ends before the varint does.
+static inline bool read_varint(const char *buffer, unsigned length, unsigned *size, uint32_t *value) {
+    *value = 0;
+    for (unsigned shift = 0; shift < 32; shift += 7) {
+        if (*size >= length) return false;
+        uint8_t byte = (uint8_t)buffer[(*size)++];
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+static unsigned serialize(Scanner *scanner, char *buffer) {
+    // Fast path: nothing is open (pending dedents always have open indents)
+    if (scanner->indents.size == 0 && scanner->delimiters.size == 0) {
+        return 0;
+    }
     
-    // Serialize indent count
-    uint32_t indent_count = scanner->indents.size;
-    if (size + sizeof(uint32_t) > TREE_SITTER_SERIALIZATION_BUFFER_SIZE) return 0;
-    memcpy(&buffer[size], &indent_count, sizeof(uint32_t));
-    size += sizeof(uint32_t);
+    unsigned size = 0;
     
-    // Serialize indents
-    for (uint32_t i = 0; i < indent_count; i++) {
-        if (size + sizeof(uint16_t) > TREE_SITTER_SERIALIZATION_BUFFER_SIZE) return 0;
+    // Serialize indents as deltas; levels only ever grow, so most fit in a byte
+    size = write_varint(buffer, size, scanner->indents.size);
+    if (size == 0) return 0;
+    uint16_t previous = 0;
+    for (uint32_t i = 0; i < scanner->indents.size; i++) {
         uint16_t indent = *array_get(&scanner->indents, i);
-        memcpy(&buffer[size], &indent, sizeof(uint16_t));
-        size += sizeof(uint16_t);
+        size = write_varint(buffer, size, (uint16_t)(indent - previous));
+        if (size == 0) return 0;
+        previous = indent;
     }
     
-    // Serialize delimiter count
-    uint32_t delim_count = scanner->delimiters.size;
-    if (size + sizeof(uint32_t) > TREE_SITTER_SERIALIZATION_BUFFER_SIZE) return 0;
-    memcpy(&buffer[size], &delim_count, sizeof(uint32_t));
-    size += sizeof(uint32_t);
-    
     // Serialize delimiters
-    for (uint32_t i = 0; i < delim_count; i++) {
-        if (size + sizeof(int32_t) > TREE_SITTER_SERIALIZATION_BUFFER_SIZE) return 0;
-        int32_t delim = *array_get(&scanner->delimiters, i);
-        memcpy(&buffer[size], &delim, sizeof(int32_t));
-        size += sizeof(int32_t);
+    size = write_varint(buffer, size, scanner->delimiters.size);
+    if (size == 0) return 0;
+    if (size + scanner->delimiters.size > TREE_SITTER_SERIALIZATION_BUFFER_SIZE) return 0;
+    for (uint32_t i = 0; i < scanner->delimiters.size; i++) {
+        buffer[size++] = (char)pack_delimiter(*array_get(&scanner->delimiters, i));
     }
     
-    // Serialize f-string state
-    if (size + 1 > TREE_SITTER_SERIALIZATION_BUFFER_SIZE) return 0;
-    buffer[size++] = scanner->inside_f_string ? 1 : 0;
+    if (scanner->pending_dedents > 0) {
+        size = write_varint(buffer, size, scanner->pending_dedents);
+        if (size == 0) return 0;
+    }
     
     return size;
 }
 
+unsigned tree_sitter_codon_external_scanner_serialize(void *payload, char *buffer) {
+    Scanner *scanner = (Scanner *)payload;
+    unsigned size = serialize(scanner, buffer);
+    STAT(scanner, serialize_calls++);
+    STAT(scanner, serialize_bytes += size);
+    return size;
+}
+
 void tree_sitter_codon_external_scanner_deserialize(void *payload, const char *buffer, unsigned length) {
     Scanner *scanner = (Scanner *)payload;
+    STAT(scanner, deserialize_calls++);
+    STAT(scanner, deserialize_bytes += length);
     array_clear(&scanner->indents);
     array_clear(&scanner->delimiters);
-    scanner->inside_f_string = false;
+    scanner->pending_dedents = 0;
     
     if (length == 0) return;
     
     unsigned size = 0;
-    
-    // Deserialize indent count
-    if (size + sizeof(uint32_t) > length) return;
-    uint32_t indent_count;
-    memcpy(&indent_count, &buffer[size], sizeof(uint32_t));
-    size += sizeof(uint32_t);
+    uint32_t count;
     
     // Deserialize indents
-    for (uint32_t i = 0; i < indent_count; i++) {
-        if (size + sizeof(uint16_t) > length) return;
-        uint16_t indent;
-        memcpy(&indent, &buffer[size], sizeof(uint16_t));
-        size += sizeof(uint16_t);
-        array_push(&scanner->indents, indent);
+    if (!read_varint(buffer, length, &size, &count)) return;
+    uint16_t indent = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t delta;
+        if (!read_varint(buffer, length, &size, &delta)) return;
+        indent += (uint16_t)delta;
+        stack_push(&scanner->indents, indent);
     }
     
-    // Deserialize delimiter count
-    if (size + sizeof(uint32_t) > length) return;
-    uint32_t delim_count;
-    memcpy(&delim_count, &buffer[size], sizeof(uint32_t));
-    size += sizeof(uint32_t);
-    
     // Deserialize delimiters
-    for (uint32_t i = 0; i < delim_count; i++) {
-        if (size + sizeof(int32_t) > length) return;
-        int32_t delim;
-        memcpy(&delim, &buffer[size], sizeof(int32_t));
-        size += sizeof(int32_t);
-        array_push(&scanner->delimiters, delim);
+    if (!read_varint(buffer, length, &size, &count)) return;
+    for (uint32_t i = 0; i < count && size < length; i++) {
+        stack_push(&scanner->delimiters, unpack_delimiter((uint8_t)buffer[size++]));
     }
     
-    // Deserialize f-string state
-    if (size + 1 <= length) {
-        scanner->inside_f_string = buffer[size++] == 1;
+    // Deserialize pending dedents
+    uint32_t pending;
+    if (read_varint(buffer, length, &size, &pending) && pending <= scanner->indents.size) {
+        scanner->pending_dedents = pending;
     }
 }
 
@@ -158,14 +353,14 @@ static bool scan_newline(Scanner *scanner, TSLexer *lexer, const bool *valid_sym
         }
     }
     
-    if (!is_newline(lexer->lookahead)) {
+    // The end of the file ends the last line even without a newline
+    if (!is_newline(lexer->lookahead) && !lexer->eof(lexer)) {
         return false;
     }
     
     // Consume newline
-    advance(lexer);
-    if (lexer->lookahead == '\n') {
-        advance(lexer);
+    if (is_newline(lexer->lookahead)) {
+        consume_newline(lexer, false);
     }
     
     lexer->result_symbol = NEWLINE;
@@ -186,10 +381,7 @@ static bool scan_newline(Scanner *scanner, TSLexer *lexer, const bool *valid_sym
             }
         }
         if (is_newline(lexer->lookahead)) {
-            skip(lexer);
-            if (lexer->lookahead == '\n') {
-                skip(lexer);
-            }
+            consume_newline(lexer, true);
         }
         indent = 0;
         while (is_space(lexer->lookahead)) {
@@ -204,199 +396,206 @@ static bool scan_newline(Scanner *scanner, TSLexer *lexer, const bool *valid_sym
         : 0;
     
     if (indent > current_indent && valid_symbols[INDENT]) {
-        array_push(&scanner->indents, indent);
+        stack_push(&scanner->indents, indent);
         lexer->result_symbol = INDENT;
         return true;
     }
     
-    if (indent < current_indent && valid_symbols[DEDENT]) {
-        array_pop(&scanner->indents);
-        lexer->result_symbol = DEDENT;
-        return true;
+    if (indent < current_indent) {
+        // Count every level this line closes so the rest can be emitted
+        // later as zero-width DEDENTs without scanning the line again
+        uint32_t dedents = 0;
+        while (dedents < scanner->indents.size &&
+               *array_get(&scanner->indents, scanner->indents.size - dedents - 1) > indent) {
+            dedents++;
+        }
+        
+        if (valid_symbols[DEDENT]) {
+            array_pop(&scanner->indents);
+            scanner->pending_dedents = dedents - 1;
+            lexer->result_symbol = DEDENT;
+            return true;
+        }
+        
+        if (valid_symbols[NEWLINE]) {
+            scanner->pending_dedents = dedents;
+            return true;
+        }
+        
+        return false;
     }
     
     return valid_symbols[NEWLINE];
 }
 
-static bool scan_string(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
-    int32_t quote_char = 0;
-    bool is_triple = false;
+// Scans a string prefix and opening quotes. Sets `*consumed` when it has
+// advanced over prefix letters that turn out not to start a string.
+static bool scan_string_start(Scanner *scanner, TSLexer *lexer, bool *consumed) {
     bool is_raw = false;
     bool is_format = false;
-    bool is_bytes = false;
-    
-    // Check for string prefix
-    if (valid_symbols[STRING_START]) {
-        // Check for prefix characters: r, R, f, F, b, B, u, U
-        while (true) {
-            int32_t c = lexer->lookahead;
-            if (c == 'r' || c == 'R') {
-                is_raw = true;
-                advance(lexer);
-            } else if (c == 'f' || c == 'F') {
-                is_format = true;
-                advance(lexer);
-            } else if (c == 'b' || c == 'B') {
-                is_bytes = true;
-                advance(lexer);
-            } else if (c == 'u' || c == 'U') {
-                advance(lexer);
-            } else {
-                break;
-            }
+    
+    // Check for prefix characters: r, R, f, F, b, B, u, U
+    while (true) {
+        int32_t c = lexer->lookahead;
+        if (c == 'r' || c == 'R') {
+            is_raw = true;
+        } else if (c == 'f' || c == 'F') {
+            is_format = true;
+        } else if (c != 'b' && c != 'B' && c != 'u' && c != 'U') {
+            break;
         }
-        
-        // Check for quote
-        if (lexer->lookahead == '"' || lexer->lookahead == '\'') {
-            quote_char = lexer->lookahead;
+        advance(lexer);
+        *consumed = true;
+    }
+    
+    if (lexer->lookahead != '"' && lexer->lookahead != '\'') {
+        return false;
+    }
+    int32_t quote_char = lexer->lookahead;
+    advance(lexer);
+    lexer->mark_end(lexer);
+    
+    // Two quotes are an empty string, which ends at the second; three
+    // open a triple-quoted string
+    bool is_triple = false;
+    if (lexer->lookahead == quote_char) {
+        advance(lexer);
+        if (lexer->lookahead == quote_char) {
             advance(lexer);
-            
-            // Check for triple quote
-            if (lexer->lookahead == quote_char) {
-                advance(lexer);
-                if (lexer->lookahead == quote_char) {
-                    advance(lexer);
-                    is_triple = true;
-                } else {
-                    // Empty string ""
-                    lexer->mark_end(lexer);
-                    lexer->result_symbol = STRING_START;
-                    return true;
-                }
-            }
-            
             lexer->mark_end(lexer);
-            lexer->result_symbol = STRING_START;
-            
-            // Push delimiter for tracking
-            int32_t delim = quote_char | (is_triple ? 0x100 : 0) | (is_raw ? 0x200 : 0) | (is_format ? 0x400 : 0);
-            array_push(&scanner->delimiters, delim);
-            scanner->inside_f_string = is_format;
-            
-            return true;
+            is_triple = true;
         }
     }
     
-    // Scan string content
-    if (valid_symbols[STRING_CONTENT] && scanner->delimiters.size > 0) {
-        int32_t delim = *array_back(&scanner->delimiters);
-        quote_char = delim & 0xFF;
-        is_triple = (delim & 0x100) != 0;
-        is_raw = (delim & 0x200) != 0;
-        is_format = (delim & 0x400) != 0;
+    int32_t delim = quote_char |
+        (is_triple ? DELIMITER_TRIPLE : 0) |
+        (is_raw ? DELIMITER_RAW : 0) |
+        (is_format ? DELIMITER_FORMAT : 0);
+    stack_push(&scanner->delimiters, delim);
+    lexer->result_symbol = STRING_START;
+    return true;
+}
+
+// Scans the innermost open string from inside it: either its closing
+// quotes, or its content up to them, to a real interpolation or, in a
+// single-line string, to the end of the line. Escape sequences, `{{` and
+// `}}`, and quotes that do not close a triple-quoted string all stay in one
+// content token. Each open string has its own delimiter, so a string
+// nested in an interpolation, even with the same quotes, is scanned with
+// its own flags and closes back to the string around it.
+static bool scan_string_body(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
+    int32_t delim = *array_back(&scanner->delimiters);
+    int32_t quote_char = delim & 0xFF;
+    bool is_triple = (delim & DELIMITER_TRIPLE) != 0;
+    bool is_raw = (delim & DELIMITER_RAW) != 0;
+    bool is_format = (delim & DELIMITER_FORMAT) != 0;
+    
+    bool has_content = false;
+    
+    // During error recovery the parser retries the scanner at many
+    // positions, so an unterminated string must not be scanned to the
+    // end of the file every time.
+    uint32_t budget = in_error_recovery(valid_symbols)
+        ? ERROR_RECOVERY_LOOKAHEAD
+        : UINT32_MAX;
+    
+    while (lexer->lookahead != 0) {
+        if (budget-- == 0) {
+            break;
+        }
         
-        bool has_content = false;
+        int32_t c = lexer->lookahead;
         
-        while (true) {
-            if (lexer->lookahead == 0) {
-                break;
-            }
-            
-            // Check for end of string
-            if (lexer->lookahead == quote_char) {
-                if (is_triple) {
-                    lexer->mark_end(lexer);
-                    advance(lexer);
-                    if (lexer->lookahead == quote_char) {
-                        advance(lexer);
-                        if (lexer->lookahead == quote_char) {
-                            // End of triple-quoted string
-                            if (has_content) {
-                                lexer->result_symbol = STRING_CONTENT;
-                                return true;
-                            }
-                            break;
-                        }
-                    }
-                    has_content = true;
-                    continue;
-                } else {
-                    // End of single-quoted string
-                    break;
-                }
-            }
-            
-            // Check for newline in non-triple string
-            if (!is_triple && is_newline(lexer->lookahead)) {
-                break;
+        if (c == quote_char) {
+            // The content, if any, ends before the quotes
+            lexer->mark_end(lexer);
+            advance(lexer);
+            uint32_t quotes = 1;
+            while (is_triple && quotes < 3 && lexer->lookahead == quote_char) {
+                advance(lexer);
+                quotes++;
             }
-            
-            // Check for interpolation in f-string
-            if (is_format && lexer->lookahead == '{') {
+            if (!is_triple || quotes == 3) {
                 if (has_content) {
-                    lexer->mark_end(lexer);
                     lexer->result_symbol = STRING_CONTENT;
-                    return true;
+                    return valid_symbols[STRING_CONTENT];
                 }
-                advance(lexer);
-                if (lexer->lookahead == '{') {
-                    // Escaped brace {{
-                    advance(lexer);
-                    has_content = true;
-                    lexer->mark_end(lexer);
-                    lexer->result_symbol = ESCAPE_INTERPOLATION;
-                    return true;
-                }
-                // Start of interpolation - handled by grammar
-                return false;
-            }
-            
-            // Check for escape sequence
-            if (!is_raw && lexer->lookahead == '\\') {
-                advance(lexer);
-                if (lexer->lookahead != 0) {
-                    advance(lexer);
+                if (!valid_symbols[STRING_END]) {
+                    return false;
                 }
-                has_content = true;
-                continue;
+                lexer->mark_end(lexer);
+                lexer->result_symbol = STRING_END;
+                array_pop(&scanner->delimiters);
+                return true;
             }
-            
-            advance(lexer);
+            // One or two quotes inside a triple-quoted string
             has_content = true;
+            continue;
         }
         
-        if (has_content) {
-            lexer->mark_end(lexer);
-            lexer->result_symbol = STRING_CONTENT;
-            return true;
+        if (!is_triple && is_newline(c)) {
+            break;
         }
-    }
-    
-    // Scan string end
-    if (valid_symbols[STRING_END] && scanner->delimiters.size > 0) {
-        int32_t delim = *array_back(&scanner->delimiters);
-        quote_char = delim & 0xFF;
-        is_triple = (delim & 0x100) != 0;
         
-        if (lexer->lookahead == quote_char) {
+        if (is_format && c == '{') {
+            lexer->mark_end(lexer);
             advance(lexer);
-            if (is_triple) {
-                if (lexer->lookahead == quote_char) {
-                    advance(lexer);
-                    if (lexer->lookahead == quote_char) {
-                        advance(lexer);
-                    } else {
-                        return false;
-                    }
-                } else {
-                    return false;
+            if (lexer->lookahead != '{') {
+                // A real interpolation, left to the grammar
+                if (has_content) {
+                    lexer->result_symbol = STRING_CONTENT;
+                    return valid_symbols[STRING_CONTENT];
                 }
+                return false;
             }
-            
-            lexer->mark_end(lexer);
-            lexer->result_symbol = STRING_END;
-            array_pop(&scanner->delimiters);
-            scanner->inside_f_string = scanner->delimiters.size > 0 && 
-                (*array_back(&scanner->delimiters) & 0x400) != 0;
-            return true;
+            advance(lexer);
+            has_content = true;
+            continue;
         }
+        
+        if (c == '\\') {
+            // A backslash always keeps the next quote, backslash or line
+            // break in the string; in raw strings it escapes nothing else.
+            // It never escapes a brace, so `f"\{x}"` and `rf"\{x}"` still
+            // interpolate
+            advance(lexer);
+            int32_t next = lexer->lookahead;
+            if (is_newline(next)) {
+                consume_newline(lexer, false);
+            } else if (next != 0 && !(is_format && next == '{') &&
+                       (!is_raw || next == quote_char || next == '\\')) {
+                advance(lexer);
+            }
+            has_content = true;
+            continue;
+        }
+        
+        advance(lexer);
+        has_content = true;
     }
     
+    if (has_content && valid_symbols[STRING_CONTENT]) {
+        lexer->mark_end(lexer);
+        lexer->result_symbol = STRING_CONTENT;
+        return true;
+    }
     return false;
 }
 
-bool tree_sitter_codon_external_scanner_scan(void *payload, TSLexer *lexer, const bool *valid_symbols) {
-    Scanner *scanner = (Scanner *)payload;
+static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
+    // DEDENTs left over from a line that closed several blocks belong to
+    // the position right after its NEWLINE. Any other token ends the run,
+    // so a count left behind by an error cannot pop levels later on.
+    uint32_t pending = scanner->pending_dedents;
+    scanner->pending_dedents = 0;
+    if (pending > 0 && valid_symbols[DEDENT]) {
+        STAT(scanner, pending_dedent_calls++);
+        scanner->pending_dedents = pending - 1;
+        array_pop(&scanner->indents);
+        lexer->mark_end(lexer);
+        lexer->result_symbol = DEDENT;
+        return true;
+    }
     
     // Handle DEDENT at EOF - emit remaining DEDENTs for unclosed indent levels
     if (valid_symbols[DEDENT] && scanner->indents.size > 0) {
@@ -409,15 +608,35 @@ bool tree_sitter_codon_external_scanner_scan(void *payload, TSLexer *lexer, cons
     }
     
     // Handle string tokens first
-    if (valid_symbols[STRING_START] || valid_symbols[STRING_CONTENT] || 
-        valid_symbols[STRING_END] || valid_symbols[ESCAPE_INTERPOLATION]) {
-        if (scan_string(scanner, lexer, valid_symbols)) {
+    if (valid_symbols[STRING_START] || valid_symbols[STRING_CONTENT] || valid_symbols[STRING_END]) {
+        STAT(scanner, string_calls++);
+        bool in_string = (valid_symbols[STRING_CONTENT] || valid_symbols[STRING_END]) &&
+            scanner->delimiters.size > 0;
+        // The runtime skips extras only for its own lexer, so a string after
+        // a space or tab has to be found here. Inside a string they are
+        // content.
+        if (valid_symbols[STRING_START] && !in_string) {
+            while (is_space(lexer->lookahead)) {
+                skip(lexer);
+            }
+        }
+        bool consumed = false;
+        if (valid_symbols[STRING_START] && scan_string_start(scanner, lexer, &consumed)) {
+            return true;
+        }
+        // Prefix letters without a quote are the start of an identifier,
+        // which no other external token can begin with
+        if (consumed) {
+            return false;
+        }
+        if (in_string && scan_string_body(scanner, lexer, valid_symbols)) {
             return true;
         }
     }
     
     // Handle newline/indent/dedent
     if (valid_symbols[NEWLINE] || valid_symbols[INDENT] || valid_symbols[DEDENT]) {
+        STAT(scanner, newline_calls++);
         if (scan_newline(scanner, lexer, valid_symbols)) {
             return true;
         }
@@ -425,3 +644,85 @@ bool tree_sitter_codon_external_scanner_scan(void *payload, TSLexer *lexer, cons
     
     return false;
 }
+
+#ifdef CODON_SCANNER_STATS
+
+// Forwards to the parser's lexer while counting the characters consumed
+typedef struct {
+    TSLexer lexer;
+    TSLexer *inner;
+    uint32_t chars;
+} CountingLexer;
+
+static void counting_advance(TSLexer *lexer, bool skip) {
+    CountingLexer *self = (CountingLexer *)lexer;
+    self->inner->advance(self->inner, skip);
+    self->chars++;
+    lexer->lookahead = self->inner->lookahead;
+}
+
+static void counting_mark_end(TSLexer *lexer) {
+    CountingLexer *self = (CountingLexer *)lexer;
+    self->inner->mark_end(self->inner);
+}
+
+static uint32_t counting_get_column(TSLexer *lexer) {
+    CountingLexer *self = (CountingLexer *)lexer;
+    return self->inner->get_column(self->inner);
+}
+
+static bool counting_is_at_included_range_start(const TSLexer *lexer) {
+    const CountingLexer *self = (const CountingLexer *)lexer;
+    return self->inner->is_at_included_range_start(self->inner);
+}
+
+static bool counting_eof(const TSLexer *lexer) {
+    const CountingLexer *self = (const CountingLexer *)lexer;
+    return self->inner->eof(self->inner);
+}
+
+static inline unsigned histogram_bucket(uint32_t chars) {
+    unsigned bucket = 0;
+    while (chars > 0 && bucket < CODON_SCANNER_HISTOGRAM_SIZE - 1) {
+        chars >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static bool scan_counted(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
+    // The copy keeps the runtime's log callback, which the scanner never calls
+    CountingLexer counting = {*lexer, lexer, 0};
+    counting.lexer.advance = counting_advance;
+    counting.lexer.mark_end = counting_mark_end;
+    counting.lexer.get_column = counting_get_column;
+    counting.lexer.is_at_included_range_start = counting_is_at_included_range_start;
+    counting.lexer.eof = counting_eof;
+
+    bool found = scan(scanner, &counting.lexer, valid_symbols);
+    lexer->result_symbol = counting.lexer.result_symbol;
+
+    CodonScannerStats *stats = &scanner->stats;
+    stats->scan_calls++;
+    if (in_error_recovery(valid_symbols)) stats->error_recovery_calls++;
+    stats->chars += counting.chars;
+    stats->chars_histogram[histogram_bucket(counting.chars)]++;
+    if (found) {
+        if (lexer->result_symbol < CODON_SCANNER_TOKEN_COUNT) stats->tokens[lexer->result_symbol]++;
+    } else if (counting.chars > 0) {
+        stats->wasted_calls++;
+        stats->wasted_chars += counting.chars;
+    }
+    return found;
+}
+
+#endif
+
+bool tree_sitter_codon_external_scanner_scan(void *payload, TSLexer *lexer, const bool *valid_symbols) {
+    Scanner *scanner = (Scanner *)payload;
+#ifdef CODON_SCANNER_STATS
+    return scan_counted(scanner, lexer, valid_symbols);
+#else
+    return scan(scanner, lexer, valid_symbols);
+#endif
+}